@@ -15,6 +15,7 @@ conf_path = ""
 test_client_path = ""
 test_client_tool_path = ""
 src_path = ""
+coroutine = False
 
 generator_path = sys.path[0]
 
@@ -37,7 +38,7 @@ def to_underline(input_s):
     return re
 
 def parseInput():
-    opts,args = getopt.getopt(sys.argv[1:], "hi:o:", longopts=["help", "input=", "output="])
+    opts,args = getopt.getopt(sys.argv[1:], "hci:o:", longopts=["help", "coroutine", "input=", "output="])
 
     for opts,arg in opts:
 
@@ -52,6 +53,9 @@ def parseInput():
             out_project_path = arg
             if out_project_path[-1] != '/':
                 out_project_path = out_project_path + '/'
+        elif opts=="-c" or opts=="--coroutine":
+            global coroutine
+            coroutine = True
         else:
             raise Exception("invalid options: [" + opts + ": " + arg + "]")
     
@@ -84,6 +88,9 @@ def printHelp():
     print('-o dir, --output dir')
     print(('    ') + 'Set the path that your want to generate project, please give a dir param.\n')
 
+    print('-c, --coroutine')
+    print(('    ') + 'Generate interfaces as C++20 coroutines that can co_await downstream rpc calls, the project builds with -std=c++20.\n')
+
     print('')
     print('For example:')
     print('rocket_generator.py -i order_server.proto -o ./')
@@ -184,6 +191,7 @@ def generate_makefile():
 
     content = tmpl.safe_substitute(
         PROJECT_NAME = project_name,
+        CXX_STD = 'c++20' if coroutine else 'c++11',
         CREATE_TIME = datetime.now().strftime('%Y-%m-%d %H:%M:%S'))
 
     file = open(out_file, 'w')
@@ -451,8 +459,9 @@ def generate_framework_code():
     print('=' * 100)
     print('Begin generate each rpc method interface.cc & interface.h')
     # genneator each interface.cc and .h file
-    interface_head_file_temlate = Template(open(generator_path + '/template/interface.h.template','r').read())
-    interface_cc_file_temlate = Template(open(generator_path + '/template/interface.cc.template','r').read())
+    interface_template_prefix = '/template/co_interface' if coroutine else '/template/interface'
+    interface_head_file_temlate = Template(open(generator_path + interface_template_prefix + '.h.template','r').read())
+    interface_cc_file_temlate = Template(open(generator_path + interface_template_prefix + '.cc.template','r').read())
     interface_test_client_file_template = Template(open(generator_path + '/template/test_rocket_client.cc.template','r').read())
 
     stub_name = service_name + "_Stub"
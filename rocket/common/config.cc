@@ -21,6 +21,23 @@ if (!name##_node) { \
   std::string name##_str = std::string(name##_node->GetText()); \
 
 
+#define READ_OPTIONAL_INT_FROM_XML_NODE(name, parent, value) \
+  if (parent) { \
+    TiXmlElement* name##_node = parent->FirstChildElement(#name); \
+    if (name##_node && name##_node->GetText()) { \
+      value = std::atoi(name##_node->GetText()); \
+    } \
+  } \
+
+
+#define READ_OPTIONAL_STR_FROM_XML_NODE(name, parent, value) \
+  if (parent) { \
+    TiXmlElement* name##_node = parent->FirstChildElement(#name); \
+    if (name##_node && name##_node->GetText()) { \
+      value = std::string(name##_node->GetText()); \
+    } \
+  } \
+
 
 namespace rocket {
 
@@ -79,9 +96,17 @@ Config::Config(const char* xmlfile) {
   m_log_file_path = log_file_path_str;
   m_log_max_file_size = std::atoi(log_max_file_size_str.c_str()) ;
   m_log_sync_inteval = std::atoi(log_sync_interval_str.c_str());
-
-  printf("LOG -- CONFIG LEVEL[%s], FILE_NAME[%s],FILE_PATH[%s] MAX_FILE_SIZE[%d B], SYNC_INTEVAL[%d ms]\n", 
-    m_log_level.c_str(), m_log_file_name.c_str(), m_log_file_path.c_str(), m_log_max_file_size, m_log_sync_inteval);
+  READ_OPTIONAL_INT_FROM_XML_NODE(log_thread_buffer_size, log_node, m_log_thread_buffer_size);
+  int log_binary = m_log_binary ? 1 : 0;
+  READ_OPTIONAL_INT_FROM_XML_NODE(log_binary, log_node, log_binary);
+  m_log_binary = (log_binary != 0);
+  READ_OPTIONAL_INT_FROM_XML_NODE(log_max_buffer_size, log_node, m_log_max_buffer_size);
+  READ_OPTIONAL_STR_FROM_XML_NODE(log_overflow_policy, log_node, m_log_overflow_policy);
+  READ_OPTIONAL_INT_FROM_XML_NODE(log_sync_size, log_node, m_log_sync_size);
+
+  printf("LOG -- CONFIG LEVEL[%s], FILE_NAME[%s],FILE_PATH[%s] MAX_FILE_SIZE[%d B], SYNC_INTEVAL[%d ms], THREAD_BUFFER_SIZE[%d B], BINARY[%d], MAX_BUFFER_SIZE[%d B], OVERFLOW_POLICY[%s], SYNC_SIZE[%d B]\n", 
+    m_log_level.c_str(), m_log_file_name.c_str(), m_log_file_path.c_str(), m_log_max_file_size, m_log_sync_inteval, m_log_thread_buffer_size, log_binary,
+    m_log_max_buffer_size, m_log_overflow_policy.c_str(), m_log_sync_size);
 
   READ_STR_FROM_XML_NODE(port, server_node);
   READ_STR_FROM_XML_NODE(io_threads, server_node);
@@ -89,6 +114,86 @@ Config::Config(const char* xmlfile) {
   m_port = std::atoi(port_str.c_str());
   m_io_threads = std::atoi(io_threads_str.c_str());
 
+  int reuse_port = m_reuse_port ? 1 : 0;
+  READ_OPTIONAL_INT_FROM_XML_NODE(reuse_port, server_node, reuse_port);
+  m_reuse_port = (reuse_port != 0);
+
+
+  TiXmlElement* eventloop_node = root_node->FirstChildElement("eventloop");
+  int epoll_adaptive = m_epoll_adaptive ? 1 : 0;
+  int epoll_edge_triggered = m_epoll_edge_triggered ? 1 : 0;
+  READ_OPTIONAL_INT_FROM_XML_NODE(epoll_max_events, eventloop_node, m_epoll_max_events);
+  READ_OPTIONAL_INT_FROM_XML_NODE(epoll_max_events_limit, eventloop_node, m_epoll_max_events_limit);
+  READ_OPTIONAL_INT_FROM_XML_NODE(epoll_adaptive, eventloop_node, epoll_adaptive);
+  READ_OPTIONAL_INT_FROM_XML_NODE(epoll_max_timeout, eventloop_node, m_epoll_max_timeout);
+  READ_OPTIONAL_INT_FROM_XML_NODE(epoll_edge_triggered, eventloop_node, epoll_edge_triggered);
+  m_epoll_adaptive = (epoll_adaptive != 0);
+  m_epoll_edge_triggered = (epoll_edge_triggered != 0);
+
+  printf("EVENTLOOP -- EPOLL_MAX_EVENTS[%d], EPOLL_MAX_EVENTS_LIMIT[%d], EPOLL_ADAPTIVE[%d], EPOLL_MAX_TIMEOUT[%d ms], EPOLL_EDGE_TRIGGERED[%d]\n",
+    m_epoll_max_events, m_epoll_max_events_limit, epoll_adaptive, m_epoll_max_timeout, epoll_edge_triggered);
+
+  TiXmlElement* io_balance_node = root_node->FirstChildElement("io_balance");
+  int enable = m_io_balance_enable ? 1 : 0;
+  READ_OPTIONAL_INT_FROM_XML_NODE(enable, io_balance_node, enable);
+  READ_OPTIONAL_INT_FROM_XML_NODE(interval, io_balance_node, m_io_balance_interval);
+  READ_OPTIONAL_INT_FROM_XML_NODE(min_imbalance, io_balance_node, m_io_balance_min_imbalance);
+  m_io_balance_enable = (enable != 0);
+
+  printf("IO_BALANCE -- ENABLE[%d], INTERVAL[%d ms], MIN_IMBALANCE[%d]\n", enable, m_io_balance_interval, m_io_balance_min_imbalance);
+
+  TiXmlElement* tinypb_node = root_node->FirstChildElement("tinypb");
+  READ_OPTIONAL_INT_FROM_XML_NODE(checksum, tinypb_node, m_tinypb_checksum);
+  READ_OPTIONAL_INT_FROM_XML_NODE(version, tinypb_node, m_tinypb_version);
+
+  printf("TINYPB -- CHECKSUM[%d], VERSION[%d]\n", m_tinypb_checksum, m_tinypb_version);
+
+  TiXmlElement* buffer_node = root_node->FirstChildElement("buffer");
+  READ_OPTIONAL_INT_FROM_XML_NODE(initial_size, buffer_node, m_buffer_initial_size);
+  READ_OPTIONAL_INT_FROM_XML_NODE(max_size, buffer_node, m_buffer_max_size);
+
+  printf("BUFFER -- INITIAL_SIZE[%d B], MAX_SIZE[%d B]\n", m_buffer_initial_size, m_buffer_max_size);
+
+  TiXmlElement* tcp_node = root_node->FirstChildElement("tcp");
+  int nodelay = m_tcp_nodelay ? 1 : 0;
+  READ_OPTIONAL_INT_FROM_XML_NODE(nodelay, tcp_node, nodelay);
+  m_tcp_nodelay = (nodelay != 0);
+
+  printf("TCP -- NODELAY[%d]\n", nodelay);
+
+  TiXmlElement* client_pool_node = root_node->FirstChildElement("client_pool");
+  READ_OPTIONAL_INT_FROM_XML_NODE(max_connections, client_pool_node, m_client_pool_max_connections);
+  READ_OPTIONAL_INT_FROM_XML_NODE(max_pending, client_pool_node, m_client_pool_max_pending);
+  READ_OPTIONAL_INT_FROM_XML_NODE(idle_timeout, client_pool_node, m_client_pool_idle_timeout);
+
+  printf("CLIENT_POOL -- MAX_CONNECTIONS[%d], MAX_PENDING[%d], IDLE_TIMEOUT[%d ms]\n",
+    m_client_pool_max_connections, m_client_pool_max_pending, m_client_pool_idle_timeout);
+
+  TiXmlElement* client_node = root_node->FirstChildElement("client");
+  READ_OPTIONAL_INT_FROM_XML_NODE(io_threads, client_node, m_client_io_threads);
+
+  printf("CLIENT -- IO Threads[%d]\n", m_client_io_threads);
+
+  TiXmlElement* worker_node = root_node->FirstChildElement("worker");
+  READ_OPTIONAL_INT_FROM_XML_NODE(threads, worker_node, m_worker_threads);
+  READ_OPTIONAL_INT_FROM_XML_NODE(max_queue, worker_node, m_worker_max_queue);
+  if (worker_node) {
+    for (TiXmlElement* node = worker_node->FirstChildElement("service"); node; node = node->NextSiblingElement("service")) {
+      TiXmlElement* name_node = node->FirstChildElement("name");
+      TiXmlElement* max_queue_node = node->FirstChildElement("max_queue");
+      if (name_node && name_node->GetText() && max_queue_node && max_queue_node->GetText()) {
+        m_worker_service_max_queue[name_node->GetText()] = std::atoi(max_queue_node->GetText());
+      }
+    }
+    for (TiXmlElement* node = worker_node->FirstChildElement("inline_method"); node; node = node->NextSiblingElement("inline_method")) {
+      if (node->GetText()) {
+        m_worker_inline_methods.insert(node->GetText());
+      }
+    }
+  }
+
+  printf("WORKER -- THREADS[%d], MAX_QUEUE[%d], %d service limits, %d inline methods\n",
+    m_worker_threads, m_worker_max_queue, (int)m_worker_service_max_queue.size(), (int)m_worker_inline_methods.size());
 
   TiXmlElement* stubs_node = root_node->FirstChildElement("stubs");
 
@@ -108,7 +213,7 @@ Config::Config(const char* xmlfile) {
 
 
 
-  printf("Server -- PORT[%d], IO Threads[%d]\n", m_port, m_io_threads);
+  printf("Server -- PORT[%d], IO Threads[%d], REUSE_PORT[%d]\n", m_port, m_io_threads, m_reuse_port ? 1 : 0);
 
 }
 
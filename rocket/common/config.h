@@ -2,6 +2,7 @@
 #define ROCKET_COMMON_CONFIG_H
 
 #include <map>
+#include <set>
 #include <tinyxml/tinyxml.h>
 #include "rocket/net/tcp/net_addr.h"
 
@@ -33,9 +34,52 @@ class Config {
   std::string m_log_file_path;
   int m_log_max_file_size {0};
   int m_log_sync_inteval {0};   
+  int m_log_thread_buffer_size {1024 * 1024};    // bytes of the log ring of every thread, optional <log_thread_buffer_size>
+  bool m_log_binary {false};    // optional <log_binary>, threads only copy the arguments of a line, the log thread formats it
+  int m_log_max_buffer_size {64 * 1024 * 1024};    // bytes waiting for the disk per log file, optional <log_max_buffer_size>, 0 is no cap
+  std::string m_log_overflow_policy {"drop_newest"};    // optional <log_overflow_policy>: drop_newest, drop_below_level or block
+  int m_log_sync_size {256 * 1024};    // optional <log_sync_size>, bytes in a ring that start a syncLoop before <log_sync_interval>
 
   int m_port {0};
   int m_io_threads {0};
+  bool m_reuse_port {false};    // optional <reuse_port>, every IO thread accepts on a SO_REUSEPORT socket of its own
+
+  // epoll settings of every IO thread's EventLoop, <eventloop> node is optional
+  int m_epoll_max_events {64};          // initial size of the epoll_event array
+  int m_epoll_max_events_limit {4096};  // adaptive mode never grows the array beyond this
+  bool m_epoll_adaptive {true};         // grow on a full batch, shrink when idle
+  int m_epoll_max_timeout {10000};      // ms, upper bound of epoll_wait timeout
+  bool m_epoll_edge_triggered {false};  // register tcp connections once with EPOLLET
+
+  // placement of server connections on IO threads, <io_balance> node is optional
+  bool m_io_balance_enable {true};          // false places connections round robin and never moves them
+  int m_io_balance_interval {1000};         // ms between load samples of the IO threads
+  int m_io_balance_min_imbalance {1000};    // requests per interval between the busiest and the least busy IO thread before an idle connection moves
+
+  // TinyPB frames, <tinypb> node is optional
+  int m_tinypb_checksum {1};     // CRC32C of sent frames and check of received ones. 0: off, 1: on, 2: on except for loopback peers. Frames with checksum 0 or 1 (older peers) are not verified
+  int m_tinypb_version {1};      // framing of client connections, servers accept both. 1: TinyPB, 2: compact TinyPB v2
+
+  // input buffer of every TcpConnection, <buffer> node is optional
+  int m_buffer_initial_size {0};                  // bytes of blocks reserved per connection, 0 allocates on demand
+  int m_buffer_max_size {64 * 1024 * 1024};       // a connection is closed when one message needs more, 0 means no limit
+
+  // sockets of client and server connections, <tcp> node is optional
+  bool m_tcp_nodelay {true};      // TCP_NODELAY, pipelined frames don't wait for the peer's delayed ACK. false leaves Nagle on
+
+  // per thread pool of RpcChannel connections, <client_pool> node is optional
+  int m_client_pool_max_connections {4};      // per peer, 0 opens a connection per call
+  int m_client_pool_max_pending {128};        // calls in flight on a connection before another one is opened
+  int m_client_pool_idle_timeout {60000};     // ms, a connection without calls for this long is closed
+
+  // <client> node is optional
+  int m_client_io_threads {0};    // IO threads owning RpcChannel connections, 0 runs calls in the caller thread's EventLoop
+
+  // business worker threads of a server, <worker> node is optional
+  int m_worker_threads {0};                 // 0 runs every handler on its connection's IO thread
+  int m_worker_max_queue {10000};           // requests of one service waiting for a worker, 0 means no limit
+  std::map<std::string, int> m_worker_service_max_queue;   // max_queue of single services
+  std::set<std::string> m_worker_inline_methods;           // "Service.method" that stay on the IO thread
 
   TiXmlDocument* m_xml_document{NULL};
 
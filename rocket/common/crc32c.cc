@@ -0,0 +1,217 @@
+#include <string.h>
+#include "rocket/common/crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace rocket {
+
+static const uint32_t g_crc32c_poly = 0x82F63B78;  // reflected Castagnoli polynomial
+
+// slicing-by-8 tables, g_crc32c_table[0] is the classic byte table
+static uint32_t g_crc32c_table[8][256];
+
+static bool initTable() {
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; ++j) {
+      crc = (crc >> 1) ^ ((crc & 1) ? g_crc32c_poly : 0);
+    }
+    g_crc32c_table[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; ++i) {
+    for (int k = 1; k < 8; ++k) {
+      uint32_t prev = g_crc32c_table[k - 1][i];
+      g_crc32c_table[k][i] = (prev >> 8) ^ g_crc32c_table[0][prev & 0xff];
+    }
+  }
+  return true;
+}
+
+static bool g_table_ready = initTable();
+
+
+uint32_t crc32cSoftware(uint32_t crc, const char* data, size_t len) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  crc = ~crc;
+  while (len >= 8) {
+    uint32_t lo;
+    uint32_t hi;
+    memcpy(&lo, p, sizeof(lo));
+    memcpy(&hi, p + 4, sizeof(hi));
+    lo ^= crc;
+    crc = g_crc32c_table[7][lo & 0xff] ^ g_crc32c_table[6][(lo >> 8) & 0xff] ^
+          g_crc32c_table[5][(lo >> 16) & 0xff] ^ g_crc32c_table[4][lo >> 24] ^
+          g_crc32c_table[3][hi & 0xff] ^ g_crc32c_table[2][(hi >> 8) & 0xff] ^
+          g_crc32c_table[1][(hi >> 16) & 0xff] ^ g_crc32c_table[0][hi >> 24];
+    p += 8;
+    len -= 8;
+  }
+  while (len > 0) {
+    crc = (crc >> 8) ^ g_crc32c_table[0][(crc ^ *p) & 0xff];
+    p++;
+    len--;
+  }
+  return ~crc;
+}
+
+
+#if defined(__x86_64__)
+
+// The crc32 instruction has a latency of 3 cycles but a throughput of 1, so large inputs
+// are split into three streams computed side by side. The stream crcs are then combined by
+// shifting a crc over kLongBlock (kShortBlock) zero bytes, a linear map kept as four byte tables.
+static const size_t kLongBlock = 8192;
+static const size_t kShortBlock = 256;
+
+static uint32_t g_crc32c_long_shift[4][256];
+static uint32_t g_crc32c_short_shift[4][256];
+
+static uint32_t gf2MatrixTimes(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void gf2MatrixSquare(uint32_t* square, const uint32_t* mat) {
+  for (int n = 0; n < 32; ++n) {
+    square[n] = gf2MatrixTimes(mat, mat[n]);
+  }
+}
+
+// operator that appends len zero bytes to a crc
+static void zerosOperator(uint32_t* even, size_t len) {
+  uint32_t odd[32];
+  odd[0] = g_crc32c_poly;
+  uint32_t row = 1;
+  for (int n = 1; n < 32; ++n) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  gf2MatrixSquare(even, odd);   // 2 zero bits
+  gf2MatrixSquare(odd, even);   // 4 zero bits
+
+  // the first square below gives one zero byte
+  while (true) {
+    gf2MatrixSquare(even, odd);
+    len >>= 1;
+    if (len == 0) {
+      return;
+    }
+    gf2MatrixSquare(odd, even);
+    len >>= 1;
+    if (len == 0) {
+      break;
+    }
+  }
+  for (int n = 0; n < 32; ++n) {
+    even[n] = odd[n];
+  }
+}
+
+static void initShiftTable(uint32_t table[][256], size_t len) {
+  uint32_t op[32];
+  zerosOperator(op, len);
+  for (uint32_t n = 0; n < 256; ++n) {
+    table[0][n] = gf2MatrixTimes(op, n);
+    table[1][n] = gf2MatrixTimes(op, n << 8);
+    table[2][n] = gf2MatrixTimes(op, n << 16);
+    table[3][n] = gf2MatrixTimes(op, n << 24);
+  }
+}
+
+static uint32_t shiftCrc(uint32_t table[][256], uint32_t crc) {
+  return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const char* data, size_t len) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  uint64_t crc0 = ~crc;
+
+  size_t block = kLongBlock;
+  uint32_t (*shift)[256] = g_crc32c_long_shift;
+  for (int round = 0; round < 2; ++round) {
+    while (len >= block * 3) {
+      uint64_t crc1 = 0;
+      uint64_t crc2 = 0;
+      const unsigned char* end = p + block;
+      do {
+        uint64_t w0;
+        uint64_t w1;
+        uint64_t w2;
+        memcpy(&w0, p, sizeof(w0));
+        memcpy(&w1, p + block, sizeof(w1));
+        memcpy(&w2, p + 2 * block, sizeof(w2));
+        crc0 = _mm_crc32_u64(crc0, w0);
+        crc1 = _mm_crc32_u64(crc1, w1);
+        crc2 = _mm_crc32_u64(crc2, w2);
+        p += 8;
+      } while (p < end);
+      crc0 = shiftCrc(shift, (uint32_t)crc0) ^ crc1;
+      crc0 = shiftCrc(shift, (uint32_t)crc0) ^ crc2;
+      p += block * 2;
+      len -= block * 3;
+    }
+    block = kShortBlock;
+    shift = g_crc32c_short_shift;
+  }
+
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    crc0 = _mm_crc32_u64(crc0, word);
+    p += 8;
+    len -= 8;
+  }
+  uint32_t crc32 = (uint32_t)crc0;
+  while (len > 0) {
+    crc32 = _mm_crc32_u8(crc32, *p);
+    p++;
+    len--;
+  }
+  return ~crc32;
+}
+
+typedef uint32_t (*Crc32cFunc)(uint32_t, const char*, size_t);
+
+static Crc32cFunc selectCrc32c() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) {
+    initShiftTable(g_crc32c_long_shift, kLongBlock);
+    initShiftTable(g_crc32c_short_shift, kShortBlock);
+    return crc32cHardware;
+  }
+  return crc32cSoftware;
+}
+
+static Crc32cFunc g_crc32c_func = selectCrc32c();
+
+uint32_t crc32c(uint32_t crc, const char* data, size_t len) {
+  return g_crc32c_func(crc, data, len);
+}
+
+bool crc32cHardwareEnabled() {
+  return g_crc32c_func == crc32cHardware;
+}
+
+#else
+
+uint32_t crc32c(uint32_t crc, const char* data, size_t len) {
+  return crc32cSoftware(crc, data, len);
+}
+
+bool crc32cHardwareEnabled() {
+  return false;
+}
+
+#endif
+
+}
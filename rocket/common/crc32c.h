@@ -0,0 +1,21 @@
+#ifndef ROCKET_COMMON_CRC32C_H
+#define ROCKET_COMMON_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace rocket {
+
+// CRC32C (Castagnoli) of data, continuing from crc. crc32c(0, ...) starts a new checksum.
+// Uses the SSE4.2 crc32 instruction when the cpu has it, a table driven version otherwise.
+uint32_t crc32c(uint32_t crc, const char* data, size_t len);
+
+// the portable version, always available
+uint32_t crc32cSoftware(uint32_t crc, const char* data, size_t len);
+
+// true if crc32c() runs on the SSE4.2 instruction
+bool crc32cHardwareEnabled();
+
+}
+
+#endif
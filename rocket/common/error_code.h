@@ -22,6 +22,7 @@ const int ERROR_METHOD_NOT_FOUND = SYS_ERROR_PREFIX(0009);        // Method not
 const int ERROR_PARSE_SERVICE_NAME = SYS_ERROR_PREFIX(0010);      // Failed to parse service name
 const int ERROR_RPC_CHANNEL_INIT = SYS_ERROR_PREFIX(0011);        // RPC channel initialization failed
 const int ERROR_RPC_PEER_ADDR = SYS_ERROR_PREFIX(0012);           // Peer address exception during RPC call
+const int ERROR_SERVICE_BUSY = SYS_ERROR_PREFIX(0013);            // Too many requests of the service wait for a worker
 
 
 
@@ -0,0 +1,155 @@
+#ifndef ROCKET_COMMON_FLAT_HASH_MAP_H
+#define ROCKET_COMMON_FLAT_HASH_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+namespace rocket {
+
+/*
+ * Open addressing hash map from uint64_t to T, linear probing in one flat array.
+ * Erase shifts the following entries back, so there are no tombstones and a
+ * lookup never walks more than the cluster its key is in.
+ * Meant for small hot tables such as the in-flight requests of a connection.
+ */
+template <class T>
+class FlatHashMap {
+
+ public:
+  FlatHashMap() {
+    m_slots.resize(kMinCapacity);
+  }
+
+  size_t size() const {
+    return m_size;
+  }
+
+  bool empty() const {
+    return m_size == 0;
+  }
+
+  // NULL if key is not in the map. The pointer is valid until the next insert or erase
+  T* find(uint64_t key) {
+    size_t i = indexOf(key);
+    while (m_slots[i].used) {
+      if (m_slots[i].key == key) {
+        return &m_slots[i].value;
+      }
+      i = (i + 1) & (m_slots.size() - 1);
+    }
+    return NULL;
+  }
+
+  // false if key is already in the map, the map is not changed then
+  bool insert(uint64_t key, T value) {
+    if ((m_size + 1) * 2 > m_slots.size()) {
+      rehash(m_slots.size() * 2);
+    }
+    size_t i = indexOf(key);
+    while (m_slots[i].used) {
+      if (m_slots[i].key == key) {
+        return false;
+      }
+      i = (i + 1) & (m_slots.size() - 1);
+    }
+    m_slots[i].used = true;
+    m_slots[i].key = key;
+    m_slots[i].value = std::move(value);
+    m_size++;
+    return true;
+  }
+
+  // move the value of key to out and remove it, false if key is not in the map
+  bool take(uint64_t key, T& out) {
+    size_t mask = m_slots.size() - 1;
+    size_t i = indexOf(key);
+    while (m_slots[i].used && m_slots[i].key != key) {
+      i = (i + 1) & mask;
+    }
+    if (!m_slots[i].used) {
+      return false;
+    }
+    out = std::move(m_slots[i].value);
+
+    // shift back every following entry of the cluster that may live at i
+    size_t hole = i;
+    size_t j = (i + 1) & mask;
+    while (m_slots[j].used) {
+      size_t home = indexOf(m_slots[j].key);
+      // j may move to hole only if its home is not inside (hole, j]
+      if (((j - home) & mask) >= ((j - hole) & mask)) {
+        m_slots[hole].key = m_slots[j].key;
+        m_slots[hole].value = std::move(m_slots[j].value);
+        hole = j;
+      }
+      j = (j + 1) & mask;
+    }
+    m_slots[hole].used = false;
+    m_slots[hole].value = T();
+    m_size--;
+    return true;
+  }
+
+  bool erase(uint64_t key) {
+    T tmp;
+    return take(key, tmp);
+  }
+
+  // move every value out and leave the map empty
+  void takeAll(std::vector<T>& out) {
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+      if (m_slots[i].used) {
+        out.push_back(std::move(m_slots[i].value));
+      }
+    }
+    clear();
+  }
+
+  void clear() {
+    m_slots.clear();
+    m_slots.resize(kMinCapacity);
+    m_size = 0;
+  }
+
+ private:
+  struct Slot {
+    uint64_t key {0};
+    bool used {false};
+    T value;
+  };
+
+  static const size_t kMinCapacity = 16;
+
+  // msg ids are sequential, mix all bits into the low ones (splitmix64 finalizer)
+  size_t indexOf(uint64_t key) const {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return (size_t)key & (m_slots.size() - 1);
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<Slot> old;
+    old.swap(m_slots);
+    m_slots.resize(capacity);
+    m_size = 0;
+    for (size_t i = 0; i < old.size(); ++i) {
+      if (old[i].used) {
+        insert(old[i].key, std::move(old[i].value));
+      }
+    }
+  }
+
+ private:
+  std::vector<Slot> m_slots;
+  size_t m_size {0};
+
+};
+
+}
+
+#endif
@@ -1,6 +1,14 @@
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
 #include <sstream>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <assert.h>
 #include <signal.h>
 #include "rocket/common/log.h"
@@ -16,6 +24,74 @@ namespace rocket {
 
 static Logger* g_logger = NULL;
 
+// per thread state of Logger::log(), the ring and the cached parts of the prefix
+struct ThreadLogContext {
+  Logger* logger {NULL};
+  LogRing::s_ptr ring;
+  bool exited {false};
+  bool overflow {false};
+  uint64_t overflow_sync {0};   // Logger::m_sync_count at the overflow
+  bool sync_thread {false};     // runs Logger::syncLoop
+  bool writer {false};          // an AsyncLogger thread, never waits for a ring
+
+  time_t second {-1};
+  char time_str[32];        // "yy-mm-dd HH:MM:SS" of second
+  size_t time_len {0};
+  char thread_str[32];      // "pid:tid"
+  size_t thread_len {0};
+
+  ~ThreadLogContext() {
+    if (ring) {
+      ring->close();
+    }
+    exited = true;
+  }
+};
+
+static thread_local ThreadLogContext t_log_context;
+
+// appends to a fixed buffer and keeps counting past its end
+class LineWriter {
+ public:
+  LineWriter(char* buf, size_t size) : m_buf(buf), m_size(size) {}
+
+  void append(const char* str, size_t len) {
+    if (m_len + len <= m_size) {
+      memcpy(m_buf + m_len, str, len);
+    }
+    m_len += len;
+  }
+
+  void append(const char* str) {
+    append(str, strlen(str));
+  }
+
+  void appendInt(int64_t value) {
+    char tmp[24];
+    char* end = tmp + sizeof(tmp);
+    char* p = end;
+    bool negative = value < 0;
+    uint64_t v = negative ? -(uint64_t)value : value;
+    do {
+      *--p = '0' + v % 10;
+      v /= 10;
+    } while (v);
+    if (negative) {
+      *--p = '-';
+    }
+    append(p, end - p);
+  }
+
+  size_t length() const {
+    return m_len;
+  }
+
+ private:
+  char* m_buf {NULL};
+  size_t m_size {0};
+  size_t m_len {0};
+};
+
 void CoredumpHandler(int signal_no) {
   ERRORLOG("progress received invalid signal, will exit");
   g_logger->flush();
@@ -36,6 +112,18 @@ Logger::Logger(LogLevel level, int type /*=1*/) : m_set_level(level), m_type(typ
   if (m_type == 0) {
     return;
   }
+  m_ring_size = Config::GetGlobalConfig()->m_log_thread_buffer_size;
+  m_binary = Config::GetGlobalConfig()->m_log_binary;
+  m_max_buffer_size = Config::GetGlobalConfig()->m_log_max_buffer_size;
+  m_sync_size = Config::GetGlobalConfig()->m_log_sync_size;
+  const std::string& policy = Config::GetGlobalConfig()->m_log_overflow_policy;
+  if (policy == "drop_below_level") {
+    m_overflow_policy = DropBelowLevel;
+  } else if (policy == "block") {
+    m_overflow_policy = BlockProducer;
+  } else {
+    m_overflow_policy = DropNewest;
+  }
   m_asnyc_logger = std::make_shared<AsyncLogger>(
       Config::GetGlobalConfig()->m_log_file_name + "_rpc",
       Config::GetGlobalConfig()->m_log_file_path,
@@ -61,8 +149,11 @@ void Logger::init() {
   if (m_type == 0) {
     return;
   }
+  // the timer bounds how long a line waits, checkSync() starts a sync early when a ring fills up
+  m_event_loop = EventLoop::GetCurrentEventLoop();
+  t_log_context.sync_thread = true;
   m_timer_event = std::make_shared<TimerEvent>(Config::GetGlobalConfig()->m_log_sync_inteval, true, std::bind(&Logger::syncLoop, this));
-  EventLoop::GetCurrentEventLoop()->addTimerEvent(m_timer_event);
+  m_event_loop->addTimerEvent(m_timer_event);
   signal(SIGSEGV, CoredumpHandler);
   signal(SIGABRT, CoredumpHandler);
   signal(SIGTERM, CoredumpHandler);
@@ -74,28 +165,113 @@ void Logger::init() {
 
 
 void Logger::syncLoop() {
-  // Synchronize m_buffer to the async_logger's buffer queue
-  // printf("sync to async logger\n");
-  std::vector<std::string> tmp_vec;
+  ScopeMutex<Mutex> sync_lock(m_sync_mutex);
+  m_sync_pending = false;
+
+  // Synchronize the rings and m_buffer to the async_logger's buffer queue
+  std::vector<LogBlock> tmp_vec;
+  std::vector<LogBlock> tmp_vec2;
+  std::vector<LogRing::s_ptr> rings;
+  int64_t queued[2];      // rpc and app
+  uint64_t dropped[2] = {0, 0};
   {
     ScopeMutex<Mutex> lock(m_mutex);
-    tmp_vec.swap(m_buffer);
+    rings = m_rings;
+    queued[0] = m_asnyc_logger->getQueuedBytes() + m_buffer_bytes;
+  }
+  {
+    ScopeMutex<Mutex> lock(m_app_mutex);
+    queued[1] = m_asnyc_app_logger->getQueuedBytes() + m_app_buffer_bytes;
   }
 
-  if (!tmp_vec.empty()) {
-    m_async_logger->pushLogBuffer(tmp_vec);
+  // every ring becomes one block, lines of a thread stay in order. In binary mode the block
+  // keeps the records as they are, with size and flags in front of each
+  bool binary = m_binary;
+  bool block_policy = m_overflow_policy == BlockProducer;
+  bool has_closed = false;
+  for (size_t i = 0; i < rings.size(); ++i) {
+    bool closed = rings[i]->isClosed();
+    has_closed = has_closed || closed;
+
+    LogBlock block;
+    LogBlock app_block;
+    block.binary = app_block.binary = binary;
+    rings[i]->drain([this, &block, &app_block, &queued, &dropped, binary, block_policy](const char* data, size_t size, uint32_t flags) {
+      int app = (flags & kAppLog) ? 1 : 0;
+      if (!underCap(queued[app], size, (flags >> kLevelShift) & 0xff)) {
+        // blocking leaves the rest of the ring, the thread waits in waitForRing()
+        if (block_policy) {
+          return false;
+        }
+        dropped[app]++;
+        return true;
+      }
+      queued[app] += size;
+
+      LogBlock& to = app ? app_block : block;
+      if (binary) {
+        uint32_t head[2] = {(uint32_t)size, flags};
+        to.data.append(reinterpret_cast<const char*>(head), sizeof(head));
+      }
+      to.data.append(data, size);
+      to.lines++;
+      return true;
+    });
+    if (!block.data.empty()) {
+      tmp_vec.push_back(std::move(block));
+    }
+    if (!app_block.data.empty()) {
+      tmp_vec2.push_back(std::move(app_block));
+    }
   }
-  tmp_vec.clear();
 
-  // Synchronize m_app_buffer to the app_async_logger's buffer queue
-  std::vector<std::string> tmp_vec2;
+  // m_buffer after the rings: a thread only falls back to it when its ring is full, so these
+  // lines are newer than the ones drained above
   {
+    ScopeMutex<Mutex> lock(m_mutex);
     ScopeMutex<Mutex> lock2(m_app_mutex);
-    tmp_vec2.swap(m_app_buffer);
+    for (size_t i = 0; i < m_buffer.size(); ++i) {
+      tmp_vec.push_back(LogBlock());
+      tmp_vec.back().data.swap(m_buffer[i]);
+      tmp_vec.back().lines = 1;
+    }
+    m_buffer.clear();
+    m_buffer_bytes = 0;
+    for (size_t i = 0; i < m_app_buffer.size(); ++i) {
+      tmp_vec2.push_back(LogBlock());
+      tmp_vec2.back().data.swap(m_app_buffer[i]);
+      tmp_vec2.back().lines = 1;
+    }
+    m_app_buffer.clear();
+    m_app_buffer_bytes = 0;
+    m_sync_count++;
+    lock2.unlock();
+
+    // a closed ring was drained above and gets no more lines
+    if (has_closed) {
+      for (auto it = m_rings.begin(); it != m_rings.end(); ) {
+        if ((*it)->isClosed() && (*it)->used() == 0) {
+          it = m_rings.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+  }
+
+  if (dropped[0]) {
+    m_asnyc_logger->addDroppedLines(dropped[0]);
+  }
+  if (dropped[1]) {
+    m_asnyc_app_logger->addDroppedLines(dropped[1]);
+  }
+
+  if (!tmp_vec.empty()) {
+    m_asnyc_logger->pushLogBuffer(tmp_vec);
   }
 
   if (!tmp_vec2.empty()) {
-    m_async_app_logger->pushLogBuffer(tmp_vec2);
+    m_asnyc_app_logger->pushLogBuffer(tmp_vec2);
   }
 }
 
@@ -196,21 +372,260 @@ void Logger::pushAppLog(const std::string& msg) {
 }
 
 
-void Logger::log() {
-  
+LogRing* Logger::getThreadLogRing() {
+  if (m_type == 0 || t_log_context.exited) {
+    return NULL;
+  }
+  if (t_log_context.overflow) {
+    if (t_log_context.overflow_sync == m_sync_count.load(std::memory_order_acquire)) {
+      return NULL;
+    }
+    t_log_context.overflow = false;
+  }
+  if (t_log_context.logger != this) {
+    if (t_log_context.ring) {
+      t_log_context.ring->close();
+    }
+    t_log_context.ring = std::make_shared<LogRing>(m_ring_size);
+    t_log_context.logger = this;
+    ScopeMutex<Mutex> lock(m_mutex);
+    m_rings.push_back(t_log_context.ring);
+  }
+  return t_log_context.ring.get();
+}
+
+
+void Logger::pushOverflow(const std::string& msg, int level, bool app) {
+  if (m_type == 0) {
+    app ? pushAppLog(msg) : pushLog(msg);
+    return;
+  }
+  AsyncLogger* writer = app ? m_asnyc_app_logger.get() : m_asnyc_logger.get();
+  int64_t& bytes = app ? m_app_buffer_bytes : m_buffer_bytes;
+  Mutex& mutex = app ? m_app_mutex : m_mutex;
+  ScopeMutex<Mutex> lock(mutex);
+  while (!underCap(writer->getQueuedBytes() + bytes, msg.size(), level)) {
+    lock.unlock();
+    // a line bigger than the ring, or one that found the ring just drained, waits here too
+    if (m_overflow_policy != BlockProducer || t_log_context.writer) {
+      writer->addDroppedLines(1);
+      return;
+    }
+    if (t_log_context.sync_thread) {
+      syncLoop();
+    } else {
+      requestSync();
+    }
+    usleep(500);
+    lock.lock();
+  }
+  (app ? m_app_buffer : m_buffer).push_back(msg);
+  bytes += msg.size();
+  bool sync = bytes >= m_sync_size;
+  if (!t_log_context.exited) {
+    // the count is read with the line pushed, the next syncLoop takes both
+    t_log_context.overflow = true;
+    t_log_context.overflow_sync = m_sync_count.load(std::memory_order_relaxed);
+  }
+  lock.unlock();
+
+  if (sync) {
+    requestSync();
+  }
+}
+
+
+bool Logger::underCap(int64_t queued, size_t size, int level) const {
+  // a line always fits when nothing waits, even if it is bigger than the cap
+  if (m_max_buffer_size <= 0 || queued == 0) {
+    return true;
+  }
+  int64_t cap = m_max_buffer_size;
+  if (m_overflow_policy == DropBelowLevel && level < Error) {
+    cap -= cap / 4;
+  }
+  return queued + (int64_t)size <= cap;
+}
+
+
+void Logger::requestSync() {
+  if (m_event_loop && !m_sync_pending.exchange(true)) {
+    m_event_loop->addTask([this]() {
+      syncLoop();
+    }, true);
+  }
+}
+
+
+bool Logger::waitForRing(LogRing* ring) {
+  if (m_overflow_policy != BlockProducer || t_log_context.writer || ring->used() == 0) {
+    return false;
+  }
+  // the thread of the EventLoop would wait for itself
+  if (t_log_context.sync_thread) {
+    syncLoop();
+    if (ring->used() < ring->capacity() / 2) {
+      return true;
+    }
+  } else {
+    requestSync();
+  }
+  usleep(500);
+  return true;
+}
+
+
+// the prefix of a line, the time string is cached per second by the calling thread
+static void WritePrefix(LineWriter& writer, int level, const timeval& now, const char* thread_str, size_t thread_len,
+    const char* msgid, size_t msgid_len, const char* method, size_t method_len, const char* file, int line) {
+  static const char* level_str[] = {"[UNKNOWN]\t[", "[DEBUG]\t[", "[INFO]\t[", "[ERROR]\t["};
+
+  ThreadLogContext& context = t_log_context;
+  if (now.tv_sec != context.second) {
+    struct tm now_time;
+    localtime_r(&now.tv_sec, &now_time);
+    context.time_len = strftime(context.time_str, sizeof(context.time_str), "%y-%m-%d %H:%M:%S", &now_time);
+    context.second = now.tv_sec;
+  }
+
+  writer.append(level_str[level >= Debug && level <= Error ? level : 0]);
+  writer.append(context.time_str, context.time_len);
+  writer.append(".", 1);
+  writer.appendInt(now.tv_usec / 1000);
+  writer.append("]\t[", 3);
+  writer.append(thread_str, thread_len);
+  writer.append("]\t", 2);
+
+  if (msgid_len > 0) {
+    writer.append("[", 1);
+    writer.append(msgid, msgid_len);
+    writer.append("]\t", 2);
+  }
+  if (method_len > 0) {
+    writer.append("[", 1);
+    writer.append(method, method_len);
+    writer.append("]\t", 2);
+  }
+
+  writer.append("[", 1);
+  writer.append(file);
+  writer.append(":", 1);
+  writer.appendInt(line);
+  writer.append("]\t", 2);
+}
+
+
+size_t Logger::FormatPrefix(char* buf, size_t size, const LogSite* site) {
+  ThreadLogContext& context = t_log_context;
+  if (context.thread_len == 0) {
+    context.thread_len = snprintf(context.thread_str, sizeof(context.thread_str), "%d:%d", getPid(), getThreadId());
+  }
+  timeval now;
+  gettimeofday(&now, NULL);
+
+  RunTime* run_time = RunTime::GetRunTime();
+  LineWriter writer(buf, size);
+  WritePrefix(writer, site->level, now, context.thread_str, context.thread_len,
+    run_time->m_msgid.c_str(), run_time->m_msgid.length(),
+    run_time->m_method_name.c_str(), run_time->m_method_name.length(), site->file, site->line);
+  return writer.length();
+}
+
+
+// start of a kBinaryLog record, followed by msgid, method name and the arguments
+struct BinaryLogHeader {
+  const LogSite* site;
+  LogFormatFunc format;
+  int64_t sec;
+  int32_t usec;
+  int32_t thread_id;
+  uint16_t msgid_len;
+  uint16_t method_len;
+};
+
+static const size_t kMaxBinaryString = 0xffff;
+
+size_t Logger::BinaryHeaderSize() {
+  RunTime* run_time = RunTime::GetRunTime();
+  return sizeof(BinaryLogHeader) + std::min(run_time->m_msgid.length(), kMaxBinaryString)
+    + std::min(run_time->m_method_name.length(), kMaxBinaryString);
+}
+
+char* Logger::WriteBinaryHeader(char* buf, const LogSite* site, LogFormatFunc format) {
+  timeval now;
+  gettimeofday(&now, NULL);
+
+  RunTime* run_time = RunTime::GetRunTime();
+  BinaryLogHeader header;
+  header.site = site;
+  header.format = format;
+  header.sec = now.tv_sec;
+  header.usec = now.tv_usec;
+  header.thread_id = getThreadId();
+  header.msgid_len = std::min(run_time->m_msgid.length(), kMaxBinaryString);
+  header.method_len = std::min(run_time->m_method_name.length(), kMaxBinaryString);
+
+  memcpy(buf, &header, sizeof(header));
+  buf += sizeof(header);
+  memcpy(buf, run_time->m_msgid.c_str(), header.msgid_len);
+  buf += header.msgid_len;
+  memcpy(buf, run_time->m_method_name.c_str(), header.method_len);
+  return buf + header.method_len;
+}
+
+void Logger::FormatBinary(const char* data, size_t size, std::string& out) {
+  BinaryLogHeader header;
+  memcpy(&header, data, sizeof(header));
+  const char* msgid = data + sizeof(header);
+  const char* method = msgid + header.msgid_len;
+
+  char thread_str[32];
+  LineWriter thread_writer(thread_str, sizeof(thread_str));
+  thread_writer.appendInt(getPid());
+  thread_writer.append(":", 1);
+  thread_writer.appendInt(header.thread_id);
+
+  timeval now;
+  now.tv_sec = header.sec;
+  now.tv_usec = header.usec;
+
+  char prefix[512];
+  LineWriter writer(prefix, sizeof(prefix));
+  WritePrefix(writer, header.site->level, now, thread_str, thread_writer.length(), msgid, header.msgid_len,
+    method, header.method_len, header.site->file, header.site->line);
+  if (writer.length() <= sizeof(prefix)) {
+    out.append(prefix, writer.length());
+  } else {
+    size_t len = out.size();
+    out.resize(len + writer.length());
+    LineWriter long_writer(&out[len], writer.length());
+    WritePrefix(long_writer, header.site->level, now, thread_str, thread_writer.length(), msgid, header.msgid_len,
+      method, header.method_len, header.site->file, header.site->line);
+  }
+
+  header.format(out, header.site->format, method + header.method_len);
+  out += '\n';
+}
+
+
+static int64_t MonotonicNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
 
 AsyncLogger::AsyncLogger(const std::string& file_name, const std::string& file_path, int max_size) 
   : m_file_name(file_name), m_file_path(file_path), m_max_file_size(max_size) {
   
-  sem_init(&m_sempahore, 0, 0);
+  sem_init(&m_semaphore, 0, 0);
+  pthread_cond_init(&m_written_condition, NULL);
 
   assert(pthread_create(&m_thread, NULL, &AsyncLogger::Loop, this) == 0);
 
-  // assert(pthread_cond_init(&m_condtion, NULL) == 0);
+  // assert(pthread_cond_init(&m_condition, NULL) == 0);
 
-  sem_wait(&m_sempahore);
+  sem_wait(&m_semaphore);
 
 }
 
@@ -219,99 +634,275 @@ void* AsyncLogger::Loop(void* arg) {
 
   AsyncLogger* logger = reinterpret_cast<AsyncLogger*>(arg); 
 
-  assert(pthread_cond_init(&logger->m_condtion, NULL) == 0);
+  assert(pthread_cond_init(&logger->m_condition, NULL) == 0);
 
-  sem_post(&logger->m_sempahore);
+  logger->m_rate_begin_ns = MonotonicNs();
+  t_log_context.writer = true;
+
+  sem_post(&logger->m_semaphore);
 
   while(1) {
     ScopeMutex<Mutex> lock(logger->m_mutex);
-    while(logger->m_buffer.empty()) {
-      // printf("begin pthread_cond_wait back \n");
-      pthread_cond_wait(&(logger->m_condtion), logger->m_mutex.getMutex());
+    while (logger->m_buffer.empty() && !logger->m_stop_flag) {
+      // wake up every second to keep bytes_per_sec current while idle
+      timeval now;
+      gettimeofday(&now, NULL);
+      timespec abs_time;
+      abs_time.tv_sec = now.tv_sec + 1;
+      abs_time.tv_nsec = now.tv_usec * 1000;
+      logger->m_waiting = true;
+      int rt = pthread_cond_timedwait(&(logger->m_condition), logger->m_mutex.getMutex(), &abs_time);
+      logger->m_waiting = false;
+      if (rt == ETIMEDOUT) {
+        lock.unlock();
+        logger->updateRate();
+        lock.lock();
+      }
     }
-    // printf("pthread_cond_wait back \n");
 
-    std::vector<std::string> tmp;
-    tmp.swap(logger->m_buffer.front());
-    logger->m_buffer.pop();
+    // double buffering: pushLogBuffer fills the vector written last time while this one is written
+    logger->m_writing.swap(logger->m_buffer);
+    uint64_t pushed = logger->m_pushed;
+    bool stop = logger->m_stop_flag;
+    lock.unlock();
 
+    if (!logger->m_writing.empty()) {
+      int64_t bytes = 0;
+      for (size_t i = 0; i < logger->m_writing.size(); ++i) {
+        bytes += logger->m_writing[i].data.size();
+      }
+      logger->writeBlocks(logger->m_writing);
+      logger->m_writing.clear();
+      logger->m_queued_bytes -= bytes;
+    }
+    logger->updateRate();
+
+    lock.lock();
+    logger->m_written = pushed;
+    pthread_cond_broadcast(&logger->m_written_condition);
+    bool finished = stop && logger->m_buffer.empty();
     lock.unlock();
+    if (finished) {
+      break;
+    }
+  }
+
+  if (logger->m_fd >= 0) {
+    close(logger->m_fd);
+    logger->m_fd = -1;
+  }
+  // a flush() after the exit must not wait for lines pushed too late
+  ScopeMutex<Mutex> lock(logger->m_mutex);
+  logger->m_exited = true;
+  pthread_cond_broadcast(&logger->m_written_condition);
+  return NULL;
+}
 
-    timeval now;
-    gettimeofday(&now, NULL);
 
+void AsyncLogger::writeBlocks(std::vector<LogBlock>& blocks) {
+  time_t now = time(NULL);
+  if (now >= m_next_day) {
+    // the date only changes at midnight
     struct tm now_time;
-    localtime_r(&(now.tv_sec), &now_time);
-    
-    const char* format = "%Y%m%d";
+    localtime_r(&now, &now_time);
     char date[32];
-    strftime(date, sizeof(date), format, &now_time);
-
-    if (std::string(date) != logger->m_date) {
-      logger->m_no = 0;
-      logger->m_reopen_flag = true;
-      logger->m_date = std::string(date);
-    }
-    if (logger->m_file_hanlder == NULL) {
-      logger->m_reopen_flag = true;
+    strftime(date, sizeof(date), "%Y%m%d", &now_time);
+
+    now_time.tm_mday++;
+    now_time.tm_hour = 0;
+    now_time.tm_min = 0;
+    now_time.tm_sec = 0;
+    now_time.tm_isdst = -1;
+    m_next_day = mktime(&now_time);
+
+    if (m_date != date) {
+      m_date = date;
+      m_file_prefix = m_file_path + m_file_name + "_" + m_date + "_log.";
+      m_no = 0;
+      if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+      }
     }
+  }
 
-    std::stringstream ss;
-    ss << logger->m_file_path << logger->m_file_name << "_"
-      << std::string(date) << "_log.";
-    std::string log_file_name = ss.str() + std::to_string(logger->m_no);
-
-    if (logger->m_reopen_flag) {
-      if (logger->m_file_hanlder) {
-        fclose(logger->m_file_hanlder);
+  std::vector<iovec> iovs;
+  std::vector<int> iov_lines;
+  iovs.reserve(blocks.size());
+  iov_lines.reserve(blocks.size());
+  size_t text_count = 0;
+  for (auto& i : blocks) {
+    const std::string* data = &i.data;
+    if (i.binary) {
+      // size and flags, then the record
+      if (m_text.size() <= text_count) {
+        m_text.resize(text_count + 1);
+      }
+      std::string& text = m_text[text_count++];
+      text.clear();
+      const char* p = i.data.c_str();
+      const char* end = p + i.data.length();
+      while (p < end) {
+        uint32_t head[2];
+        memcpy(head, p, sizeof(head));
+        p += sizeof(head);
+        if (head[1] & Logger::kBinaryLog) {
+          Logger::FormatBinary(p, head[0], text);
+        } else {
+          text.append(p, head[0]);
+        }
+        p += head[0];
       }
-      logger->m_file_hanlder = fopen(log_file_name.c_str(), "a");
-      logger->m_reopen_flag = false;
+      data = &text;
+    }
+    if (data->empty()) {
+      continue;
     }
+    iovec iov;
+    iov.iov_base = const_cast<char*>(data->c_str());
+    iov.iov_len = data->length();
+    iovs.push_back(iov);
+    iov_lines.push_back(i.lines);
+  }
 
-    if (ftell(logger->m_file_hanlder) > logger->m_max_file_size) {
-      fclose(logger->m_file_hanlder);
+  size_t index = 0;
+  while (index < iovs.size()) {
+    if (m_fd < 0 && !openFile()) {
+      break;
+    }
+    // whole blocks up to the file size, a file gets at least one block
+    size_t end = index;
+    int64_t size = 0;
+    while (end < iovs.size() && (m_max_file_size <= 0 || (m_file_size == 0 && end == index)
+        || m_file_size + size + (int64_t)iovs[end].iov_len <= m_max_file_size)) {
+      size += iovs[end].iov_len;
+      end++;
+    }
+    if (end == index) {
+      close(m_fd);
+      m_fd = -1;
+      m_no++;
+      continue;
+    }
+    if (!writeIovecs(iovs, iov_lines, index, end)) {
+      break;
+    }
+  }
+  for (; index < iovs.size(); ++index) {
+    m_failed_lines += iov_lines[index];
+  }
+}
 
-      log_file_name = ss.str() + std::to_string(logger->m_no++);
-      logger->m_file_hanlder = fopen(log_file_name.c_str(), "a");
-      logger->m_reopen_flag = false;
 
+bool AsyncLogger::writeIovecs(std::vector<iovec>& iovs, const std::vector<int>& lines, size_t& index, size_t end) {
+  while (index < end) {
+    int count = std::min(end - index, (size_t)IOV_MAX);
+    ssize_t rt = writev(m_fd, &iovs[index], count);
+    if (rt < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // the file is opened again for the next batch
+      ERRORLOG("write log file failed, errno=%d, error=%s", errno, strerror(errno));
+      close(m_fd);
+      m_fd = -1;
+      return false;
     }
-
-    for (auto& i : tmp) {
-      if (!i.empty()) {
-        fwrite(i.c_str(), 1, i.length(), logger->m_file_hanlder);
+    m_writes++;
+    m_written_bytes += rt;
+    m_file_size += rt;
+    // a partial write leaves the rest of an iovec for the next call
+    while (rt > 0) {
+      if ((size_t)rt >= iovs[index].iov_len) {
+        rt -= iovs[index].iov_len;
+        m_written_lines += lines[index];
+        index++;
+      } else {
+        iovs[index].iov_base = reinterpret_cast<char*>(iovs[index].iov_base) + rt;
+        iovs[index].iov_len -= rt;
+        rt = 0;
       }
     }
-    fflush(logger->m_file_hanlder);
+  }
+  return true;
+}
 
-    if (logger->m_stop_flag) {
-      return NULL;
+
+bool AsyncLogger::openFile() {
+  while (true) {
+    std::string log_file_name = m_file_prefix + std::to_string(m_no);
+    m_fd = open(log_file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+      return false;
     }
+    struct stat st;
+    m_file_size = fstat(m_fd, &st) == 0 ? st.st_size : 0;
+    if (m_max_file_size <= 0 || m_file_size < m_max_file_size) {
+      return true;
+    }
+    close(m_fd);
+    m_fd = -1;
+    m_no++;
   }
+}
 
-  return NULL;
+
+void AsyncLogger::updateRate() {
+  int64_t now = MonotonicNs();
+  if (now - m_rate_begin_ns < 1000000000) {
+    return;
+  }
+  uint64_t bytes = m_written_bytes.load();
+  m_bytes_per_sec = (bytes - m_rate_begin_bytes) * 1000000000 / (now - m_rate_begin_ns);
+  m_rate_begin_ns = now;
+  m_rate_begin_bytes = bytes;
 }
 
 
 void AsyncLogger::stop() {
+  ScopeMutex<Mutex> lock(m_mutex);
   m_stop_flag = true;
+  pthread_cond_signal(&m_condition);
 }
 
 void AsyncLogger::flush() {
-  if (m_file_hanlder) {
-    fflush(m_file_hanlder);
+  ScopeMutex<Mutex> lock(m_mutex);
+  uint64_t target = m_pushed;
+  while (m_written < target && !m_exited) {
+    pthread_cond_wait(&m_written_condition, m_mutex.getMutex());
   }
 }
 
-void AsyncLogger::pushLogBuffer(std::vector<std::string>& vec) {
+void AsyncLogger::pushLogBuffer(std::vector<LogBlock>& vec) {
+  int64_t bytes = 0;
+  for (size_t i = 0; i < vec.size(); ++i) {
+    bytes += vec[i].data.size();
+  }
+  m_queued_bytes += bytes;
   ScopeMutex<Mutex> lock(m_mutex);
-  m_buffer.push(vec);
-  pthread_cond_signal(&m_condtion);
-
-  lock.unlock();
+  m_pushed++;
+  if (m_buffer.empty()) {
+    m_buffer.swap(vec);
+  } else {
+    for (size_t i = 0; i < vec.size(); ++i) {
+      m_buffer.push_back(std::move(vec[i]));
+    }
+  }
+  vec.clear();
+  if (m_waiting) {
+    pthread_cond_signal(&m_condition);
+  }
+}
 
-  // printf("pthread_cond_signal\n");
+AsyncLogger::Stats AsyncLogger::getStats() {
+  Stats stats;
+  stats.written_bytes = m_written_bytes;
+  stats.written_lines = m_written_lines;
+  stats.dropped_lines = m_dropped_lines;
+  stats.failed_lines = m_failed_lines;
+  stats.writes = m_writes;
+  stats.bytes_per_sec = m_bytes_per_sec;
+  return stats;
 }
 
 }
\ No newline at end of file
@@ -4,10 +4,13 @@
 #include <string>
 #include <queue>
 #include <memory>
+#include <atomic>
 #include <semaphore.h>
 
 #include "rocket/common/config.h"
 #include "rocket/common/mutex.h"
+#include "rocket/common/log_ring.h"
+#include "rocket/common/log_args.h"
 #include "rocket/net/timer_event.h"
 
 namespace rocket {
@@ -28,49 +31,57 @@ std::string formatString(const char* str, Args&&... args) {
 }
 
 
+// Levels below ROCKET_MIN_LOG_LEVEL (1 Debug, 2 Info, 3 Error) are compiled out, build with
+// make ROCKET_MIN_LOG_LEVEL=3 to keep only ERRORLOG. The arguments of a log macro are only
+// evaluated when its level is enabled, so ShortDebugString() and the like cost nothing otherwise
+#ifndef ROCKET_MIN_LOG_LEVEL
+#define ROCKET_MIN_LOG_LEVEL 1
+#endif
+
+
 #define DEBUGLOG(str, ...) \
-  if (rocket::Logger::GetGlobalLogger()->getLogLevel() && rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Debug) \
+  if (ROCKET_MIN_LOG_LEVEL <= rocket::Debug && rocket::Logger::GetGlobalLogger()->getLogLevel() && rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Debug) \
   { \
-    rocket::Logger::GetGlobalLogger()->pushLog(rocket::LogEvent(rocket::LogLevel::Debug).toString() \
-      + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n");\
+    static const rocket::LogSite rocket_log_site = {rocket::LogLevel::Debug, false, __FILE__, __LINE__, str}; \
+    rocket::Logger::GetGlobalLogger()->log(&rocket_log_site, ##__VA_ARGS__); \
   } \
 
 
 #define INFOLOG(str, ...) \
-  if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Info) \
+  if (ROCKET_MIN_LOG_LEVEL <= rocket::Info && rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Info) \
   { \
-    rocket::Logger::GetGlobalLogger()->pushLog(rocket::LogEvent(rocket::LogLevel::Info).toString() \
-    + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n");\
+    static const rocket::LogSite rocket_log_site = {rocket::LogLevel::Info, false, __FILE__, __LINE__, str}; \
+    rocket::Logger::GetGlobalLogger()->log(&rocket_log_site, ##__VA_ARGS__); \
   } \
 
 #define ERRORLOG(str, ...) \
-  if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Error) \
+  if (ROCKET_MIN_LOG_LEVEL <= rocket::Error && rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Error) \
   { \
-    rocket::Logger::GetGlobalLogger()->pushLog(rocket::LogEvent(rocket::LogLevel::Error).toString() \
-      + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n");\
+    static const rocket::LogSite rocket_log_site = {rocket::LogLevel::Error, false, __FILE__, __LINE__, str}; \
+    rocket::Logger::GetGlobalLogger()->log(&rocket_log_site, ##__VA_ARGS__); \
   } \
 
 
 #define APPDEBUGLOG(str, ...) \
-  if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Debug) \
+  if (ROCKET_MIN_LOG_LEVEL <= rocket::Debug && rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Debug) \
   { \
-    rocket::Logger::GetGlobalLogger()->pushAppLog(rocket::LogEvent(rocket::LogLevel::Debug).toString() \
-      + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n");\
+    static const rocket::LogSite rocket_log_site = {rocket::LogLevel::Debug, true, __FILE__, __LINE__, str}; \
+    rocket::Logger::GetGlobalLogger()->log(&rocket_log_site, ##__VA_ARGS__); \
   } \
 
 
 #define APPINFOLOG(str, ...) \
-  if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Info) \
+  if (ROCKET_MIN_LOG_LEVEL <= rocket::Info && rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Info) \
   { \
-    rocket::Logger::GetGlobalLogger()->pushAppLog(rocket::LogEvent(rocket::LogLevel::Info).toString() \
-    + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n");\
+    static const rocket::LogSite rocket_log_site = {rocket::LogLevel::Info, true, __FILE__, __LINE__, str}; \
+    rocket::Logger::GetGlobalLogger()->log(&rocket_log_site, ##__VA_ARGS__); \
   } \
 
 #define APPERRORLOG(str, ...) \
-  if (rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Error) \
+  if (ROCKET_MIN_LOG_LEVEL <= rocket::Error && rocket::Logger::GetGlobalLogger()->getLogLevel() <= rocket::Error) \
   { \
-    rocket::Logger::GetGlobalLogger()->pushAppLog(rocket::LogEvent(rocket::LogLevel::Error).toString() \
-      + "[" + std::string(__FILE__) + ":" + std::to_string(__LINE__) + "]\t" + rocket::formatString(str, ##__VA_ARGS__) + "\n");\
+    static const rocket::LogSite rocket_log_site = {rocket::LogLevel::Error, true, __FILE__, __LINE__, str}; \
+    rocket::Logger::GetGlobalLogger()->log(&rocket_log_site, ##__VA_ARGS__); \
   } \
 
 
@@ -90,22 +101,55 @@ LogLevel StringToLogLevel(const std::string& log_level);
 #include <queue>
 #include <pthread.h>
 #include <semaphore.h>
+#include <sys/uio.h>
 #include <string>
 #include <vector>
 #include <memory>
 
+// lines of text, or in binary mode the LogRing records of a thread, which the
+// AsyncLogger thread formats before writing them
+struct LogBlock {
+  std::string data;
+  bool binary {false};
+  int lines {0};
+};
+
 class AsyncLogger {
 public:
   typedef std::shared_ptr<AsyncLogger> s_ptr;
 
+  // counters of the writer thread, read from any thread
+  struct Stats {
+    uint64_t written_bytes {0};
+    uint64_t written_lines {0};
+    uint64_t dropped_lines {0};    // over the memory cap of the Logger
+    uint64_t failed_lines {0};     // the file could not be opened or written
+    uint64_t writes {0};           // writev calls
+    uint64_t bytes_per_sec {0};    // over the last second
+  };
+
   AsyncLogger(const std::string& file_name, const std::string& file_path, int max_size);
 
+  // the thread writes what is queued and exits
   void stop();
 
-  // Flush the logs to disk
+  // Waits until every block pushed before the call is written, or the thread has exited.
+  // Lines still in the threads' rings are not pushed yet, Logger::flush() syncs them first
   void flush();
 
-  void pushLogBuffer(std::vector<std::string>& vec);
+  // takes the blocks, vec is empty afterwards
+  void pushLogBuffer(std::vector<LogBlock>& vec);
+
+  Stats getStats();
+
+  // bytes pushed and not written yet
+  int64_t getQueuedBytes() const {
+    return m_queued_bytes.load(std::memory_order_relaxed);
+  }
+
+  void addDroppedLines(uint64_t lines) {
+    m_dropped_lines += lines;
+  }
 
 public:
   static void* Loop(void*);
@@ -114,9 +158,23 @@ public:
   pthread_t m_thread;
 
 private:
-  // m_file_path/m_file_name_yyyymmdd.0
+  // every block of a batch in as few writev calls as possible
+  void writeBlocks(std::vector<LogBlock>& blocks);
+
+  // writes iovs[index, end) to m_fd, index is moved past what was written
+  bool writeIovecs(std::vector<iovec>& iovs, const std::vector<int>& lines, size_t& index, size_t end);
+
+  // opens m_file_prefix + m_no, skipping numbers that are already full
+  bool openFile();
+
+  void updateRate();
+
+private:
+  // m_file_path/m_file_name_yyyymmdd_log.0
 
-  std::queue<std::vector<std::string>> m_buffer;
+  std::vector<LogBlock> m_buffer;     // filled by pushLogBuffer, swapped with m_writing by the thread
+  std::vector<LogBlock> m_writing;
+  std::vector<std::string> m_text;    // binary blocks formatted
 
   std::string m_file_name;  // Log output file name
   std::string m_file_path;  // Log output path
@@ -127,17 +185,40 @@ private:
   pthread_cond_t m_condition;  // Condition variable
   Mutex m_mutex;
 
+  bool m_waiting {false};     // the thread sleeps on m_condition
+
+  pthread_cond_t m_written_condition;   // signaled after every batch, flush() waits on it
+  uint64_t m_pushed {0};       // pushLogBuffer calls so far
+  uint64_t m_written {0};      // pushLogBuffer calls whose blocks are written
+  bool m_exited {false};
+
   std::string m_date;  // Current file date for log printing
-  FILE* m_file_handler {NULL};  // Current opened log file handler
+  time_t m_next_day {0};       // the date is formatted again from this time on
+  std::string m_file_prefix;   // m_file_path + m_file_name + "_" + m_date + "_log."
 
-  bool m_reopen_flag {false};
+  int m_fd {-1};
+  int64_t m_file_size {0};
 
   int m_no {0};  // Log file number
 
   bool m_stop_flag {false};
+
+  std::atomic<uint64_t> m_written_bytes {0};
+  std::atomic<uint64_t> m_written_lines {0};
+  std::atomic<uint64_t> m_dropped_lines {0};
+  std::atomic<uint64_t> m_failed_lines {0};
+  std::atomic<uint64_t> m_writes {0};
+  std::atomic<uint64_t> m_bytes_per_sec {0};
+
+  int64_t m_rate_begin_ns {0};
+  uint64_t m_rate_begin_bytes {0};
+
+  std::atomic<int64_t> m_queued_bytes {0};
 };
 
 
+class EventLoop;
+
 class Logger {
  public:
   typedef std::shared_ptr<Logger> s_ptr;
@@ -150,7 +231,61 @@ class Logger {
 
   void init();
 
-  void log();
+  // Formats the line straight into the calling thread's LogRing, no lock and no allocation.
+  // In binary mode it only copies the arguments there, the AsyncLogger thread formats them.
+  // A line the ring has no room for goes through pushLog()/pushAppLog()
+  template<typename... Args>
+  void log(const LogSite* site, Args&&... args) {
+    LogRing* ring = getThreadLogRing();
+    if (ring && m_binary) {
+      typedef LogArgs<typename std::decay<Args>::type...> Codec;
+      size_t size = BinaryHeaderSize() + Codec::Size(args...);
+      while (true) {
+        size_t free_size = 0;
+        char* buf = ring->beginWrite(&free_size);
+        if (buf && size <= free_size) {
+          Codec::Encode(WriteBinaryHeader(buf, site, &Codec::template Format<>), args...);
+          ring->commitWrite(size, (site->level << kLevelShift) | (site->app ? kAppLog : 0) | kBinaryLog);
+          checkSync(ring);
+          return;
+        }
+        if (!ring->skipToFront() && !waitForRing(ring)) {
+          break;
+        }
+      }
+      ring = NULL;
+    }
+
+    while (ring) {
+      size_t size = 0;
+      char* buf = ring->beginWrite(&size);
+      if (buf) {
+        size_t len = FormatPrefix(buf, size, site);
+        if (len < size) {
+          int n = snprintf(buf + len, size - len, site->format, args...);
+          if (n >= 0 && len + n < size) {
+            buf[len + n] = '\n';
+            ring->commitWrite(len + n + 1, (site->level << kLevelShift) | (site->app ? kAppLog : 0));
+            checkSync(ring);
+            return;
+          }
+        }
+      }
+      if (!ring->skipToFront() && !waitForRing(ring)) {
+        break;
+      }
+    }
+
+    std::string msg(256, '\0');
+    size_t len = FormatPrefix(&msg[0], msg.size(), site);
+    if (len > msg.size()) {
+      msg.resize(len);
+      FormatPrefix(&msg[0], msg.size(), site);
+    }
+    msg.resize(len);
+    msg += formatString(site->format, args...) + "\n";
+    pushOverflow(msg, site->level, site->app);
+  }
 
   LogLevel getLogLevel() const {
     return m_set_level;
@@ -173,6 +308,55 @@ class Logger {
 
   static void InitGlobalLogger(int type = 1);
 
+  // "[level]\t[time]\t[pid:tid]\t[msgid]\t[method]\t[file:line]\t" into buf, returns its length
+  // even if that is more than size. The time is formatted once per second and thread
+  static size_t FormatPrefix(char* buf, size_t size, const LogSite* site);
+
+  // appends the text line of a kBinaryLog record to out
+  static void FormatBinary(const char* data, size_t size, std::string& out);
+
+ public:
+  static const uint32_t kAppLog = 1;       // LogRing record flag of the app log
+  static const uint32_t kBinaryLog = 2;    // LogRing record flag, the line is a site and raw arguments
+  static const int kLevelShift = 8;        // the LogLevel of a record is in the flags from this bit on
+
+  // what happens to a line over <log_max_buffer_size>
+  enum OverflowPolicy {
+    DropNewest = 0,
+    DropBelowLevel = 1,   // the last quarter of the cap is kept for ERROR lines
+    BlockProducer = 2,    // the thread waits for room in its ring, a line too big for it waits under the cap,
+                          // only lines of the AsyncLogger thread itself are dropped
+  };
+
+ private:
+  // ring of the calling thread, created on its first line. NULL for the stdout logger, and
+  // after an overflow until the next syncLoop, so the lines of a thread stay in order
+  LogRing* getThreadLogRing();
+
+  // m_buffer or m_app_buffer if under the cap, the line is dropped otherwise
+  void pushOverflow(const std::string& msg, int level, bool app);
+
+  // true when size more bytes at level fit in the cap, queued is what already waits for the disk
+  bool underCap(int64_t queued, size_t size, int level) const;
+
+  // a syncLoop on m_event_loop, once until it runs
+  void requestSync();
+
+  // a ring over <log_sync_size> is synced before the timer
+  void checkSync(LogRing* ring) {
+    if ((int64_t)ring->used() >= m_sync_size && !m_sync_pending.load(std::memory_order_relaxed)) {
+      requestSync();
+    }
+  }
+
+  // BlockProducer: the ring of the calling thread is full, waits for syncLoop to take some of it.
+  // false when the line has to go to pushOverflow
+  bool waitForRing(LogRing* ring);
+
+  // bytes of a binary record before its arguments, and writing them, for the calling thread
+  static size_t BinaryHeaderSize();
+  static char* WriteBinaryHeader(char* buf, const LogSite* site, LogFormatFunc format);
+
  private:
   LogLevel m_set_level;
   std::vector<std::string> m_buffer;
@@ -183,6 +367,26 @@ class Logger {
 
   Mutex m_app_mutex;
 
+  std::vector<LogRing::s_ptr> m_rings;   // one per thread that logged, guarded by m_mutex
+
+  Mutex m_sync_mutex;     // one syncLoop at a time, it is the reader of every ring
+
+  int m_ring_size {0};
+
+  bool m_binary {false};
+
+  std::atomic<uint64_t> m_sync_count {0};    // syncLoops that took m_buffer
+
+  int64_t m_max_buffer_size {0};    // per log file, lines queued in AsyncLogger and m_buffer together
+  int m_overflow_policy {DropNewest};
+  int64_t m_sync_size {0};
+
+  int64_t m_buffer_bytes {0};       // guarded by m_mutex
+  int64_t m_app_buffer_bytes {0};   // guarded by m_app_mutex
+
+  EventLoop* m_event_loop {NULL};   // runs syncLoop
+  std::atomic<bool> m_sync_pending {false};
+
   // m_file_path/m_file_name_yyyymmdd.1
 
   std::string m_file_name;     // Log output file name
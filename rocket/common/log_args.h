@@ -0,0 +1,121 @@
+#ifndef ROCKET_COMMON_LOG_ARGS_H
+#define ROCKET_COMMON_LOG_ARGS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+namespace rocket {
+
+// Raw arguments of a log line in binary mode. The line only stores the bytes of its
+// arguments, LogArgs<Args...>::Format turns them back into the printf arguments later
+typedef void (*LogFormatFunc)(std::string& out, const char* format, const char* data);
+
+// one per log macro call site, static and constant initialized. format must be a string literal
+struct LogSite {
+  int level;
+  bool app;
+  const char* file;
+  int line;
+  const char* format;
+};
+
+
+// numbers, enums and pointers for %p are copied as they are
+template<typename T>
+struct LogArg {
+  static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+    "log arguments must be numbers, enums, pointers or C strings");
+
+  static size_t Size(T value) {
+    return sizeof(T);
+  }
+
+  static char* Encode(char* buf, T value) {
+    memcpy(buf, &value, sizeof(T));
+    return buf + sizeof(T);
+  }
+
+  static const char* Decode(const char* buf, T* value) {
+    memcpy(value, buf, sizeof(T));
+    return buf + sizeof(T);
+  }
+};
+
+// C strings are copied with their terminating 0, the pointer may not live until the line is formatted.
+// The codec goes by type and never sees the format, so every char pointer is taken for a %s
+// argument: print one with %p as (void*)p. NULL is stored as "(null)", as glibc prints it for %s
+template<>
+struct LogArg<const char*> {
+  static size_t Size(const char* value) {
+    return value ? strlen(value) + 1 : sizeof("(null)");
+  }
+
+  static char* Encode(char* buf, const char* value) {
+    return stpcpy(buf, value ? value : "(null)") + 1;
+  }
+
+  static const char* Decode(const char* buf, const char** value) {
+    *value = buf;
+    return buf + strlen(buf) + 1;
+  }
+};
+
+template<>
+struct LogArg<char*> : public LogArg<const char*> {
+  static const char* Decode(const char* buf, char** value) {
+    *value = const_cast<char*>(buf);
+    return buf + strlen(buf) + 1;
+  }
+};
+
+
+template<typename... Args>
+struct LogArgs;
+
+template<>
+struct LogArgs<> {
+  static size_t Size() {
+    return 0;
+  }
+
+  static char* Encode(char* buf) {
+    return buf;
+  }
+
+  // every argument decoded, append the formatted message
+  template<typename... Decoded>
+  static void Format(std::string& out, const char* format, const char* data, Decoded... decoded) {
+    size_t len = out.size();
+    out.resize(len + 256);
+    int n = snprintf(&out[len], 256, format, decoded...);
+    if (n >= 256) {
+      out.resize(len + n + 1);
+      snprintf(&out[len], n + 1, format, decoded...);
+    }
+    out.resize(len + (n > 0 ? n : 0));
+  }
+};
+
+template<typename T, typename... Rest>
+struct LogArgs<T, Rest...> {
+  static size_t Size(T value, Rest... rest) {
+    return LogArg<T>::Size(value) + LogArgs<Rest...>::Size(rest...);
+  }
+
+  static char* Encode(char* buf, T value, Rest... rest) {
+    return LogArgs<Rest...>::Encode(LogArg<T>::Encode(buf, value), rest...);
+  }
+
+  template<typename... Decoded>
+  static void Format(std::string& out, const char* format, const char* data, Decoded... decoded) {
+    T value;
+    data = LogArg<T>::Decode(data, &value);
+    LogArgs<Rest...>::Format(out, format, data, decoded..., value);
+  }
+};
+
+}
+
+#endif
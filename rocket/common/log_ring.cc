@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <algorithm>
+#include "rocket/common/log_ring.h"
+
+namespace rocket {
+
+LogRing::LogRing(size_t capacity) {
+  m_capacity = 4096;
+  while (m_capacity < capacity) {
+    m_capacity <<= 1;
+  }
+  m_data = reinterpret_cast<char*>(malloc(m_capacity));
+}
+
+LogRing::~LogRing() {
+  if (m_data) {
+    free(m_data);
+    m_data = NULL;
+  }
+}
+
+char* LogRing::beginWrite(size_t* size) {
+  uint64_t write_pos = m_write_pos.load(std::memory_order_relaxed);
+  size_t free_size = m_capacity - (write_pos - m_read_pos.load(std::memory_order_acquire));
+  size_t offset = write_pos & (m_capacity - 1);
+  size_t contiguous = std::min(free_size, m_capacity - offset);
+  if (contiguous <= sizeof(Header)) {
+    *size = 0;
+    return NULL;
+  }
+  *size = contiguous - sizeof(Header);
+  return m_data + offset + sizeof(Header);
+}
+
+void LogRing::commitWrite(size_t size, uint32_t flags) {
+  uint64_t write_pos = m_write_pos.load(std::memory_order_relaxed);
+  Header header;
+  header.size = size;
+  header.flags = flags;
+  memcpy(m_data + (write_pos & (m_capacity - 1)), &header, sizeof(header));
+  m_write_pos.store(write_pos + align(sizeof(header) + size), std::memory_order_release);
+}
+
+bool LogRing::skipToFront() {
+  uint64_t write_pos = m_write_pos.load(std::memory_order_relaxed);
+  size_t free_size = m_capacity - (write_pos - m_read_pos.load(std::memory_order_acquire));
+  size_t offset = write_pos & (m_capacity - 1);
+  size_t rest = m_capacity - offset;
+  // the front is only worth it when it has more room than the rest of the ring
+  if (offset == 0 || free_size <= 2 * rest) {
+    return false;
+  }
+  commitWrite(rest - sizeof(Header), kPadding);
+  return true;
+}
+
+}
@@ -0,0 +1,100 @@
+#ifndef ROCKET_COMMON_LOG_RING_H
+#define ROCKET_COMMON_LOG_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+
+namespace rocket {
+
+// Byte ring with one writer (the thread that logs) and one reader (Logger::syncLoop).
+// A record is an 8 byte header followed by its payload, always contiguous: when the rest of
+// the ring is too short the writer pads it and starts again at the front.
+class LogRing {
+ public:
+  typedef std::shared_ptr<LogRing> s_ptr;
+
+  // capacity is rounded up to a power of two
+  explicit LogRing(size_t capacity);
+
+  ~LogRing();
+
+  // writer side. Free contiguous space for the next payload, NULL if the ring is full
+  char* beginWrite(size_t* size);
+
+  // publishes the payload written at beginWrite(), size is at most what it returned
+  void commitWrite(size_t size, uint32_t flags);
+
+  // pads the rest of the ring so the next record starts at the front, false when this
+  // would not give more contiguous space
+  bool skipToFront();
+
+  // reader side. Calls f(data, size, flags) for every committed record and frees them. When
+  // f returns false its record and the ones after it stay in the ring
+  template<typename F>
+  size_t drain(F f) {
+    uint64_t read_pos = m_read_pos.load(std::memory_order_relaxed);
+    uint64_t write_pos = m_write_pos.load(std::memory_order_acquire);
+    size_t count = 0;
+    while (read_pos < write_pos) {
+      Header header;
+      char* record = m_data + (read_pos & (m_capacity - 1));
+      memcpy(&header, record, sizeof(header));
+      if (!(header.flags & kPadding)) {
+        if (!f(record + sizeof(header), header.size, header.flags)) {
+          break;
+        }
+        count++;
+      }
+      read_pos += align(sizeof(header) + header.size);
+    }
+    m_read_pos.store(read_pos, std::memory_order_release);
+    return count;
+  }
+
+  // bytes written and not drained yet
+  size_t used() const {
+    return m_write_pos.load(std::memory_order_acquire) - m_read_pos.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const {
+    return m_capacity;
+  }
+
+  // the writer thread has exited, the reader drops the ring once it is empty
+  void close() {
+    m_closed.store(true, std::memory_order_release);
+  }
+
+  bool isClosed() const {
+    return m_closed.load(std::memory_order_acquire);
+  }
+
+ public:
+  static const uint32_t kPadding = 1u << 31;   // flags bit reserved by the ring
+
+ private:
+  struct Header {
+    uint32_t size;
+    uint32_t flags;
+  };
+
+  static size_t align(size_t size) {
+    return (size + sizeof(Header) - 1) & ~(sizeof(Header) - 1);
+  }
+
+ private:
+  char* m_data {NULL};
+  size_t m_capacity {0};
+
+  std::atomic<uint64_t> m_write_pos {0};
+  char m_pad[64];     // writer and reader positions on different cache lines
+  std::atomic<uint64_t> m_read_pos {0};
+
+  std::atomic<bool> m_closed {false};
+};
+
+}
+
+#endif
@@ -7,7 +7,8 @@
 namespace rocket {
 
 
-static int g_msg_id_length = 20;
+// 19 digits without a leading zero always fit in a uint64, TinyPB v2 sends them as 8 bytes
+static int g_msg_id_length = 19;
 static int g_random_fd = -1;
 
 static thread_local std::string t_msg_id_no;
@@ -26,19 +27,19 @@ std::string MsgIDUtil::GenMsgID() {
     for (int i = 0; i < g_msg_id_length; ++i) {
       uint8_t x = ((uint8_t)(res[i])) % 10;
       res[i] = x + '0';
-      t_max_msg_id_no += "9";
     }
+    res[0] = ((uint8_t)(res[0]) - '0') % 9 + '1';
+    t_max_msg_id_no = std::string(g_msg_id_length, '9');
     t_msg_id_no = res;
   } else {
+    // not all 9s, so some digit can be carried into
     size_t i = t_msg_id_no.length() - 1;
-    while (t_msg_id_no[i] == '9' && i >= 0) {
+    while (t_msg_id_no[i] == '9') {
       i--;
     }
-    if (i >= 0) {
-      t_msg_id_no[i] += 1;
-      for (size_t j = i + 1; j < t_msg_id_no.length(); ++j) {
-        t_msg_id_no[j] = '0';
-      }
+    t_msg_id_no[i] += 1;
+    for (size_t j = i + 1; j < t_msg_id_no.length(); ++j) {
+      t_msg_id_no[j] = '0';
     }
   }
 
@@ -46,4 +47,22 @@ std::string MsgIDUtil::GenMsgID() {
 
 }
 
+bool MsgIDUtil::ToBinary(const std::string& msg_id, uint64_t& value) {
+  if (msg_id.empty() || msg_id.length() > 20 || (msg_id[0] == '0' && msg_id.length() > 1)) {
+    return false;
+  }
+  value = 0;
+  for (size_t i = 0; i < msg_id.length(); ++i) {
+    if (msg_id[i] < '0' || msg_id[i] > '9') {
+      return false;
+    }
+    uint64_t digit = msg_id[i] - '0';
+    if (value > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    value = value * 10 + digit;
+  }
+  return true;
+}
+
 }
@@ -1,6 +1,7 @@
 #ifndef ROCKET_COMMON_MSGID_UTIL_H
 #define ROCKET_COMMON_MSGID_UTIL_H
 
+#include <stdint.h>
 #include <string>
 
 
@@ -11,6 +12,9 @@ class MsgIDUtil {
  public:
   static std::string GenMsgID();
 
+  // true if msg_id is the decimal form of a uint64 that converts back to the same string, GenMsgID() ids are
+  static bool ToBinary(const std::string& msg_id, uint64_t& value);
+
 };
 
 }
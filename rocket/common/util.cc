@@ -24,7 +24,8 @@ pid_t getThreadId() {
   if (t_thread_id != 0) {
     return t_thread_id;
   }
-  return syscall(SYS_gettid);
+  t_thread_id = syscall(SYS_gettid);
+  return t_thread_id;
 }
 
 
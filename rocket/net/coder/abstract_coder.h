@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/tcp/output_chain.h"
 #include "rocket/net/coder/abstract_protocol.h"
 
 namespace rocket {
@@ -13,8 +14,16 @@ class AbstractCoder {
   
   virtual void encode(std::vector<AbstractProtocol::s_ptr>& messages, TcpBuffer::s_ptr out_buffer) = 0;
 
+  // encode for TcpConnection's writev path, large payloads may be referenced instead of copied
+  virtual void encode(std::vector<AbstractProtocol::s_ptr>& messages, OutputChain::s_ptr out_chain) = 0;
+
   virtual void decode(std::vector<AbstractProtocol::s_ptr>& out_messages, TcpBuffer::s_ptr buffer) = 0;
 
+  // true once the coder can no longer find where the next frame starts, the connection must be closed
+  virtual bool isDesynced() {
+    return false;
+  }
+
   virtual ~AbstractCoder() {}
 
 };
@@ -22,6 +22,13 @@ class StringCoder : public AbstractCoder {
     }
   }
 
+  void encode(std::vector<AbstractProtocol::s_ptr>& messages, OutputChain::s_ptr out_chain) {
+    for (size_t i = 0; i < messages.size(); ++i) {
+      std::shared_ptr<StringProtocol> msg = std::dynamic_pointer_cast<StringProtocol>(messages[i]);
+      out_chain->append(msg->info.c_str(), msg->info.length());
+    }
+  }
+
   // decode bytes in buffer into msg
   void decode(std::vector<AbstractProtocol::s_ptr>& out_messages, TcpBuffer::s_ptr buffer) {
     std::vector<char> re;
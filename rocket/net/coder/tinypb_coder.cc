@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <vector>
 #include <string.h>
 #include <arpa/inet.h>
 #include "rocket/net/coder/tinypb_coder.h"
 #include "rocket/net/coder/tinypb_protocol.h"
 #include "rocket/common/util.h"
+#include "rocket/common/crc32c.h"
 #include "rocket/common/log.h"
 
 namespace rocket {
@@ -25,143 +27,263 @@ void TinyPBCoder::encode(std::vector<AbstractProtocol::s_ptr>& messages, TcpBuff
   }
 }
 
-void TinyPBCoder::decode(std::vector<AbstractProtocol::s_ptr>& out_messages, TcpBuffer::s_ptr buffer) {
-    while (true) {
-      std::vector<char> tmp = buffer->m_buffer;
-      int start_index = buffer->readIndex();
-      int end_index = -1;
-
-      int pk_len = 0;
-      bool parse_success = false;
-      int i = 0;
-      for (i = start_index; i < buffer->writeIndex(); ++i) {
-        if (tmp[i] == TinyPBProtocol::PB_START) {
-          if (i + 1 < buffer->writeIndex()) {
-            pk_len = getInt32FromNetByte(&tmp[i + 1]);
-            DEBUGLOG("get pk_len = %d", pk_len);
-
-            int j = i + pk_len - 1;
-            if (j >= buffer->writeIndex()) {
-              continue;
-            }
-            if (tmp[j] == TinyPBProtocol::PB_END) {
-              start_index = i;
-              end_index = j;
-              parse_success = true;
-              break;
-            }
-          }
-        }
-      }
+void TinyPBCoder::encode(std::vector<AbstractProtocol::s_ptr>& messages, OutputChain::s_ptr out_chain) {
+  char stack_buf[512];
+  std::vector<char> heap_buf;
 
-      if (parse_success) {
-        std::string packet_data(tmp.begin() + start_index + 1, tmp.begin() + end_index);
-        AbstractProtocol::s_ptr message = std::make_shared<TinyPBProtocol>();
-        message->deserialize(packet_data);
-        out_messages.push_back(message);
+  for (auto &i : messages) {
+    std::shared_ptr<TinyPBProtocol> msg = std::dynamic_pointer_cast<TinyPBProtocol>(i);
+    int head_len = prepareTinyPB(msg);
 
-        buffer->readIndex(end_index + 1);
-      } else {
-        break;
-      }
+    char* head = stack_buf;
+    if (head_len > (int)sizeof(stack_buf)) {
+      heap_buf.resize(head_len);
+      head = &heap_buf[0];
     }
-  }
+    writeTinyPBHead(msg, head);
+    out_chain->append(head, head_len);
 
+    uint32_t check_sum = 0;
+    if (m_checksum_enabled) {
+      check_sum = crc32c(0, head, head_len);
+      check_sum = crc32c(check_sum, msg->m_pb_data.data(), msg->m_pb_data.length());
+    }
+    msg->m_check_sum = (int32_t)check_sum;
 
-    if (i >= buffer->writeIndex()) {
-      DEBUGLOG("decode end, read all buffer data");
-      return;
+    if (msg->m_pb_data.length() >= kZeroCopyPayloadSize) {
+      // msg keeps m_pb_data alive until the chain has written it
+      out_chain->appendRef(msg->m_pb_data.data(), msg->m_pb_data.length(), msg);
+    } else if (!msg->m_pb_data.empty()) {
+      out_chain->append(msg->m_pb_data.data(), msg->m_pb_data.length());
     }
 
-    if (parse_success) {
-      buffer->moveReadIndex(end_index - start_index + 1);
-      std::shared_ptr<TinyPBProtocol> message = std::make_shared<TinyPBProtocol>(); 
-      message->m_pk_len = pk_len;
+    char tail[sizeof(int32_t) + 1];
+    writeTinyPBTail(msg, tail);
+    out_chain->append(tail, sizeof(tail));
 
-      int msg_id_len_index = start_index + sizeof(char) + sizeof(message->m_pk_len);
-      if (msg_id_len_index >= end_index) {
-        message->parse_success = false;
-        ERRORLOG("parse error, msg_id_len_index[%d] >= end_index[%d]", msg_id_len_index, end_index);
-        continue;
+    DEBUGLOG("encode message[%s] success", msg->m_msg_id.c_str());
+  }
+}
+
+void TinyPBCoder::decode(std::vector<AbstractProtocol::s_ptr>& out_messages, TcpBuffer::s_ptr buffer) {
+  while (true) {
+    if (m_frame_len == 0) {
+      // find the head of the next frame, bytes before PB_START are dropped
+      int start_index = buffer->find(TinyPBProtocol::PB_START, 0);
+      if (start_index == -1) {
+        if (buffer->readAble() > 0) {
+          ERRORLOG("decode error, drop %d bytes without PB_START", buffer->readAble());
+          buffer->moveReadIndex(buffer->readAble());
+        }
+        return;
       }
-      message->m_msg_id_len = getInt32FromNetByte(&tmp[msg_id_len_index]);
-      DEBUGLOG("parse msg_id_len=%d", message->m_msg_id_len);
-
-      int msg_id_index = msg_id_len_index + sizeof(message->m_msg_id_len);
-      
-      char msg_id[100] = {0};
-      memcpy(&msg_id[0], &tmp[msg_id_index], message->m_msg_id_len);
-      message->m_msg_id = std::string(msg_id);
-      DEBUGLOG("parse msg_id=%s", message->m_msg_id.c_str());
-
-      int method_name_len_index = msg_id_index + message->m_msg_id_len;
-      if (method_name_len_index >= end_index) {
-        message->parse_success = false;
-        ERRORLOG("parse error, method_name_len_index[%d] >= end_index[%d]", method_name_len_index, end_index);
-        continue;
+      if (start_index > 0) {
+        ERRORLOG("decode error, drop %d bytes before PB_START", start_index);
+        buffer->moveReadIndex(start_index);
+      }
+
+      int32_t pk_len = 0;
+      if (!buffer->peekInt32(sizeof(char), pk_len)) {
+        return;
       }
-      message->m_method_name_len = getInt32FromNetByte(&tmp[method_name_len_index]);
-
-      int method_name_index = method_name_len_index + sizeof(message->m_method_name_len);
-      char method_name[512] = {0};
-      memcpy(&method_name[0], &tmp[method_name_index], message->m_method_name_len);
-      message->m_method_name = std::string(method_name);
-      DEBUGLOG("parse method_name=%s", message->m_method_name.c_str());
-
-      int err_code_index = method_name_index + message->m_method_name_len;
-      if (err_code_index >= end_index) {
-        message->parse_success = false;
-        ERRORLOG("parse error, err_code_index[%d] >= end_index[%d]", err_code_index, end_index);
+      if (pk_len < kMinFrameLen) {
+        ERRORLOG("decode error, invalid pk_len %d", pk_len);
+        buffer->moveReadIndex(sizeof(char));
         continue;
       }
-      message->m_err_code = getInt32FromNetByte(&tmp[err_code_index]);
+      m_frame_len = pk_len;
+    }
+
+    // the head is parsed once, a partial frame only costs this check per read
+    if (buffer->readAble() < m_frame_len) {
+      return;
+    }
 
+    std::shared_ptr<TinyPBProtocol> message = std::make_shared<TinyPBProtocol>();
+    message->m_pk_len = m_frame_len;
+    if (buffer->peekChar(m_frame_len - 1) != TinyPBProtocol::PB_END) {
+      ERRORLOG("decode error, no PB_END at the end of pk_len %d, skip PB_START", m_frame_len);
+      buffer->moveReadIndex(sizeof(char));
+      m_frame_len = 0;
+      continue;
+    }
 
-      int error_info_len_index = err_code_index + sizeof(message->m_err_code);
-      if (error_info_len_index >= end_index) {
-        message->parse_success = false;
-        ERRORLOG("parse error, error_info_len_index[%d] >= end_index[%d]", error_info_len_index, end_index);
+    int check_sum_index = m_frame_len - sizeof(int32_t) - sizeof(char);
+    buffer->peekInt32(check_sum_index, message->m_check_sum);
+    // 0 is sent with the checksum off, kLegacyChecksum by peers from before it existed
+    if (m_checksum_enabled && message->m_check_sum != 0 && message->m_check_sum != kLegacyChecksum) {
+      uint32_t check_sum = ChecksumOf(buffer, check_sum_index);
+      if ((int32_t)check_sum != message->m_check_sum) {
+        ERRORLOG("decode error, checksum mismatch, frame has %u, computed %u, drop pk_len %d", (uint32_t)message->m_check_sum, check_sum, m_frame_len);
+        buffer->moveReadIndex(m_frame_len);
+        m_frame_len = 0;
         continue;
       }
-      message->m_err_info_len = getInt32FromNetByte(&tmp[error_info_len_index]);
+    }
 
-      int err_info_index = error_info_len_index + sizeof(message->m_err_info_len);
-      char error_info[512] = {0};
-      memcpy(&error_info[0], &tmp[err_info_index], message->m_err_info_len);
-      message->m_err_info = std::string(error_info);
-      DEBUGLOG("parse error_info=%s", message->m_err_info.c_str());
+    message->parse_success = decodeTinyPB(message, buffer);
+    buffer->moveReadIndex(m_frame_len);
+    m_frame_len = 0;
 
-      int pb_data_len = message->m_pk_len - message->m_method_name_len - message->m_msg_id_len - message->m_err_info_len - 2 - 24;
+    if (message->parse_success) {
+      DEBUGLOG("decode message[%s] success, method_name=%s, pk_len=%d", message->m_msg_id.c_str(), message->m_method_name.c_str(), message->m_pk_len);
+      out_messages.push_back(message);
+    }
+  }
 
-      int pd_data_index = err_info_index + message->m_err_info_len;
-      message->m_pb_data = std::string(&tmp[pd_data_index], pb_data_len);
+}
 
-      message->parse_success = true;
 
-      out_messages.push_back(message);
+uint32_t TinyPBCoder::ChecksumOf(TcpBuffer::s_ptr buffer, int len) {
+  uint32_t check_sum = 0;
+  int offset = 0;
+  while (offset < len) {
+    int segment_len = 0;
+    const char* segment = buffer->segmentAt(offset, segment_len);
+    segment_len = std::min(segment_len, len - offset);
+    check_sum = crc32c(check_sum, segment, segment_len);
+    offset += segment_len;
+  }
+  return check_sum;
+}
+
+
+// Frame fields as read from a TcpBuffer: int32 at an offset and a string of given length after it.
+// Reads straight from the block when the frame is contiguous, otherwise across blocks.
+class TinyPBFrameReader {
+ public:
+  TinyPBFrameReader(TcpBuffer::s_ptr buffer, int frame_len) : m_buffer(buffer), m_end(frame_len) {
+    int len = 0;
+    const char* data = buffer->contiguousData(len);
+    if (len >= frame_len) {
+      m_data = data;
     }
+  }
 
+  bool readInt32(int32_t& value) {
+    if (m_offset + (int)sizeof(int32_t) > m_end) {
+      return false;
+    }
+    if (m_data) {
+      value = getInt32FromNetByte(m_data + m_offset);
+    } else {
+      m_buffer->peekInt32(m_offset, value);
+    }
+    m_offset += sizeof(int32_t);
+    return true;
+  }
+
+  bool readString(int32_t len, std::string& out) {
+    if (len < 0 || len > m_end - m_offset) {
+      return false;
+    }
+    if (m_data) {
+      out.assign(m_data + m_offset, len);
+    } else {
+      m_buffer->peekString(m_offset, len, out);
+    }
+    m_offset += len;
+    return true;
   }
 
+  void skip(int len) {
+    m_offset += len;
+  }
+
+  int offset() {
+    return m_offset;
+  }
+
+ private:
+  TcpBuffer::s_ptr m_buffer;
+  const char* m_data {NULL};
+  int m_offset {0};
+  int m_end {0};
+};
+
+
+bool TinyPBCoder::decodeTinyPB(std::shared_ptr<TinyPBProtocol> message, TcpBuffer::s_ptr buffer) {
+  // PB_START and pk_len are checked already, checksum and PB_END follow pb_data
+  TinyPBFrameReader reader(buffer, message->m_pk_len - sizeof(int32_t) - sizeof(char));
+  reader.skip(sizeof(char) + sizeof(int32_t));
 
+  if (!reader.readInt32(message->m_msg_id_len) || !reader.readString(message->m_msg_id_len, message->m_msg_id)) {
+    ERRORLOG("parse error, invalid msg_id_len[%d], pk_len[%d]", message->m_msg_id_len, message->m_pk_len);
+    return false;
+  }
+  if (!reader.readInt32(message->m_method_name_len) || !reader.readString(message->m_method_name_len, message->m_method_name)) {
+    ERRORLOG("parse error, invalid method_name_len[%d], pk_len[%d]", message->m_method_name_len, message->m_pk_len);
+    return false;
+  }
+  if (!reader.readInt32(message->m_err_code)) {
+    ERRORLOG("parse error, no err_code, pk_len[%d]", message->m_pk_len);
+    return false;
+  }
+  if (!reader.readInt32(message->m_err_info_len) || !reader.readString(message->m_err_info_len, message->m_err_info)) {
+    ERRORLOG("parse error, invalid err_info_len[%d], pk_len[%d]", message->m_err_info_len, message->m_pk_len);
+    return false;
+  }
+
+  // the lengths above leave exactly pb_data before the checksum
+  int pb_data_len = message->m_pk_len - message->m_method_name_len - message->m_msg_id_len - message->m_err_info_len - kMinFrameLen;
+  if (!reader.readString(pb_data_len, message->m_pb_data)) {
+    ERRORLOG("parse error, invalid pb_data_len[%d], pk_len[%d]", pb_data_len, message->m_pk_len);
+    return false;
+  }
+
+  return true;
 }
 
 
 const char* TinyPBCoder::encodeTinyPB(std::shared_ptr<TinyPBProtocol> message, int& len) {
+  int head_len = prepareTinyPB(message);
+  int pk_len = message->m_pk_len;
+
+  char* buf = reinterpret_cast<char*>(malloc(pk_len));
+  char* tmp = writeTinyPBHead(message, buf);
+
+  if (!message->m_pb_data.empty()) {
+    memcpy(tmp, &(message->m_pb_data[0]), message->m_pb_data.length());
+    tmp += message->m_pb_data.length();
+  }
+
+  message->m_check_sum = m_checksum_enabled ? (int32_t)crc32c(0, buf, tmp - buf) : 0;
+
+  writeTinyPBTail(message, tmp);
+  len = pk_len;
+
+  DEBUGLOG("encode message[%s] success, head_len=%d", message->m_msg_id.c_str(), head_len);
+
+  return buf;
+}
+
+
+int TinyPBCoder::prepareTinyPB(std::shared_ptr<TinyPBProtocol> message) {
   if (message->m_msg_id.empty()) {
     message->m_msg_id = "123456789";
   }
   DEBUGLOG("msg_id = %s", message->m_msg_id.c_str());
   int pk_len = 2 + 24 + message->m_msg_id.length() + message->m_method_name.length() + message->m_err_info.length() + message->m_pb_data.length();
-  DEBUGLOG("pk_len = %", pk_len);
+  DEBUGLOG("pk_len = %d", pk_len);
 
-  char* buf = reinterpret_cast<char*>(malloc(pk_len));
+  message->m_pk_len = pk_len;
+  message->m_msg_id_len = message->m_msg_id.length();
+  message->m_method_name_len = message->m_method_name.length();
+  message->m_err_info_len = message->m_err_info.length();
+  message->parse_success = true;
+
+  // check_sum and PB_END follow pb_data
+  return pk_len - message->m_pb_data.length() - sizeof(int32_t) - 1;
+}
+
+
+char* TinyPBCoder::writeTinyPBHead(std::shared_ptr<TinyPBProtocol> message, char* buf) {
   char* tmp = buf;
 
   *tmp = TinyPBProtocol::PB_START;
   tmp++;
 
-  int32_t pk_len_net = htonl(pk_len);
+  int32_t pk_len_net = htonl(message->m_pk_len);
   memcpy(tmp, &pk_len_net, sizeof(pk_len_net));
   tmp += sizeof(pk_len_net);
 
@@ -199,28 +321,21 @@ const char* TinyPBCoder::encodeTinyPB(std::shared_ptr<TinyPBProtocol> message, i
     tmp += err_info_len;
   }
 
-  if (!message->m_pb_data.empty()) {
-    memcpy(tmp, &(message->m_pb_data[0]), message->m_pb_data.length());
-    tmp += message->m_pb_data.length();
-  }
+  return tmp;
+}
 
-  int32_t check_sum_net = htonl(1);
+
+char* TinyPBCoder::writeTinyPBTail(std::shared_ptr<TinyPBProtocol> message, char* buf) {
+  char* tmp = buf;
+
+  int32_t check_sum_net = htonl(message->m_check_sum);
   memcpy(tmp, &check_sum_net, sizeof(check_sum_net));
   tmp += sizeof(check_sum_net);
 
   *tmp = TinyPBProtocol::PB_END;
+  tmp++;
 
-  message->m_pk_len = pk_len;
-  message->m_msg_id_len = msg_id_len;
-  message->m_method_name_len = method_name_len;
-  message->m_err_info_len = err_info_len;
-  message->parse_success = true;
-  len = pk_len;
-
-  DEBUGLOG("encode message[%s] success", message->m_msg_id.c_str());
-
-  return buf;
+  return tmp;
 }
 
-
 }
\ No newline at end of file
@@ -14,16 +14,58 @@ class TinyPBCoder : public AbstractCoder {
   ~TinyPBCoder() {}
 
   // Convert message objects to byte stream and write them into the buffer.
-  void TinyPBCoder::encode(std::vector<AbstractProtocol::s_ptr>& messages, TcpBuffer::s_ptr out_buffer);
+  void encode(std::vector<AbstractProtocol::s_ptr>& messages, TcpBuffer::s_ptr out_buffer);
+
+  // Same frame for the writev path, m_pb_data of at least kZeroCopyPayloadSize bytes is referenced, not copied.
+  void encode(std::vector<AbstractProtocol::s_ptr>& messages, OutputChain::s_ptr out_chain);
 
   // Convert byte stream in the buffer to message objects.
-  void TinyPBCoder::decode(std::vector<AbstractProtocol::s_ptr>& out_messages, TcpBuffer::s_ptr buffer);
+  // A partial frame stays in the buffer and its parsed head is kept for the next call,
+  // so a coder must only decode one buffer.
+  void decode(std::vector<AbstractProtocol::s_ptr>& out_messages, TcpBuffer::s_ptr buffer);
+
+  // CRC32C of everything before the checksum field. When disabled the field is 0 and
+  // received checksums are not verified; a frame with checksum 0 or kLegacyChecksum is never verified.
+  void setChecksumEnabled(bool enabled) {
+    m_checksum_enabled = enabled;
+  }
+
+  bool isChecksumEnabled() {
+    return m_checksum_enabled;
+  }
+
+
+ public:
+  static const size_t kZeroCopyPayloadSize = 1024;
+
+  // PB_START, pk_len, msg_id_len, method_name_len, err_code, err_info_len, checksum and PB_END
+  static const int kMinFrameLen = 26;
 
+  // the constant checksum of frames from peers that predate CRC32C
+  static const int32_t kLegacyChecksum = 1;
 
+  // CRC32C of the first len bytes of buffer
+  static uint32_t ChecksumOf(TcpBuffer::s_ptr buffer, int len);
 
  private:
   const char* encodeTinyPB(std::shared_ptr<TinyPBProtocol> message, int& len);
 
+  // fill the length fields of message, return size of the frame before pb_data
+  int prepareTinyPB(std::shared_ptr<TinyPBProtocol> message);
+
+  // write the frame fields before pb_data, return the end of written bytes
+  char* writeTinyPBHead(std::shared_ptr<TinyPBProtocol> message, char* buf);
+
+  // write m_check_sum and PB_END after pb_data, return the end of written bytes
+  char* writeTinyPBTail(std::shared_ptr<TinyPBProtocol> message, char* buf);
+
+  // parse the m_pk_len bytes frame at the read cursor of buffer into message
+  bool decodeTinyPB(std::shared_ptr<TinyPBProtocol> message, TcpBuffer::s_ptr buffer);
+
+ private:
+  int32_t m_frame_len {0};    // pk_len of the frame at the read cursor, 0 before its head is read
+  bool m_checksum_enabled {true};
+
 };
 
 
@@ -21,6 +21,7 @@ struct TinyPBProtocol : public AbstractProtocol {
 
   int32_t m_method_name_len {0};
   std::string m_method_name;
+  uint32_t m_method_id {0};       // TinyPB v2 only, see RpcDispatcher::getMethodId
   int32_t m_err_code {0};
   int32_t m_err_info_len {0};
   std::string m_err_info;
@@ -0,0 +1,396 @@
+#include <endian.h>
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "rocket/net/coder/tinypb_v2_coder.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/common/crc32c.h"
+#include "rocket/common/msg_id_util.h"
+#include "rocket/common/log.h"
+
+namespace rocket {
+
+const char TinyPBV2Coder::PB2_START;
+
+static const uint64_t g_max_frame_len = 0x7fffffff - 16;
+
+
+static int varintLen(uint64_t value) {
+  int len = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    len++;
+  }
+  return len;
+}
+
+static char* writeVarint(char* buf, uint64_t value) {
+  while (value >= 0x80) {
+    *buf++ = (char)(value | 0x80);
+    value >>= 7;
+  }
+  *buf++ = (char)value;
+  return buf;
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+int TinyPBV2Coder::writeHead(std::shared_ptr<TinyPBProtocol> message, char* buf) {
+  if (message->m_msg_id.empty()) {
+    message->m_msg_id = "123456789";
+  }
+
+  uint8_t flags = 0;
+  uint64_t binary_msg_id = 0;
+  if (MsgIDUtil::ToBinary(message->m_msg_id, binary_msg_id)) {
+    flags |= kBinaryMsgId;
+  }
+
+  // a response names its method id, a request uses the id the peer has told us
+  uint32_t method_id = message->m_method_id;
+  if (method_id != 0) {
+    flags |= kHasMethodId;
+    if (!message->m_method_name.empty() && m_announced_ids.insert(method_id).second) {
+      flags |= kHasMethodName;
+    }
+  } else {
+    auto it = m_method_ids.find(message->m_method_name);
+    if (it != m_method_ids.end()) {
+      method_id = it->second;
+      flags |= kHasMethodId;
+    } else if (!message->m_method_name.empty()) {
+      flags |= kHasMethodName;
+    }
+  }
+
+  if (message->m_err_code != 0 || !message->m_err_info.empty()) {
+    flags |= kHasError;
+  }
+  if (m_checksum_enabled) {
+    flags |= kHasChecksum;
+  }
+
+  uint64_t frame_len = 1 + message->m_pb_data.length();
+  if (flags & kBinaryMsgId) {
+    frame_len += sizeof(uint64_t);
+  } else {
+    frame_len += varintLen(message->m_msg_id.length()) + message->m_msg_id.length();
+  }
+  if (flags & kHasMethodId) {
+    frame_len += varintLen(method_id);
+  }
+  if (flags & kHasMethodName) {
+    frame_len += varintLen(message->m_method_name.length()) + message->m_method_name.length();
+  }
+  if (flags & kHasError) {
+    frame_len += varintLen(zigzag(message->m_err_code)) + varintLen(message->m_err_info.length()) + message->m_err_info.length();
+  }
+  if (flags & kHasChecksum) {
+    frame_len += sizeof(uint32_t);
+  }
+
+  char* tmp = buf;
+  *tmp++ = PB2_START;
+  tmp = writeVarint(tmp, frame_len);
+  *tmp++ = (char)flags;
+
+  if (flags & kBinaryMsgId) {
+    uint64_t net = htobe64(binary_msg_id);
+    memcpy(tmp, &net, sizeof(net));
+    tmp += sizeof(net);
+  } else {
+    tmp = writeVarint(tmp, message->m_msg_id.length());
+    memcpy(tmp, message->m_msg_id.data(), message->m_msg_id.length());
+    tmp += message->m_msg_id.length();
+  }
+  if (flags & kHasMethodId) {
+    tmp = writeVarint(tmp, method_id);
+  }
+  if (flags & kHasMethodName) {
+    tmp = writeVarint(tmp, message->m_method_name.length());
+    memcpy(tmp, message->m_method_name.data(), message->m_method_name.length());
+    tmp += message->m_method_name.length();
+  }
+  if (flags & kHasError) {
+    tmp = writeVarint(tmp, zigzag(message->m_err_code));
+    tmp = writeVarint(tmp, message->m_err_info.length());
+    memcpy(tmp, message->m_err_info.data(), message->m_err_info.length());
+    tmp += message->m_err_info.length();
+  }
+
+  message->m_pk_len = (int32_t)(1 + varintLen(frame_len) + frame_len);
+  return tmp - buf;
+}
+
+
+void TinyPBV2Coder::encode(std::vector<AbstractProtocol::s_ptr>& messages, TcpBuffer::s_ptr out_buffer) {
+  std::vector<char> head;
+
+  for (auto &i : messages) {
+    std::shared_ptr<TinyPBProtocol> msg = std::dynamic_pointer_cast<TinyPBProtocol>(i);
+    head.resize(kMaxHeadLen + msg->m_msg_id.length() + msg->m_method_name.length() + msg->m_err_info.length());
+    int head_len = writeHead(msg, &head[0]);
+    out_buffer->writeToBuffer(&head[0], head_len);
+    out_buffer->writeToBuffer(msg->m_pb_data.data(), msg->m_pb_data.length());
+
+    if (m_checksum_enabled) {
+      uint32_t check_sum = crc32c(0, &head[0], head_len);
+      check_sum = crc32c(check_sum, msg->m_pb_data.data(), msg->m_pb_data.length());
+      msg->m_check_sum = (int32_t)check_sum;
+      uint32_t net = htonl(check_sum);
+      out_buffer->writeToBuffer((const char*)&net, sizeof(net));
+    }
+  }
+}
+
+
+void TinyPBV2Coder::encode(std::vector<AbstractProtocol::s_ptr>& messages, OutputChain::s_ptr out_chain) {
+  char stack_buf[512];
+  std::vector<char> heap_buf;
+
+  for (auto &i : messages) {
+    std::shared_ptr<TinyPBProtocol> msg = std::dynamic_pointer_cast<TinyPBProtocol>(i);
+
+    size_t max_head_len = kMaxHeadLen + msg->m_msg_id.length() + msg->m_method_name.length() + msg->m_err_info.length();
+    char* head = stack_buf;
+    if (max_head_len > sizeof(stack_buf)) {
+      heap_buf.resize(max_head_len);
+      head = &heap_buf[0];
+    }
+    int head_len = writeHead(msg, head);
+    out_chain->append(head, head_len);
+
+    if (msg->m_pb_data.length() >= TinyPBCoder::kZeroCopyPayloadSize) {
+      out_chain->appendRef(msg->m_pb_data.data(), msg->m_pb_data.length(), msg);
+    } else if (!msg->m_pb_data.empty()) {
+      out_chain->append(msg->m_pb_data.data(), msg->m_pb_data.length());
+    }
+
+    if (m_checksum_enabled) {
+      uint32_t check_sum = crc32c(0, head, head_len);
+      check_sum = crc32c(check_sum, msg->m_pb_data.data(), msg->m_pb_data.length());
+      msg->m_check_sum = (int32_t)check_sum;
+      uint32_t net = htonl(check_sum);
+      out_chain->append((const char*)&net, sizeof(net));
+    }
+
+    DEBUGLOG("encode v2 message[%s] success, head_len=%d", msg->m_msg_id.c_str(), head_len);
+  }
+}
+
+
+void TinyPBV2Coder::decode(std::vector<AbstractProtocol::s_ptr>& out_messages, TcpBuffer::s_ptr buffer) {
+  while (!m_desynced) {
+    if (m_head_len == 0) {
+      int readable = buffer->readAble();
+      if (readable == 0) {
+        return;
+      }
+      // without a frame length there is no way to find the next frame
+      if (buffer->peekChar(0) != PB2_START) {
+        ERRORLOG("decode error, frame does not start with PB2_START, %d bytes out of sync", readable);
+        m_desynced = true;
+        return;
+      }
+
+      uint64_t frame_len = 0;
+      int i = 1;
+      for (int shift = 0; ; shift += 7, ++i) {
+        if (i >= readable) {
+          return;
+        }
+        uint8_t byte = (uint8_t)buffer->peekChar(i);
+        frame_len |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+          break;
+        }
+        if (shift >= 28) {
+          frame_len = g_max_frame_len + 1;
+          break;
+        }
+      }
+      if (frame_len == 0 || frame_len > g_max_frame_len) {
+        ERRORLOG("decode error, invalid frame_len, %d bytes out of sync", readable);
+        m_desynced = true;
+        return;
+      }
+      m_head_len = i + 1;
+      m_frame_len = (int)frame_len;
+    }
+
+    if (buffer->readAble() < m_head_len + m_frame_len) {
+      return;
+    }
+
+    std::shared_ptr<TinyPBProtocol> message = std::make_shared<TinyPBProtocol>();
+    message->m_pk_len = m_head_len + m_frame_len;
+    message->parse_success = decodeFrame(message, buffer);
+    buffer->moveReadIndex(m_head_len + m_frame_len);
+    m_head_len = 0;
+    m_frame_len = 0;
+
+    if (message->parse_success) {
+      DEBUGLOG("decode v2 message[%s] success, method_name=%s, method_id=%u", message->m_msg_id.c_str(), message->m_method_name.c_str(), message->m_method_id);
+      out_messages.push_back(message);
+    }
+  }
+}
+
+
+// reads the fields of one frame at increasing offsets of a TcpBuffer, never past m_end.
+// Straight from memory when the frame is in the first block, like TinyPBFrameReader
+class TinyPBV2Reader {
+ public:
+  TinyPBV2Reader(TcpBuffer::s_ptr buffer, int offset, int end) : m_buffer(buffer), m_offset(offset), m_end(end) {
+    int len = 0;
+    const char* data = buffer->contiguousData(len);
+    if (len >= end) {
+      m_data = data;
+    }
+  }
+
+  bool readByte(uint8_t& value) {
+    if (m_offset >= m_end) {
+      return false;
+    }
+    value = (uint8_t)(m_data ? m_data[m_offset] : m_buffer->peekChar(m_offset));
+    m_offset++;
+    return true;
+  }
+
+  bool readVarint(uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift <= 28; shift += 7) {
+      uint8_t byte = 0;
+      if (!readByte(byte)) {
+        return false;
+      }
+      value |= (uint32_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool readUint64(uint64_t& value) {
+    if (m_offset + (int)sizeof(value) > m_end) {
+      return false;
+    }
+    if (m_data) {
+      memcpy(&value, m_data + m_offset, sizeof(value));
+    } else {
+      m_buffer->peek(m_offset, (char*)&value, sizeof(value));
+    }
+    value = be64toh(value);
+    m_offset += sizeof(value);
+    return true;
+  }
+
+  bool readString(uint32_t len, std::string& out) {
+    if (len > (uint32_t)(m_end - m_offset)) {
+      return false;
+    }
+    if (m_data) {
+      out.assign(m_data + m_offset, len);
+    } else {
+      m_buffer->peekString(m_offset, len, out);
+    }
+    m_offset += len;
+    return true;
+  }
+
+  bool readLengthString(std::string& out) {
+    uint32_t len = 0;
+    return readVarint(len) && readString(len, out);
+  }
+
+  int remaining() {
+    return m_end - m_offset;
+  }
+
+ private:
+  TcpBuffer::s_ptr m_buffer;
+  const char* m_data {NULL};
+  int m_offset {0};
+  int m_end {0};
+};
+
+
+bool TinyPBV2Coder::decodeFrame(std::shared_ptr<TinyPBProtocol> message, TcpBuffer::s_ptr buffer) {
+  int end = m_head_len + m_frame_len;
+  uint8_t flags = (uint8_t)buffer->peekChar(m_head_len);
+
+  if (flags & kHasChecksum) {
+    if (m_frame_len < 1 + (int)sizeof(uint32_t)) {
+      ERRORLOG("parse error, frame_len %d too short for a checksum", m_frame_len);
+      return false;
+    }
+    end -= sizeof(uint32_t);
+    buffer->peekInt32(end, message->m_check_sum);
+    if (m_checksum_enabled) {
+      uint32_t check_sum = TinyPBCoder::ChecksumOf(buffer, end);
+      if ((int32_t)check_sum != message->m_check_sum) {
+        ERRORLOG("decode error, checksum mismatch, frame has %u, computed %u", (uint32_t)message->m_check_sum, check_sum);
+        return false;
+      }
+    }
+  }
+
+  TinyPBV2Reader reader(buffer, m_head_len + 1, end);
+  if (flags & kBinaryMsgId) {
+    uint64_t msg_id = 0;
+    if (!reader.readUint64(msg_id)) {
+      ERRORLOG("parse error, no msg_id");
+      return false;
+    }
+    message->m_msg_id = std::to_string(msg_id);
+  } else if (!reader.readLengthString(message->m_msg_id)) {
+    ERRORLOG("parse error, invalid msg_id");
+    return false;
+  }
+  message->m_msg_id_len = message->m_msg_id.length();
+
+  if ((flags & kHasMethodId) && !reader.readVarint(message->m_method_id)) {
+    ERRORLOG("parse error, invalid method_id, msg_id[%s]", message->m_msg_id.c_str());
+    return false;
+  }
+  if ((flags & kHasMethodName) && !reader.readLengthString(message->m_method_name)) {
+    ERRORLOG("parse error, invalid method_name, msg_id[%s]", message->m_msg_id.c_str());
+    return false;
+  }
+  if ((flags & kHasMethodId) && (flags & kHasMethodName)) {
+    // the peer announces an id, use it from now on
+    m_method_ids[message->m_method_name] = message->m_method_id;
+    m_method_names[message->m_method_id] = message->m_method_name;
+  } else if (flags & kHasMethodId) {
+    auto it = m_method_names.find(message->m_method_id);
+    if (it != m_method_names.end()) {
+      message->m_method_name = it->second;
+    }
+  }
+  message->m_method_name_len = message->m_method_name.length();
+
+  if (flags & kHasError) {
+    uint32_t err_code = 0;
+    if (!reader.readVarint(err_code) || !reader.readLengthString(message->m_err_info)) {
+      ERRORLOG("parse error, invalid error fields, msg_id[%s]", message->m_msg_id.c_str());
+      return false;
+    }
+    message->m_err_code = unzigzag(err_code);
+    message->m_err_info_len = message->m_err_info.length();
+  }
+
+  reader.readString(reader.remaining(), message->m_pb_data);
+  return true;
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef ROCKET_NET_CODER_TINYPB_V2_CODER_H
+#define ROCKET_NET_CODER_TINYPB_V2_CODER_H
+
+#include <map>
+#include <set>
+#include "rocket/net/coder/abstract_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+
+namespace rocket {
+
+/*
+ * Compact TinyPB frame, same TinyPBProtocol messages as TinyPBCoder:
+ *
+ *   PB2_START | varint frame_len | flags | request id | [method id] | [method name] | [error] | pb_data | [checksum]
+ *
+ * frame_len counts the bytes after it. The request id is 8 bytes when m_msg_id is a decimal
+ * that fits in uint64 (MsgIDUtil ids do), otherwise a varint length + the string.
+ * The first response of every method carries its id and full name, after that both sides of the
+ * connection send the id only; see RpcDispatcher for the id table. There is no handshake, until
+ * then a request names its method in full.
+ * A server tells the two framings apart by the first byte of a connection.
+ */
+class TinyPBV2Coder : public AbstractCoder {
+
+ public:
+  static const char PB2_START = (char)0xB2;
+
+  enum Flags {
+    kBinaryMsgId = 0x01,
+    kHasMethodId = 0x02,
+    kHasMethodName = 0x04,
+    kHasError = 0x08,
+    kHasChecksum = 0x10,
+  };
+
+ public:
+
+  TinyPBV2Coder() {}
+  ~TinyPBV2Coder() {}
+
+  void encode(std::vector<AbstractProtocol::s_ptr>& messages, TcpBuffer::s_ptr out_buffer);
+
+  void encode(std::vector<AbstractProtocol::s_ptr>& messages, OutputChain::s_ptr out_chain);
+
+  // a partial frame stays in the buffer, a coder must only decode one buffer.
+  // A bad start byte or frame_len stops decoding for good, see isDesynced()
+  void decode(std::vector<AbstractProtocol::s_ptr>& out_messages, TcpBuffer::s_ptr buffer);
+
+  // v2 has no end marker to scan for, after a bad frame head no later frame can be found
+  bool isDesynced() {
+    return m_desynced;
+  }
+
+  // CRC32C of the frame before the checksum, sent and verified only when enabled
+  void setChecksumEnabled(bool enabled) {
+    m_checksum_enabled = enabled;
+  }
+
+ private:
+  // write everything before pb_data into buf, return its length. buf holds kMaxHeadLen + the strings
+  int writeHead(std::shared_ptr<TinyPBProtocol> message, char* buf);
+
+  bool decodeFrame(std::shared_ptr<TinyPBProtocol> message, TcpBuffer::s_ptr buffer);
+
+ private:
+  static const int kMaxHeadLen = 64;
+
+  int m_head_len {0};         // PB2_START and frame_len of the frame at the read cursor, 0 before it is read
+  int m_frame_len {0};
+  bool m_checksum_enabled {true};
+  bool m_desynced {false};
+
+  // method ids learned from the peer, and the ids whose name this side has already sent
+  std::map<std::string, uint32_t> m_method_ids;
+  std::map<uint32_t, std::string> m_method_names;
+  std::set<uint32_t> m_announced_ids;
+
+};
+
+}
+
+#endif
@@ -2,9 +2,11 @@
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <string.h>
+#include <algorithm>
 #include "rocket/net/eventloop.h"
 #include "rocket/common/log.h"
 #include "rocket/common/util.h"
+#include "rocket/common/config.h"
 
 
 #define ADD_TO_EPOLL() \
@@ -40,8 +42,7 @@
 namespace rocket {
 
 static thread_local EventLoop* t_current_eventloop = NULL;
-static int g_epoll_max_timeout = 10000;
-static int g_epoll_max_events = 10;
+static EventLoop::DispatchMode g_dispatch_mode = EventLoop::DispatchInline;
 
 EventLoop::EventLoop() {
   if (t_current_eventloop != NULL) {
@@ -49,6 +50,21 @@ EventLoop::EventLoop() {
     exit(0);
   }
   m_thread_id = getThreadId();
+  m_dispatch_mode = g_dispatch_mode;
+
+  Config* config = Config::GetGlobalConfig();
+  if (config) {
+    m_min_events = std::max(1, config->m_epoll_max_events);
+    m_max_events_limit = std::max(m_min_events, config->m_epoll_max_events_limit);
+    m_epoll_adaptive = config->m_epoll_adaptive;
+    m_epoll_max_timeout = std::max(1, config->m_epoll_max_timeout);
+  }
+  m_max_events = m_min_events;
+  m_result_events.resize(m_max_events);
+  m_current_max_events = m_max_events;
+  for (int i = 0; i < EpollStats::kHistBuckets; ++i) {
+    m_events_hist[i] = 0;
+  }
 
   m_epoll_fd = epoll_create(10);
 
@@ -111,31 +127,26 @@ void EventLoop::initWakeUpFdEevent() {
 void EventLoop::loop() {
   m_is_looping = true;
   while(!m_stop_flag) {
-    ScopeMutex<Mutex> lock(m_mutex); 
-    std::queue<std::function<void()>> tmp_tasks; 
-    m_pending_tasks.swap(tmp_tasks); 
-    lock.unlock();
-
-    while (!tmp_tasks.empty()) {
-      std::function<void()> cb = tmp_tasks.front();
-      tmp_tasks.pop();
-      if (cb) {
-        cb();
-      }
-    }
+    // run pending tasks, including the ones posted by last round's fd handlers, before blocking in epoll_wait
+    // clear the flag before draining, so producers posting after this point will write the wakeup fd again
+    m_wakeup_pending.store(false);
+    m_pending_tasks.runTasks();
 
 
-    int timeout = g_epoll_max_timeout; 
-    epoll_event result_events[g_epoll_max_events];
+    int timeout = getEpollTimeout(); 
     // DEBUGLOG("now begin to epoll_wait");
-    int rt = epoll_wait(m_epoll_fd, result_events, g_epoll_max_events, timeout);
+    int rt = epoll_wait(m_epoll_fd, &m_result_events[0], m_max_events, timeout);
     // DEBUGLOG("now end epoll_wait, rt = %d", rt);
 
     if (rt < 0) {
-      ERRORLOG("epoll_wait error, errno=%d, error=%s", errno, strerror(errno));
+      if (errno != EINTR) {
+        ERRORLOG("epoll_wait error, errno=%d, error=%s", errno, strerror(errno));
+      }
     } else {
+      recordEpollWait(rt);
+
       for (int i = 0; i < rt; ++i) {
-        epoll_event trigger_event = result_events[i];
+        epoll_event trigger_event = m_result_events[i];
         FdEvent* fd_event = static_cast<FdEvent*>(trigger_event.data.ptr);
         if (fd_event == NULL) {
           ERRORLOG("fd_event = NULL, continue");
@@ -145,14 +156,15 @@ void EventLoop::loop() {
         // int event = (int)(trigger_event.events); 
         // DEBUGLOG("unkonow event = %d", event);
 
-        if (trigger_event.events & EPOLLIN) { 
+        // peer half close is reported as EPOLLRDHUP for edge-triggered fds, the read handler sees the EOF
+        if (trigger_event.events & (EPOLLIN | EPOLLRDHUP)) { 
 
           // DEBUGLOG("fd %d trigger EPOLLIN event", fd_event->getFd())
-          addTask(fd_event->handler(FdEvent::IN_EVENT));
+          dispatch(fd_event->handler(FdEvent::IN_EVENT));
         }
         if (trigger_event.events & EPOLLOUT) { 
           // DEBUGLOG("fd %d trigger EPOLLOUT event", fd_event->getFd())
-          addTask(fd_event->handler(FdEvent::OUT_EVENT));
+          dispatch(fd_event->handler(FdEvent::OUT_EVENT));
         }
 
         // EPOLLHUP EPOLLERR
@@ -161,14 +173,100 @@ void EventLoop::loop() {
           deleteEpollEvent(fd_event);
           if (fd_event->handler(FdEvent::ERROR_EVENT) != nullptr) {
             DEBUGLOG("fd %d add error callback", fd_event->getFd())
-            addTask(fd_event->handler(FdEvent::OUT_EVENT));
+            dispatch(fd_event->handler(FdEvent::ERROR_EVENT));
           }
         }
       }
+
+      // the timeout follows the next timer deadline, so a timed out wait means timer events are due
+      if (rt == 0) {
+        int64_t next_arrive_time = m_timer->getNextArriveTime();
+        if (next_arrive_time != -1 && next_arrive_time <= getNowMs()) {
+          m_timer->onTimer();
+        }
+      }
+
+      adjustEpollEvents(rt);
     }
     
   }
 
+  INFOLOG("event loop exit, epoll stats: %s", getEpollStats().toString().c_str());
+}
+
+int EventLoop::getEpollTimeout() {
+  int64_t next_arrive_time = m_timer->getNextArriveTime();
+  if (next_arrive_time == -1) {
+    return m_epoll_max_timeout;
+  }
+  int64_t timeout = next_arrive_time - getNowMs();
+  if (timeout < 0) {
+    timeout = 0;
+  }
+  if (timeout > m_epoll_max_timeout) {
+    timeout = m_epoll_max_timeout;
+  }
+  return (int)timeout;
+}
+
+void EventLoop::recordEpollWait(int event_count) {
+  m_wait_count.store(m_wait_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  if (event_count == 0) {
+    m_timeout_count.store(m_timeout_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+  m_event_count.store(m_event_count.load(std::memory_order_relaxed) + event_count, std::memory_order_relaxed);
+  if (event_count == m_max_events) {
+    m_full_batch_count.store(m_full_batch_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  int bucket = 0;
+  while ((event_count >> (bucket + 1)) > 0 && bucket < EpollStats::kHistBuckets - 1) {
+    bucket++;
+  }
+  m_events_hist[bucket].store(m_events_hist[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void EventLoop::adjustEpollEvents(int event_count) {
+  if (!m_epoll_adaptive) {
+    return;
+  }
+
+  if (event_count == m_max_events && m_max_events < m_max_events_limit) {
+    // a full batch, more fds may be ready than we could fetch
+    m_max_events = std::min(m_max_events * 2, m_max_events_limit);
+    m_result_events.resize(m_max_events);
+    m_idle_wait_count = 0;
+    m_grow_count.store(m_grow_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_current_max_events.store(m_max_events, std::memory_order_relaxed);
+    DEBUGLOG("epoll event array grow to %d", m_max_events);
+    return;
+  }
+
+  if (m_max_events > m_min_events && event_count < m_max_events / 4) {
+    if (++m_idle_wait_count >= 128) {
+      m_max_events = std::max(m_max_events / 2, m_min_events);
+      m_result_events.resize(m_max_events);
+      m_result_events.shrink_to_fit();
+      m_idle_wait_count = 0;
+      m_shrink_count.store(m_shrink_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      m_current_max_events.store(m_max_events, std::memory_order_relaxed);
+      DEBUGLOG("epoll event array shrink to %d", m_max_events);
+    }
+  } else {
+    m_idle_wait_count = 0;
+  }
+}
+
+void EventLoop::dispatch(std::function<void()> cb) {
+  if (m_dispatch_mode == DispatchQueued) {
+    addTask(std::move(cb));
+    return;
+  }
+  // the handler is a copy, so it stays valid even if the callback re-listens the fd while running
+  if (cb) {
+    cb();
+  }
 }
 
 void EventLoop::wakeup() {
@@ -210,12 +308,8 @@ void EventLoop::deleteEpollEvent(FdEvent* event) {
 
 }
 
-void EventLoop::addTask(std::function<void()> cb, bool is_wake_up /*=false*/) {
-  ScopeMutex<Mutex> lock(m_mutex);
-  m_pending_tasks.push(cb);
-  lock.unlock();
-
-  if (is_wake_up) {
+void EventLoop::wakeupForTask() {
+  if (!m_wakeup_pending.exchange(true)) {
     wakeup();
   }
 }
@@ -233,9 +327,52 @@ EventLoop* EventLoop::GetCurrentEventLoop() {
   return t_current_eventloop;
 }
 
+EventLoop* EventLoop::GetCurrentEventLoopOrNull() {
+  return t_current_eventloop;
+}
+
 
 bool EventLoop::isLooping() {
   return m_is_looping;
 }
 
+void EventLoop::setDispatchMode(DispatchMode mode) {
+  m_dispatch_mode = mode;
+}
+
+void EventLoop::SetDefaultDispatchMode(DispatchMode mode) {
+  g_dispatch_mode = mode;
+}
+
+EpollStats EventLoop::getEpollStats() {
+  EpollStats stats;
+  stats.m_wait_count = m_wait_count.load(std::memory_order_relaxed);
+  stats.m_event_count = m_event_count.load(std::memory_order_relaxed);
+  stats.m_full_batch_count = m_full_batch_count.load(std::memory_order_relaxed);
+  stats.m_timeout_count = m_timeout_count.load(std::memory_order_relaxed);
+  stats.m_grow_count = m_grow_count.load(std::memory_order_relaxed);
+  stats.m_shrink_count = m_shrink_count.load(std::memory_order_relaxed);
+  stats.m_max_events = m_current_max_events.load(std::memory_order_relaxed);
+  for (int i = 0; i < EpollStats::kHistBuckets; ++i) {
+    stats.m_events_hist[i] = m_events_hist[i].load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+
+std::string EpollStats::toString() const {
+  std::string re = "waits=" + std::to_string(m_wait_count) + " events=" + std::to_string(m_event_count)
+    + " full_batch=" + std::to_string(m_full_batch_count) + " timeout=" + std::to_string(m_timeout_count)
+    + " grow=" + std::to_string(m_grow_count) + " shrink=" + std::to_string(m_shrink_count)
+    + " max_events=" + std::to_string(m_max_events) + " events_per_wait=[";
+  for (int i = 0; i < kHistBuckets; ++i) {
+    if (m_events_hist[i] == 0) {
+      continue;
+    }
+    re += " " + std::to_string(1 << i) + "+:" + std::to_string(m_events_hist[i]);
+  }
+  re += " ]";
+  return re;
+}
+
 }
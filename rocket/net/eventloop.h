@@ -2,17 +2,45 @@
 #define ROCKET_NET_EVENTLOOP_H
 
 #include <pthread.h>
+#include <stdint.h>
 #include <set>
+#include <string>
+#include <vector>
+#include <atomic>
 #include <functional>
-#include <queue>
 #include "rocket/common/mutex.h"
 #include "rocket/net/fd_event.h"
+#include "rocket/net/mpsc_task_queue.h"
 #include "rocket/net/wakeup_fd_event.h"
 #include "rocket/net/timer.h"
 
 namespace rocket {
+
+// epoll_wait counters of one EventLoop, used to tune epoll_max_events
+struct EpollStats {
+  static const int kHistBuckets = 16;
+
+  uint64_t m_wait_count {0};
+  uint64_t m_event_count {0};
+  uint64_t m_full_batch_count {0};    // waits that filled the whole event array
+  uint64_t m_timeout_count {0};       // waits that returned no event
+  uint64_t m_grow_count {0};
+  uint64_t m_shrink_count {0};
+  int m_max_events {0};               // current size of the event array
+
+  // events per wait in log2 buckets: [1], [2, 3], [4, 7] ...
+  uint64_t m_events_hist[kHistBuckets] {0};
+
+  std::string toString() const;
+};
+
 class EventLoop {
  public:
+  enum DispatchMode {
+    DispatchInline = 1,   // run ready fd handlers directly in the same loop iteration
+    DispatchQueued = 2,   // push ready fd handlers to pending tasks, run them next iteration
+  };
+
   EventLoop();
 
   ~EventLoop();
@@ -29,15 +57,33 @@ class EventLoop {
 
   bool isInLoopThread();
 
-  void addTask(std::function<void()> cb, bool is_wake_up = false);
+  // Can be called from any thread, tasks are executed by the loop thread.
+  // Wakeups are coalesced: a burst of posts costs one write to the wakeup fd.
+  template <class F>
+  void addTask(F&& cb, bool is_wake_up = false) {
+    m_pending_tasks.push(std::forward<F>(cb));
+    if (is_wake_up) {
+      wakeupForTask();
+    }
+  }
 
   void addTimerEvent(TimerEvent::s_ptr event);
 
   bool isLooping();
 
+  void setDispatchMode(DispatchMode mode);
+
+  EpollStats getEpollStats();
+
  public:
   static EventLoop* GetCurrentEventLoop();
 
+  // NULL if the calling thread has not created an EventLoop, never creates one
+  static EventLoop* GetCurrentEventLoopOrNull();
+
+  // dispatch mode of event loops created after this call
+  static void SetDefaultDispatchMode(DispatchMode mode);
+
 
  private:
   void dealWakeup();
@@ -46,6 +92,16 @@ class EventLoop {
 
   void initTimer();
 
+  void wakeupForTask();
+
+  void dispatch(std::function<void()> cb);
+
+  int getEpollTimeout();
+
+  void recordEpollWait(int event_count);
+
+  void adjustEpollEvents(int event_count);
+
  private:
   pid_t m_thread_id {0};
 
@@ -59,14 +115,36 @@ class EventLoop {
 
   std::set<int> m_listen_fds;
 
-  std::queue<std::function<void()>> m_pending_tasks;
-  
-  Mutex m_mutex;
+  MpscTaskQueue m_pending_tasks;
+
+  std::atomic<bool> m_wakeup_pending {false};
 
   Timer* m_timer {NULL};
 
   bool m_is_looping {false};
 
+  DispatchMode m_dispatch_mode {DispatchInline};
+
+  std::vector<epoll_event> m_result_events;
+
+  int m_max_events {64};
+  int m_min_events {64};
+  int m_max_events_limit {4096};
+  bool m_epoll_adaptive {true};
+  int m_epoll_max_timeout {10000};    // ms
+
+  int m_idle_wait_count {0};          // consecutive waits that used less than a quarter of the array
+
+  // written by the loop thread only, atomic so getEpollStats() can be called from other threads
+  std::atomic<uint64_t> m_wait_count {0};
+  std::atomic<uint64_t> m_event_count {0};
+  std::atomic<uint64_t> m_full_batch_count {0};
+  std::atomic<uint64_t> m_timeout_count {0};
+  std::atomic<uint64_t> m_grow_count {0};
+  std::atomic<uint64_t> m_shrink_count {0};
+  std::atomic<int> m_current_max_events {0};
+  std::atomic<uint64_t> m_events_hist[EpollStats::kHistBuckets];
+
 };
 
 }
@@ -1,5 +1,9 @@
+#include <errno.h>
 #include <string.h>
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 #include "rocket/net/fd_event.h"
 #include "rocket/common/log.h"
 
@@ -52,7 +56,7 @@ void FdEvent::listen(TriggerEvent event_type, std::function<void()> callback, st
 }
 
 
-void FdEvent::cancle(TriggerEvent event_type) {
+void FdEvent::cancel(TriggerEvent event_type) {
   if (event_type == TriggerEvent::IN_EVENT) {
     m_listen_events.events &= (~EPOLLIN);
   } else {
@@ -61,6 +65,15 @@ void FdEvent::cancle(TriggerEvent event_type) {
 }
 
 
+void FdEvent::setEdgeTriggered(bool value) {
+  if (value) {
+    m_listen_events.events |= (EPOLLET | EPOLLRDHUP);
+  } else {
+    m_listen_events.events &= ~(EPOLLET | EPOLLRDHUP);
+  }
+}
+
+
 void FdEvent::setNonBlock() {
   
   int flag = fcntl(m_fd, F_GETFL, 0);
@@ -71,5 +84,12 @@ void FdEvent::setNonBlock() {
   fcntl(m_fd, F_SETFL, flag | O_NONBLOCK);
 }
 
+void FdEvent::setNoDelay() {
+  int on = 1;
+  if (setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0) {
+    ERRORLOG("setsockopt TCP_NODELAY error, fd[%d], errno=%d, error=%s", m_fd, errno, strerror(errno));
+  }
+}
+
 
 }
\ No newline at end of file
@@ -22,11 +22,21 @@ class FdEvent {
 
   void setNonBlock();
 
+  // disable Nagle, pipelined requests and responses must not wait for the peer's delayed ack
+  void setNoDelay();
+
   std::function<void()> handler(TriggerEvent event_type);
 
   void listen(TriggerEvent event_type, std::function<void()> callback, std::function<void()> error_callback = nullptr);
 
-  void cancle(TriggerEvent event_type);
+  void cancel(TriggerEvent event_type);
+
+  // EPOLLET | EPOLLRDHUP, the owner registers once and drains the fd until EAGAIN
+  void setEdgeTriggered(bool value);
+
+  bool isEdgeTriggered() const {
+    return (m_listen_events.events & EPOLLET) != 0;
+  }
 
   int getFd() const {
     return m_fd;
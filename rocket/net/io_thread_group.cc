@@ -1,3 +1,5 @@
+#include <stdlib.h>
+#include <time.h>
 #include "rocket/net/io_thread_group.h"
 #include "rocket/common/log.h"
 
@@ -5,8 +7,11 @@
 namespace rocket {
 
 
-IOThreadGroup::IOThreadGroup(int size) : m_size(size) {
+IOThreadGroup::IOThreadGroup(int size) : m_size(size), m_seed((unsigned int)time(NULL)) {
   m_io_thread_groups.resize(size);
+  m_requests.resize(size, 0);
+  m_connections.resize(size, 0);
+  m_placed.resize(size, 0);
   for (size_t i = 0; (int)i < size; ++i) {
     m_io_thread_groups[i] = new IOThread();
   }
@@ -29,10 +34,53 @@ void IOThreadGroup::join() {
 } 
 
 IOThread* IOThreadGroup::getIOThread() {
-  if (m_index == (int)m_io_thread_groups.size() || m_index == -1)  {
-    m_index = 0;
+  uint32_t index = m_index.fetch_add(1, std::memory_order_relaxed);
+  return m_io_thread_groups[index % m_io_thread_groups.size()];
+}
+
+IOThread* IOThreadGroup::getIOThread(int index) {
+  return m_io_thread_groups[index];
+}
+
+int IOThreadGroup::size() {
+  return m_size;
+}
+
+int IOThreadGroup::pickIOThread() {
+  if (m_size <= 1) {
+    return 0;
+  }
+  // connections placed since the last sample count with the average load of a connection,
+  // so a burst of accepts does not all go to the thread that was idle
+  int64_t requests = 0;
+  int64_t connections = 0;
+  for (int i = 0; i < m_size; ++i) {
+    requests += m_requests[i];
+    connections += m_connections[i];
   }
-  return m_io_thread_groups[m_index++];
+  int64_t per_connection = (connections > 0) ? requests / connections : 0;
+  if (per_connection < 1) {
+    per_connection = 1;
+  }
+
+  int a = rand_r(&m_seed) % m_size;
+  int b = (a + 1 + rand_r(&m_seed) % (m_size - 1)) % m_size;
+  int64_t load_a = m_requests[a] + m_placed[a] * per_connection;
+  int64_t load_b = m_requests[b] + m_placed[b] * per_connection;
+  if (load_a != load_b) {
+    return load_a < load_b ? a : b;
+  }
+  return (m_connections[a] + m_placed[a] <= m_connections[b] + m_placed[b]) ? a : b;
+}
+
+void IOThreadGroup::setLoad(int index, int64_t requests, int connections) {
+  m_requests[index] = requests;
+  m_connections[index] = connections;
+  m_placed[index] = 0;
+}
+
+void IOThreadGroup::addConnection(int index) {
+  m_placed[index]++;
 }
 
 }
\ No newline at end of file
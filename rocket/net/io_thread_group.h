@@ -2,6 +2,7 @@
 #define ROCKET_NET_IO_THREAD_GROUP_H
 
 #include <vector>
+#include <atomic>
 #include "rocket/common/log.h"
 #include "rocket/net/io_thread.h"
 
@@ -20,14 +21,34 @@ class IOThreadGroup {
 
   void join();
 
+  // round robin, may be called from any thread
   IOThread* getIOThread();
 
+  IOThread* getIOThread(int index);
+
+  int size();
+
+  // Load aware placement, only for the thread that places connections (TcpServer's main loop).
+  // Index of the less loaded of two IO threads picked at random, by requests of the last
+  // interval and its connections
+  int pickIOThread();
+
+  void setLoad(int index, int64_t requests, int connections);
+
+  // a connection placed on index since the last setLoad()
+  void addConnection(int index);
+
  private:
 
   int m_size {0};
   std::vector<IOThread*> m_io_thread_groups;
 
-  int m_index {0};
+  std::atomic<uint32_t> m_index {0};
+
+  std::vector<int64_t> m_requests;
+  std::vector<int> m_connections;
+  std::vector<int> m_placed;     // connections placed since the last setLoad()
+  unsigned int m_seed {0};
 
 };
 
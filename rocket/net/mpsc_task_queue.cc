@@ -0,0 +1,149 @@
+#include "rocket/net/mpsc_task_queue.h"
+
+namespace rocket {
+
+MpscTaskQueue::MpscTaskQueue(size_t pool_size /*= kDefaultPoolSize*/) : m_pool_size(pool_size) {
+  m_stub.m_index = kNilIndex;
+  m_head.store(&m_stub);
+  m_tail = &m_stub;
+
+  if (m_pool_size >= kHeapIndex) {
+    m_pool_size = kHeapIndex - 1;
+  }
+
+  uint32_t first = kNilIndex;
+  if (m_pool_size > 0) {
+    m_pool = new Node[m_pool_size];
+    for (size_t i = 0; i < m_pool_size; ++i) {
+      m_pool[i].m_index = i;
+      m_pool[i].m_free_next.store(i + 1 < m_pool_size ? i + 1 : kNilIndex, std::memory_order_relaxed);
+    }
+    first = 0;
+  }
+  m_free_head.store(first);
+}
+
+MpscTaskQueue::~MpscTaskQueue() {
+  // drop the tasks which never got a chance to run
+  Node* node = dequeue();
+  while (node) {
+    node->m_destroy(node->m_storage);
+    freeNode(node);
+    node = dequeue();
+  }
+
+  if (m_pool) {
+    delete[] m_pool;
+    m_pool = NULL;
+  }
+}
+
+
+MpscTaskQueue::Node* MpscTaskQueue::allocNode() {
+  uint64_t old_head = m_free_head.load(std::memory_order_acquire);
+  while (true) {
+    uint32_t index = (uint32_t)(old_head & 0xFFFFFFFF);
+    if (index == kNilIndex) {
+      Node* node = new Node();
+      node->m_index = kHeapIndex;
+      return node;
+    }
+    uint32_t next = m_pool[index].m_free_next.load(std::memory_order_relaxed);
+    uint64_t new_head = (((old_head >> 32) + 1) << 32) | next;
+    if (m_free_head.compare_exchange_weak(old_head, new_head, std::memory_order_acq_rel, std::memory_order_acquire)) {
+      m_pool[index].m_next.store(nullptr, std::memory_order_relaxed);
+      return &m_pool[index];
+    }
+  }
+}
+
+void MpscTaskQueue::freeNode(Node* node) {
+  if (node->m_index == kHeapIndex) {
+    delete node;
+    return;
+  }
+
+  uint64_t old_head = m_free_head.load(std::memory_order_acquire);
+  while (true) {
+    node->m_free_next.store((uint32_t)(old_head & 0xFFFFFFFF), std::memory_order_relaxed);
+    uint64_t new_head = (((old_head >> 32) + 1) << 32) | node->m_index;
+    if (m_free_head.compare_exchange_weak(old_head, new_head, std::memory_order_acq_rel, std::memory_order_acquire)) {
+      return;
+    }
+  }
+}
+
+
+void MpscTaskQueue::enqueue(Node* node) {
+  node->m_next.store(nullptr, std::memory_order_relaxed);
+  Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+  prev->m_next.store(node, std::memory_order_release);
+}
+
+
+MpscTaskQueue::Node* MpscTaskQueue::dequeue() {
+  Node* tail = m_tail;
+  Node* next = tail->m_next.load(std::memory_order_acquire);
+
+  if (tail == &m_stub) {
+    if (next == nullptr) {
+      return nullptr;
+    }
+    m_tail = next;
+    tail = next;
+    next = next->m_next.load(std::memory_order_acquire);
+  }
+
+  if (next) {
+    m_tail = next;
+    return tail;
+  }
+
+  // tail is the last visible node, a producer may be in the middle of linking after it
+  Node* head = m_head.load(std::memory_order_acquire);
+  if (tail != head) {
+    return nullptr;
+  }
+
+  enqueue(&m_stub);
+
+  next = tail->m_next.load(std::memory_order_acquire);
+  if (next) {
+    m_tail = next;
+    return tail;
+  }
+  return nullptr;
+}
+
+
+int MpscTaskQueue::runTasks() {
+  Node* last = m_head.load(std::memory_order_acquire);
+  if (last == &m_stub && m_tail == &m_stub) {
+    return 0;
+  }
+
+  int count = 0;
+  while (true) {
+    Node* node = dequeue();
+    if (node == nullptr) {
+      break;
+    }
+    node->m_invoke(node->m_storage);
+    node->m_destroy(node->m_storage);
+    freeNode(node);
+    ++count;
+
+    if (node == last) {
+      break;
+    }
+  }
+  return count;
+}
+
+
+bool MpscTaskQueue::empty() {
+  return m_tail == &m_stub && m_stub.m_next.load(std::memory_order_acquire) == nullptr
+    && m_head.load(std::memory_order_acquire) == &m_stub;
+}
+
+}
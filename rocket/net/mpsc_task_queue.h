@@ -0,0 +1,134 @@
+#ifndef ROCKET_NET_MPSC_TASK_QUEUE_H
+#define ROCKET_NET_MPSC_TASK_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace rocket {
+
+/*
+ * Lock-free multi-producer single-consumer task queue.
+ *
+ * Intrusive node queue (Vyukov), every producer does one atomic exchange to
+ * enqueue and never blocks. Nodes come from a fixed size pool owned by the
+ * queue, so steady-state pushes do no heap allocation; closures that fit in
+ * kInlineSize bytes are stored inside the node itself. When the pool is
+ * exhausted nodes are taken from the heap, so the queue itself is unbounded.
+ *
+ * push() may be called from any thread, runTasks() only from the consumer.
+ */
+class MpscTaskQueue {
+ public:
+  static const size_t kInlineSize = 64;
+  static const size_t kDefaultPoolSize = 1024;
+
+  explicit MpscTaskQueue(size_t pool_size = kDefaultPoolSize);
+
+  ~MpscTaskQueue();
+
+  template <class F>
+  void push(F&& cb) {
+    typedef typename std::decay<F>::type Fn;
+    if (isNullTask(cb)) {
+      return;
+    }
+    Node* node = allocNode();
+    store(node, std::forward<F>(cb), std::integral_constant<bool, sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t)>());
+    enqueue(node);
+  }
+
+  // Run the tasks that were queued when this call started, return count of executed tasks.
+  // Tasks pushed while running are left for the next call.
+  int runTasks();
+
+  bool empty();
+
+ private:
+  struct Node {
+    std::atomic<Node*> m_next {nullptr};
+    std::atomic<uint32_t> m_free_next {0};
+    uint32_t m_index {0};
+    void (*m_invoke)(void*) {nullptr};
+    void (*m_destroy)(void*) {nullptr};
+    alignas(std::max_align_t) char m_storage[kInlineSize];
+  };
+
+  static const uint32_t kNilIndex = 0xFFFFFFFF;
+  static const uint32_t kHeapIndex = 0xFFFFFFFE;
+
+  // the closure inside the node
+  template <class F>
+  static void store(Node* node, F&& cb, std::true_type) {
+    typedef typename std::decay<F>::type Fn;
+    new (node->m_storage) Fn(std::forward<F>(cb));
+    node->m_invoke = &InvokeInline<Fn>;
+    node->m_destroy = &DestroyInline<Fn>;
+  }
+
+  // too big for the node, it holds a pointer to the closure
+  template <class F>
+  static void store(Node* node, F&& cb, std::false_type) {
+    typedef typename std::decay<F>::type Fn;
+    *reinterpret_cast<Fn**>(node->m_storage) = new Fn(std::forward<F>(cb));
+    node->m_invoke = &InvokeHeap<Fn>;
+    node->m_destroy = &DestroyHeap<Fn>;
+  }
+
+  template <class Fn>
+  static void InvokeInline(void* p) {
+    (*reinterpret_cast<Fn*>(p))();
+  }
+
+  template <class Fn>
+  static void DestroyInline(void* p) {
+    reinterpret_cast<Fn*>(p)->~Fn();
+  }
+
+  template <class Fn>
+  static void InvokeHeap(void* p) {
+    (**reinterpret_cast<Fn**>(p))();
+  }
+
+  template <class Fn>
+  static void DestroyHeap(void* p) {
+    delete *reinterpret_cast<Fn**>(p);
+  }
+
+  template <class Fn>
+  static bool isNullTask(const Fn&) {
+    return false;
+  }
+
+  static bool isNullTask(const std::function<void()>& cb) {
+    return !cb;
+  }
+
+  Node* allocNode();
+
+  void freeNode(Node* node);
+
+  void enqueue(Node* node);
+
+  Node* dequeue();
+
+ private:
+  std::atomic<Node*> m_head;      // producers push here
+  Node* m_tail {nullptr};         // consumer pops here
+  Node m_stub;
+
+  Node* m_pool {nullptr};
+  size_t m_pool_size {0};
+
+  // ABA-safe free list: high 32 bits tag, low 32 bits node index
+  std::atomic<uint64_t> m_free_head;
+
+};
+
+}
+
+#endif
@@ -3,13 +3,16 @@
 #include <google/protobuf/message.h>
 #include "rocket/net/rpc/rpc_channel.h"
 #include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_client_runtime.h"
 #include "rocket/net/coder/tinypb_protocol.h"
 #include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/tcp/tcp_client_pool.h"
 #include "rocket/common/log.h"
 #include "rocket/common/msg_id_util.h"
 #include "rocket/common/error_code.h"
 #include "rocket/common/run_time.h"
 #include "rocket/net/timer_event.h"
+#include "rocket/net/worker_pool.h"
 
 namespace rocket {
 
@@ -23,17 +26,37 @@ RpcChannel::~RpcChannel() {
 
 
 void RpcChannel::callBack() {
+  if (m_timer_event) {
+    m_timer_event->setCancled(true);
+  }
+  if (m_client && !m_client_released) {
+    // on the connection's IO thread, startCall() acquired it there
+    m_client_released = true;
+    TcpClientPool::GetCurrentPool()->release(m_client);
+  }
   RpcController* my_controller = dynamic_cast<RpcController*>(getController());
   if (my_controller->Finished()) {
     return;
   }
 
-  if (m_closure) {
-    m_closure->Run();
-    if (my_controller) {
-      my_controller->SetFinished(true);
-    }
+  if (!m_closure) {
+    return;
+  }
+
+  // finished before the closure runs: a timeout must not run it again, and once it runs a
+  // waiter of CallSync/CallAsync or the callback executor owns the controller
+  my_controller->SetFinished(true);
+
+  RpcClientRuntime* runtime = RpcClientRuntime::GetRpcClientRuntime();
+  if (runtime && runtime->hasCallbackExecutor()) {
+    s_ptr channel = shared_from_this();
+    runtime->runCallback([channel]() {
+      channel->getClosure()->Run();
+    });
+    return;
   }
+
+  m_closure->Run();
 }
 
 void RpcChannel::CallMethod(const google::protobuf::MethodDescriptor* method,
@@ -58,8 +81,6 @@ void RpcChannel::CallMethod(const google::protobuf::MethodDescriptor* method,
     return;
   }
 
-  m_client = std::make_shared<TcpClient>(m_peer_addr);
-
   if (my_controller->GetMsgId().empty()) {
     // 先从 runtime 里面取, 取不到再生成一个
     // 这样的目的是为了实现 msg_id 的透传，假设服务 A 调用了 B，那么同一个 msgid 可以在服务 A 和 B 之间串起来，方便日志追踪
@@ -97,25 +118,104 @@ void RpcChannel::CallMethod(const google::protobuf::MethodDescriptor* method,
     return;
   }
 
+  RpcClientRuntime* runtime = RpcClientRuntime::GetRpcClientRuntime();
+  if (runtime == NULL && WorkerPool::IsInWorkerThread()) {
+    // a worker has no EventLoop running, connect() would run one there and never give the worker back
+    std::string err_info = "call from a worker thread needs client io_threads above 0";
+    my_controller->SetError(ERROR_RPC_CHANNEL_INIT, err_info);
+    ERRORLOG("%s | %s", req_protocol->m_msg_id.c_str(), err_info.c_str());
+    callBack();
+    return;
+  }
+  if (runtime && !runtime->isInIOThread()) {
+    // the caller thread only serializes, connections belong to the runtime's IO threads
+    s_ptr channel = shared_from_this();
+    runtime->post([channel, req_protocol]() {
+      channel->startCall(req_protocol);
+    });
+    return;
+  }
+
+  startCall(req_protocol);
+}
+
+
+void RpcChannel::startCall(std::shared_ptr<TinyPBProtocol> req_protocol) {
+  RpcController* my_controller = dynamic_cast<RpcController*>(getController());
+
+  // the connection is shared with other calls and outlives this channel
+  m_client = TcpClientPool::GetCurrentPool()->acquire(m_peer_addr, req_protocol->m_msg_id);
+
   s_ptr channel = shared_from_this(); 
 
-  TimerEvent::s_ptr timer_event = std::make_shared<TimerEvent>(my_controller->GetTimeout(), false, [my_controller, channel]() mutable {
+  // callBack() cancels the timer. It must not hold the channel, the read done does while the call is in flight
+  std::weak_ptr<RpcChannel> weak_channel = channel;
+  m_timer_event = std::make_shared<TimerEvent>(my_controller->GetTimeout(), false, [weak_channel]() {
+    s_ptr channel = weak_channel.lock();
+    if (!channel) {
+      return;
+    }
+    RpcController* my_controller = dynamic_cast<RpcController*>(channel->getController());
     INFOLOG("%s | call rpc timeout arrive", my_controller->GetMsgId().c_str());
     if (my_controller->Finished()) {
-      channel.reset();
       return;
     }
 
-    my_controller->StartCancel();
+    // a late response must not find the read done any more
+    channel->getTcpClient()->cancelReadMessage(my_controller->GetMsgId());
     my_controller->SetError(ERROR_RPC_CALL_TIMEOUT, "rpc call timeout " + std::to_string(my_controller->GetTimeout()));
+    my_controller->SetCanceled();
 
     channel->callBack();
-    channel.reset();
   });
 
-  m_client->addTimerEvent(timer_event);
+  m_client->addTimerEvent(m_timer_event);
+
+  // the dones hold the channel, the pooled connection may run them after the caller dropped it.
+  // The read is registered first so the pool sees this msg_id in flight on the connection
+  bool registered = getTcpClient()->readMessage(req_protocol->m_msg_id, [this, channel, my_controller](AbstractProtocol::s_ptr msg) mutable {
+    if (!msg) {
+      ERRORLOG("%s | no response, the connection closed or the msg_id already waits on it, peer addr[%s]",
+        my_controller->GetMsgId().c_str(), getTcpClient()->getPeerAddr()->toString().c_str());
+      my_controller->SetError(ERROR_PEER_CLOSED, "connection closed before the response");
+      callBack();
+      return;
+    }
+    std::shared_ptr<rocket::TinyPBProtocol> rsp_protocol = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg);
+    INFOLOG("%s | success get rpc response, call method name[%s], peer addr[%s], local addr[%s]", 
+      rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(),
+      getTcpClient()->getPeerAddr()->toString().c_str(), getTcpClient()->getLocalAddr()->toString().c_str());
+
+    if (!(getResponse()->ParseFromString(rsp_protocol->m_pb_data))){
+      ERRORLOG("%s | serialize error", rsp_protocol->m_msg_id.c_str());
+      my_controller->SetError(ERROR_FAILED_SERIALIZE, "serialize error");
+      callBack();
+      return;
+    }
 
-  m_client->connect([req_protocol, this]() mutable {
+    if (rsp_protocol->m_err_code != 0) {
+      ERRORLOG("%s | call rpc methood[%s] failed, error code[%d], error info[%s]", 
+        rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(),
+        rsp_protocol->m_err_code, rsp_protocol->m_err_info.c_str());
+
+      my_controller->SetError(rsp_protocol->m_err_code, rsp_protocol->m_err_info);
+      callBack();
+      return;
+    }
+
+    INFOLOG("%s | call rpc success, call method name[%s], peer addr[%s], local addr[%s]",
+      rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(),
+      getTcpClient()->getPeerAddr()->toString().c_str(), getTcpClient()->getLocalAddr()->toString().c_str())
+
+    callBack();
+
+  });
+  if (!registered) {
+    // the read done already failed the call, the request must not take the response of the other one
+    return;
+  }
+
+  m_client->connect([req_protocol, this, channel]() mutable {
 
     RpcController* my_controller = dynamic_cast<RpcController*>(getController());
 
@@ -125,6 +225,7 @@ void RpcChannel::CallMethod(const google::protobuf::MethodDescriptor* method,
         req_protocol->m_msg_id.c_str(), my_controller->GetErrorCode(), 
         my_controller->GetErrorInfo().c_str(), getTcpClient()->getPeerAddr()->toString().c_str());
 
+      getTcpClient()->cancelReadMessage(req_protocol->m_msg_id);
       callBack();
 
       return;
@@ -135,42 +236,11 @@ void RpcChannel::CallMethod(const google::protobuf::MethodDescriptor* method,
       getTcpClient()->getPeerAddr()->toString().c_str(), 
       getTcpClient()->getLocalAddr()->toString().c_str()); 
 
-    getTcpClient()->writeMessage(req_protocol, [req_protocol, this, my_controller](AbstractProtocol::s_ptr) mutable {
+    getTcpClient()->writeMessage(req_protocol, [req_protocol, this, channel](AbstractProtocol::s_ptr) mutable {
       INFOLOG("%s | send rpc request success. call method name[%s], peer addr[%s], local addr[%s]", 
         req_protocol->m_msg_id.c_str(), req_protocol->m_method_name.c_str(),
         getTcpClient()->getPeerAddr()->toString().c_str(), getTcpClient()->getLocalAddr()->toString().c_str());
 
-        getTcpClient()->readMessage(req_protocol->m_msg_id, [this, my_controller](AbstractProtocol::s_ptr msg) mutable {
-        std::shared_ptr<rocket::TinyPBProtocol> rsp_protocol = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg);
-        INFOLOG("%s | success get rpc response, call method name[%s], peer addr[%s], local addr[%s]", 
-          rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(),
-          getTcpClient()->getPeerAddr()->toString().c_str(), getTcpClient()->getLocalAddr()->toString().c_str());
-
-        if (!(getResponse()->ParseFromString(rsp_protocol->m_pb_data))){
-          ERRORLOG("%s | serialize error", rsp_protocol->m_msg_id.c_str());
-          my_controller->SetError(ERROR_FAILED_SERIALIZE, "serialize error");
-          callBack();
-          return;
-        }
-
-        if (rsp_protocol->m_err_code != 0) {
-          ERRORLOG("%s | call rpc methood[%s] failed, error code[%d], error info[%s]", 
-            rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(),
-            rsp_protocol->m_err_code, rsp_protocol->m_err_info.c_str());
-
-          my_controller->SetError(rsp_protocol->m_err_code, rsp_protocol->m_err_info);
-          callBack();
-          return;
-        }
-
-        INFOLOG("%s | call rpc success, call method name[%s], peer addr[%s], local addr[%s]",
-          rsp_protocol->m_msg_id.c_str(), rsp_protocol->m_method_name.c_str(),
-          getTcpClient()->getPeerAddr()->toString().c_str(), getTcpClient()->getLocalAddr()->toString().c_str())
-
-        callBack();
-      
-      });
-
     });
 
   });
@@ -2,10 +2,16 @@
 #define ROCKET_NET_RPC_RPC_CHANNEL_H
 
 #include <google/protobuf/service.h>
+#include <future>
 #include <memory>
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/coder/tinypb_protocol.h"
 #include "rocket/net/timer_event.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_closure.h"
+#include "rocket/net/rpc/rpc_client_runtime.h"
+#include "rocket/common/error_code.h"
 
 namespace rocket {
 
@@ -28,6 +34,10 @@ namespace rocket {
 
 
 
+#if defined(__cpp_impl_coroutine)
+class RpcCallAwaiter;
+#endif
+
 class RpcChannel : public google::protobuf::RpcChannel, public std::enable_shared_from_this<RpcChannel> {
  
  public:
@@ -53,6 +63,69 @@ class RpcChannel : public google::protobuf::RpcChannel, public std::enable_share
                           google::protobuf::RpcController* controller, const google::protobuf::Message* request,
                           google::protobuf::Message* response, google::protobuf::Closure* done);
 
+  // Init() the channel and start one call of a Stub method, e.g. Call(&Order_Stub::makeOrder, controller, request, response, done).
+  // A channel carries one call, done runs at once with ERROR_RPC_CHANNEL_INIT on a used one
+  template <class Stub, class Request, class Response>
+  void Call(void (Stub::*method)(google::protobuf::RpcController*, const Request*, Response*, google::protobuf::Closure*),
+      controller_s_ptr controller, std::shared_ptr<Request> request, std::shared_ptr<Response> response, closure_s_ptr done) {
+    if (m_is_init) {
+      ERRORLOG("failed call, channel already used");
+      dynamic_cast<RpcController*>(controller.get())->SetError(ERROR_RPC_CHANNEL_INIT, "channel already used");
+      done->Run();
+      return;
+    }
+    Init(controller, request, response, done);
+    Stub stub(this);
+    (stub.*method)(controller.get(), request.get(), response.get(), done.get());
+  }
+
+  // Start one call of a Stub method on this channel, e.g. CallAsync(&Order_Stub::makeOrder, controller, request, response).
+  // The future is ready when the call has finished, the result is in controller.
+  // The call is carried by the client runtime's IO threads, the caller needs no EventLoop
+  template <class Stub, class Request, class Response>
+  std::future<void> CallAsync(void (Stub::*method)(google::protobuf::RpcController*, const Request*, Response*, google::protobuf::Closure*),
+      controller_s_ptr controller, std::shared_ptr<Request> request, std::shared_ptr<Response> response) {
+    std::shared_ptr<RpcPromiseClosure> closure = std::make_shared<RpcPromiseClosure>();
+    std::future<void> future = closure->getFuture();
+
+    RpcController* my_controller = dynamic_cast<RpcController*>(controller.get());
+    if (RpcClientRuntime::GetRpcClientRuntime() == NULL) {
+      ERRORLOG("failed CallAsync, client io_threads is 0");
+      my_controller->SetError(ERROR_RPC_CHANNEL_INIT, "CallAsync needs client io_threads above 0");
+      closure->Run();
+      return future;
+    }
+
+    Call(method, controller, request, response, closure);
+    return future;
+  }
+
+  // CallAsync() and wait until it is done. The controller's timeout is the deadline, it covers
+  // connecting, sending and the response. Returns the controller's error code, 0 on success.
+  // Must not be called on a client runtime IO thread, the call would wait for itself
+  template <class Stub, class Request, class Response>
+  int CallSync(void (Stub::*method)(google::protobuf::RpcController*, const Request*, Response*, google::protobuf::Closure*),
+      controller_s_ptr controller, std::shared_ptr<Request> request, std::shared_ptr<Response> response) {
+    RpcController* my_controller = dynamic_cast<RpcController*>(controller.get());
+    RpcClientRuntime* runtime = RpcClientRuntime::GetRpcClientRuntime();
+    if (runtime && runtime->isInIOThread()) {
+      ERRORLOG("failed CallSync, called on a client io thread");
+      my_controller->SetError(ERROR_RPC_CHANNEL_INIT, "CallSync called on a client io thread");
+      return my_controller->GetErrorCode();
+    }
+
+    CallAsync(method, controller, request, response).wait();
+    return my_controller->GetErrorCode();
+  }
+
+#if defined(__cpp_impl_coroutine)
+  // co_await channel->call(&Order_Stub::makeOrder, controller, request, response) in a rocket::Task,
+  // gives the controller's error code. Defined in rpc_coroutine.h
+  template <class Stub, class Request, class Response>
+  RpcCallAwaiter call(void (Stub::*method)(google::protobuf::RpcController*, const Request*, Response*, google::protobuf::Closure*),
+      controller_s_ptr controller, std::shared_ptr<Request> request, std::shared_ptr<Response> response);
+#endif
+
 
   google::protobuf::RpcController* getController(); 
 
@@ -67,6 +140,9 @@ class RpcChannel : public google::protobuf::RpcChannel, public std::enable_share
  private:
   void callBack();
 
+  // acquire a connection, arm the timeout and send, in the thread of the connection's EventLoop
+  void startCall(std::shared_ptr<TinyPBProtocol> req_protocol);
+
  private:
   NetAddr::s_ptr m_peer_addr {nullptr};
   NetAddr::s_ptr m_local_addr {nullptr};
@@ -79,6 +155,9 @@ class RpcChannel : public google::protobuf::RpcChannel, public std::enable_share
   bool m_is_init {false};
 
   TcpClient::s_ptr m_client {nullptr};
+  bool m_client_released {false};     // given back to the TcpClientPool by callBack()
+
+  TimerEvent::s_ptr m_timer_event {nullptr};    // the call's timeout
 
 };
 
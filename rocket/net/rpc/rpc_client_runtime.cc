@@ -0,0 +1,72 @@
+#include "rocket/net/rpc/rpc_client_runtime.h"
+#include "rocket/common/config.h"
+#include "rocket/common/log.h"
+
+namespace rocket {
+
+static thread_local bool t_in_client_io_thread = false;
+
+
+static RpcClientRuntime* CreateRpcClientRuntime() {
+  int io_threads = Config::GetGlobalConfig()->m_client_io_threads;
+  if (io_threads <= 0) {
+    return NULL;
+  }
+  return new RpcClientRuntime(io_threads);
+}
+
+RpcClientRuntime* RpcClientRuntime::GetRpcClientRuntime() {
+  // initialized once even when the first calls race
+  static RpcClientRuntime* runtime = CreateRpcClientRuntime();
+  return runtime;
+}
+
+RpcClientRuntime::Executor RpcClientRuntime::EventLoopExecutor(EventLoop* loop) {
+  return [loop](std::function<void()> cb) {
+    loop->addTask(std::move(cb), true);
+  };
+}
+
+
+RpcClientRuntime::RpcClientRuntime(int io_threads) {
+  m_io_thread_group = new IOThreadGroup(io_threads);
+  for (int i = 0; i < io_threads; ++i) {
+    // queued ahead of any call, round robin hands out every thread once
+    m_io_thread_group->getIOThread()->getEventLoop()->addTask([]() {
+      t_in_client_io_thread = true;
+    });
+  }
+  m_io_thread_group->start();
+  INFOLOG("rpc client runtime started with %d io threads", io_threads);
+}
+
+RpcClientRuntime::~RpcClientRuntime() {
+
+}
+
+
+bool RpcClientRuntime::isInIOThread() {
+  return t_in_client_io_thread;
+}
+
+void RpcClientRuntime::post(std::function<void()> task) {
+  m_io_thread_group->getIOThread()->getEventLoop()->addTask(std::move(task), true);
+}
+
+void RpcClientRuntime::setCallbackExecutor(Executor executor) {
+  m_callback_executor = executor;
+}
+
+bool RpcClientRuntime::hasCallbackExecutor() {
+  return m_callback_executor != nullptr;
+}
+
+void RpcClientRuntime::runCallback(std::function<void()> cb) {
+  if (m_callback_executor) {
+    m_callback_executor(std::move(cb));
+  } else {
+    cb();
+  }
+}
+
+}
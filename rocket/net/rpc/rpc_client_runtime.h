@@ -0,0 +1,58 @@
+#ifndef ROCKET_NET_RPC_RPC_CLIENT_RUNTIME_H
+#define ROCKET_NET_RPC_RPC_CLIENT_RUNTIME_H
+
+#include <functional>
+#include "rocket/net/eventloop.h"
+#include "rocket/net/io_thread_group.h"
+
+namespace rocket {
+
+/*
+ * IO threads that own the outbound connections of the process.
+ *
+ * With <client><io_threads> above 0, RpcChannel calls from any other thread are
+ * posted to one of these loops through its lock free task queue and return at
+ * once. The TcpClientPool of that IO thread carries the call, the closure runs
+ * on the callback executor, or on the IO thread when none is set.
+ * With 0 there is no runtime and a call runs in the caller thread's EventLoop.
+ */
+class RpcClientRuntime {
+
+ public:
+  typedef std::function<void(std::function<void()>)> Executor;
+
+ public:
+  // NULL when <client><io_threads> is 0. The IO threads are started on the first call
+  static RpcClientRuntime* GetRpcClientRuntime();
+
+  // executor that posts to loop, e.g. to complete calls on the loop of a business thread
+  static Executor EventLoopExecutor(EventLoop* loop);
+
+ public:
+  RpcClientRuntime(int io_threads);
+
+  ~RpcClientRuntime();
+
+  // whether the calling thread is one of the runtime's IO threads
+  bool isInIOThread();
+
+  // run task on the next IO thread, round robin. Can be called from any thread
+  void post(std::function<void()> task);
+
+  // set before the first call, the executor is not guarded against concurrent calls
+  void setCallbackExecutor(Executor executor);
+
+  bool hasCallbackExecutor();
+
+  void runCallback(std::function<void()> cb);
+
+ private:
+  IOThreadGroup* m_io_thread_group {NULL};
+
+  Executor m_callback_executor {nullptr};
+
+};
+
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <google/protobuf/stubs/callback.h>
 #include <functional>
+#include <future>
 #include <memory>
 #include "rocket/common/run_time.h"
 #include "rocket/common/log.h"
@@ -66,5 +67,22 @@ class RpcClosure : public google::protobuf::Closure {
 
 };
 
+
+// completes a future when the call is done, the result is in the call's controller
+class RpcPromiseClosure : public google::protobuf::Closure {
+ public:
+  std::future<void> getFuture() {
+    return m_promise.get_future();
+  }
+
+  void Run() override {
+    m_promise.set_value();
+  }
+
+ private:
+  std::promise<void> m_promise;
+
+};
+
 }
 #endif
\ No newline at end of file
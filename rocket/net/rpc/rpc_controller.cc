@@ -24,9 +24,13 @@ std::string RpcController::ErrorText() const {
 }
 
 void RpcController::StartCancel() {
+  SetCanceled();
+  SetFinished(true);
+}
+
+void RpcController::SetCanceled() {
   m_is_cancled = true;
   m_is_failed = true;
-  SetFinished(true);
 }
 
 void RpcController::SetFailed(const std::string& reason) {
@@ -24,6 +24,9 @@ class RpcController : public google::protobuf::RpcController {
 
   void StartCancel();
 
+  // canceled and failed like StartCancel(), but not finished: the closure still has to run
+  void SetCanceled();
+
   void SetFailed(const std::string& reason);
 
   bool IsCanceled() const;
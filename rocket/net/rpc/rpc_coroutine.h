@@ -0,0 +1,307 @@
+#ifndef ROCKET_NET_RPC_RPC_COROUTINE_H
+#define ROCKET_NET_RPC_RPC_COROUTINE_H
+
+/*
+ * C++20 coroutines for RPC handlers and client calls, empty below C++20.
+ *
+ *   rocket::Task Foo::corun() {
+ *     int rt = co_await channel->call(&Order_Stub::makeOrder, controller, request, response);
+ *     ...
+ *   }
+ *
+ * A Task starts when it is awaited or spawned. An awaited call resumes the coroutine on
+ * the EventLoop of the thread that awaited it, or on the thread that completed the call
+ * when that thread runs no EventLoop. A server handler awaiting downstream calls
+ * therefore keeps running on its connection's IO thread without blocking it.
+ */
+
+#if defined(__cpp_impl_coroutine)
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <utility>
+#include "rocket/common/log.h"
+#include "rocket/common/exception.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/rpc/rpc_channel.h"
+#include "rocket/net/rpc/rpc_closure.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_interface.h"
+
+namespace rocket {
+
+// Lazily started coroutine without a result. co_await on it runs it to the end and
+// rethrows what it threw
+class Task {
+ public:
+  struct promise_type {
+    std::coroutine_handle<> m_continuation;
+    std::exception_ptr m_exception;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+
+    struct FinalAwaiter {
+      bool await_ready() noexcept {
+        return false;
+      }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().m_continuation;
+        return continuation ? continuation : std::noop_coroutine();
+      }
+
+      void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept {
+      return {};
+    }
+
+    void return_void() {}
+
+    void unhandled_exception() {
+      m_exception = std::current_exception();
+    }
+  };
+
+ public:
+  explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+  Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+  Task(const Task&) = delete;
+
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  bool await_ready() {
+    return false;
+  }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) {
+    m_handle.promise().m_continuation = continuation;
+    return m_handle;
+  }
+
+  void await_resume() {
+    if (m_handle.promise().m_exception) {
+      std::rethrow_exception(m_handle.promise().m_exception);
+    }
+  }
+
+ private:
+  std::coroutine_handle<promise_type> m_handle;
+
+};
+
+
+namespace detail {
+
+// coroutine that starts at once and frees itself at the end, nobody awaits it
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() {
+      return {};
+    }
+
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+
+    void return_void() {}
+
+    void unhandled_exception() {
+      ERRORLOG("unhandled exception in detached coroutine");
+    }
+  };
+};
+
+inline DetachedTask RunDetached(Task task) {
+  try {
+    co_await task;
+  } catch (std::exception& e) {
+    ERRORLOG("coroutine exit with std::exception[%s]", e.what());
+  } catch (...) {
+    ERRORLOG("coroutine exit with unknown exception");
+  }
+}
+
+// the interface replies when its last reference goes, i.e. when the handler is done
+inline DetachedTask RunInterface(std::shared_ptr<RpcInterface> interface, Task handler) {
+  try {
+    co_await handler;
+  } catch (RocketException& e) {
+    ERRORLOG("RocketException exception[%s], deal handle", e.what());
+    e.handle();
+    interface->setError(e.errorCode(), e.errorInfo());
+  } catch (std::exception& e) {
+    ERRORLOG("std::exception[%s]", e.what());
+    interface->setError(-1, "unkonwn std::exception");
+  } catch (...) {
+    ERRORLOG("Unkonwn exception");
+    interface->setError(-1, "unkonwn exception");
+  }
+}
+
+// Completion of a number of calls awaited by one coroutine. The count starts at 1 for the
+// awaiter itself, whoever brings it to 0 resumes the coroutine
+struct CallState {
+  std::atomic<int> pending {1};
+  std::coroutine_handle<> handle;
+  EventLoop* loop {NULL};
+
+  void done() {
+    if (pending.fetch_sub(1) == 1) {
+      resume();
+    }
+  }
+
+  // false if every call is already done, the coroutine then goes on without suspending
+  bool suspend(std::coroutine_handle<> h) {
+    handle = h;
+    EventLoop* current = EventLoop::GetCurrentEventLoopOrNull();
+    loop = (current && current->isLooping()) ? current : NULL;
+    return pending.fetch_sub(1) != 1;
+  }
+
+  void resume() {
+    if (loop) {
+      std::coroutine_handle<> h = handle;
+      loop->addTask([h]() {
+        h.resume();
+      }, true);
+    } else {
+      handle.resume();
+    }
+  }
+};
+
+}
+
+
+// start task without awaiting it, it runs until its first suspension before this returns
+inline void CoSpawn(Task task) {
+  detail::RunDetached(std::move(task));
+}
+
+// For RpcInterface::run() of a coroutine handler: { rocket::CoRunInterface(shared_from_this(), corun()); }
+// The reply is sent when the handler co_returns, an exception sets the response error as run() would
+inline void CoRunInterface(std::shared_ptr<RpcInterface> interface, Task handler) {
+  detail::RunInterface(interface, std::move(handler));
+}
+
+
+// Calls started together and awaited once, e.g. a fan out to several services:
+//   RpcCallGroup group;
+//   group.add(channel_a, &A_Stub::foo, ...);
+//   group.add(channel_b, &B_Stub::bar, ...);
+//   co_await group.wait();
+// Each result is in its controller. A group is awaited at most once
+class RpcCallGroup {
+ public:
+  class Awaiter {
+   public:
+    explicit Awaiter(std::shared_ptr<detail::CallState> state) : m_state(state) {}
+
+    bool await_ready() {
+      return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+      return m_state->suspend(handle);
+    }
+
+    void await_resume() {}
+
+   private:
+    std::shared_ptr<detail::CallState> m_state;
+  };
+
+ public:
+  RpcCallGroup() : m_state(std::make_shared<detail::CallState>()) {}
+
+  // start the call on channel, a new channel per call
+  template <class Stub, class Request, class Response>
+  void add(RpcChannel::s_ptr channel,
+      void (Stub::*method)(google::protobuf::RpcController*, const Request*, Response*, google::protobuf::Closure*),
+      RpcChannel::controller_s_ptr controller, std::shared_ptr<Request> request, std::shared_ptr<Response> response) {
+    m_state->pending++;
+    std::shared_ptr<detail::CallState> state = m_state;
+    std::shared_ptr<RpcClosure> closure = std::make_shared<RpcClosure>(nullptr, [state]() {
+      state->done();
+    });
+    channel->Call(method, controller, request, response, closure);
+  }
+
+  Awaiter wait() {
+    return Awaiter(m_state);
+  }
+
+ private:
+  std::shared_ptr<detail::CallState> m_state;
+
+};
+
+
+// co_await of RpcChannel::call(), starts the call when the coroutine suspends
+class RpcCallAwaiter {
+ public:
+  RpcCallAwaiter(RpcChannel::controller_s_ptr controller, std::function<void(RpcChannel::closure_s_ptr)> start)
+    : m_controller(controller), m_start(std::move(start)), m_state(std::make_shared<detail::CallState>()) {}
+
+  bool await_ready() {
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    m_state->pending++;
+    std::shared_ptr<detail::CallState> state = m_state;
+    m_start(std::make_shared<RpcClosure>(nullptr, [state]() {
+      state->done();
+    }));
+    return m_state->suspend(handle);
+  }
+
+  int await_resume() {
+    return dynamic_cast<RpcController*>(m_controller.get())->GetErrorCode();
+  }
+
+ private:
+  RpcChannel::controller_s_ptr m_controller;
+  std::function<void(RpcChannel::closure_s_ptr)> m_start;
+  std::shared_ptr<detail::CallState> m_state;
+
+};
+
+
+template <class Stub, class Request, class Response>
+RpcCallAwaiter RpcChannel::call(void (Stub::*method)(google::protobuf::RpcController*, const Request*, Response*, google::protobuf::Closure*),
+    controller_s_ptr controller, std::shared_ptr<Request> request, std::shared_ptr<Response> response) {
+  s_ptr channel = shared_from_this();
+  return RpcCallAwaiter(controller, [channel, method, controller, request, response](closure_s_ptr done) {
+    channel->Call(method, controller, request, response, done);
+  });
+}
+
+}
+
+#endif
+
+#endif
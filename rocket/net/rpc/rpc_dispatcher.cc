@@ -11,6 +11,8 @@
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/tcp/tcp_connection.h"
 #include "rocket/common/run_time.h"
+#include "rocket/common/config.h"
+#include "rocket/net/eventloop.h"
 
 namespace rocket {
 
@@ -22,6 +24,26 @@ namespace rocket {
 
 static RpcDispatcher* g_rpc_dispatcher = NULL;
 
+
+// the connection belongs to its IO thread, a handler may finish on a worker or any other thread
+static void ReplyTo(std::weak_ptr<TcpConnection> connection, EventLoop* event_loop, AbstractProtocol::s_ptr message) {
+  if (!event_loop->isInLoopThread()) {
+    event_loop->addTask([connection, event_loop, message]() {
+      ReplyTo(connection, event_loop, message);
+    }, true);
+    return;
+  }
+
+  TcpConnection::s_ptr conn = connection.lock();
+  if (conn == nullptr) {
+    ERRORLOG("%s | connection closed before reply", message->m_msg_id.c_str());
+    return;
+  }
+  std::vector<AbstractProtocol::s_ptr> replay_messages;
+  replay_messages.emplace_back(message);
+  conn->reply(replay_messages);
+}
+
 RpcDispatcher* RpcDispatcher::GetRpcDispatcher() {
   if (g_rpc_dispatcher != NULL) {
     return g_rpc_dispatcher;
@@ -36,15 +58,33 @@ void RpcDispatcher::dispatch(AbstractProtocol::s_ptr request, AbstractProtocol::
   std::shared_ptr<TinyPBProtocol> req_protocol = std::dynamic_pointer_cast<TinyPBProtocol>(request);
   std::shared_ptr<TinyPBProtocol> rsp_protocol = std::dynamic_pointer_cast<TinyPBProtocol>(response);
 
+  // every request is answered, the errors below included
+  std::weak_ptr<TcpConnection> weak_connection = connection->shared_from_this();
+  EventLoop* event_loop = connection->getEventLoop();
+
+  if (req_protocol->m_method_name.empty() && req_protocol->m_method_id != 0) {
+    // TinyPB v2 request that names its method by id only
+    req_protocol->m_method_name = getMethodName(req_protocol->m_method_id);
+    if (req_protocol->m_method_name.empty()) {
+      ERRORLOG("%s | method id[%u] not found", req_protocol->m_msg_id.c_str(), req_protocol->m_method_id);
+      rsp_protocol->m_msg_id = req_protocol->m_msg_id;
+      setTinyPBError(rsp_protocol, ERROR_SERVICE_NOT_FOUND, "method id not found");
+      ReplyTo(weak_connection, event_loop, rsp_protocol);
+      return;
+    }
+  }
+
   std::string method_full_name = req_protocol->m_method_name;
   std::string service_name;
   std::string method_name;
 
   rsp_protocol->m_msg_id = req_protocol->m_msg_id;
   rsp_protocol->m_method_name = req_protocol->m_method_name;
+  rsp_protocol->m_method_id = getMethodId(method_full_name);
 
   if (!parseServiceFullName(method_full_name, service_name, method_name)) {
     setTinyPBError(rsp_protocol, ERROR_PARSE_SERVICE_NAME, "parse service name error");
+    ReplyTo(weak_connection, event_loop, rsp_protocol);
     return;
   }
 
@@ -52,6 +92,7 @@ void RpcDispatcher::dispatch(AbstractProtocol::s_ptr request, AbstractProtocol::
   if (it == m_service_map.end()) {
     ERRORLOG("%s | sericve neame[%s] not found", req_protocol->m_msg_id.c_str(), service_name.c_str());
     setTinyPBError(rsp_protocol, ERROR_SERVICE_NOT_FOUND, "service not found");
+    ReplyTo(weak_connection, event_loop, rsp_protocol);
     return;
   }
 
@@ -61,16 +102,54 @@ void RpcDispatcher::dispatch(AbstractProtocol::s_ptr request, AbstractProtocol::
   if (method == NULL) {
     ERRORLOG("%s | method neame[%s] not found in service[%s]", req_protocol->m_msg_id.c_str(), method_name.c_str(), service_name.c_str());
     setTinyPBError(rsp_protocol, ERROR_SERVICE_NOT_FOUND, "method not found");
+    ReplyTo(weak_connection, event_loop, rsp_protocol);
     return;
   }
 
+  RpcController* rpc_controller = new RpcController();
+  rpc_controller->SetLocalAddr(connection->getLocalAddr());
+  rpc_controller->SetPeerAddr(connection->getPeerAddr());
+  rpc_controller->SetMsgId(req_protocol->m_msg_id);
+
+  uint32_t index = rsp_protocol->m_method_id - 1;
+  if (m_worker_pool == NULL || m_inline_methods[index]) {
+    callMethod(service, method, req_protocol, rsp_protocol, rpc_controller, weak_connection, event_loop);
+    return;
+  }
+
+  std::shared_ptr<ServiceQueue> queue = m_method_queues[index];
+  // several IO threads dispatch to the same queue, the slot is taken before the limit is checked
+  int waiting = queue->size.fetch_add(1);
+  if (queue->max_size > 0 && waiting >= queue->max_size) {
+    queue->size--;
+    // answered at once, the caller can back off instead of waiting for its timeout
+    ERRORLOG("%s | service[%s] busy, %d requests wait for a worker", req_protocol->m_msg_id.c_str(), service_name.c_str(), waiting);
+    setTinyPBError(rsp_protocol, ERROR_SERVICE_BUSY, "service busy");
+    DELETE_RESOURCE(rpc_controller);
+    ReplyTo(weak_connection, event_loop, rsp_protocol);
+    return;
+  }
+
+  m_worker_pool->submit([this, service, method, req_protocol, rsp_protocol, rpc_controller, weak_connection, event_loop, queue]() {
+    queue->size--;
+    callMethod(service, method, req_protocol, rsp_protocol, rpc_controller, weak_connection, event_loop);
+  });
+}
+
+
+void RpcDispatcher::callMethod(service_s_ptr service, const google::protobuf::MethodDescriptor* method,
+    std::shared_ptr<TinyPBProtocol> req_protocol, std::shared_ptr<TinyPBProtocol> rsp_protocol,
+    RpcController* rpc_controller, std::weak_ptr<TcpConnection> connection, EventLoop* event_loop) {
+
   google::protobuf::Message* req_msg = service->GetRequestPrototype(method).New();
 
   // 反序列化，将 pb_data 反序列化为 req_msg
   if (!req_msg->ParseFromString(req_protocol->m_pb_data)) {
-    ERRORLOG("%s | deserilize error", req_protocol->m_msg_id.c_str(), method_name.c_str(), service_name.c_str());
+    ERRORLOG("%s | deserilize error", req_protocol->m_msg_id.c_str());
     setTinyPBError(rsp_protocol, ERROR_FAILED_DESERIALIZE, "deserilize error");
     DELETE_RESOURCE(req_msg);
+    DELETE_RESOURCE(rpc_controller);
+    ReplyTo(connection, event_loop, rsp_protocol);
     return;
   }
 
@@ -78,15 +157,10 @@ void RpcDispatcher::dispatch(AbstractProtocol::s_ptr request, AbstractProtocol::
 
   google::protobuf::Message* rsp_msg = service->GetResponsePrototype(method).New();
 
-  RpcController* rpc_controller = new RpcController();
-  rpc_controller->SetLocalAddr(connection->getLocalAddr());
-  rpc_controller->SetPeerAddr(connection->getPeerAddr());
-  rpc_controller->SetMsgId(req_protocol->m_msg_id);
-
   RunTime::GetRunTime()->m_msgid = req_protocol->m_msg_id;
-  RunTime::GetRunTime()->m_method_name = method_name;
+  RunTime::GetRunTime()->m_method_name = method->name();
 
-  RpcClosure* closure = new RpcClosure(nullptr, [req_msg, rsp_msg, req_protocol, rsp_protocol, connection, rpc_controller, this]() mutable {
+  RpcClosure* closure = new RpcClosure(nullptr, [req_msg, rsp_msg, req_protocol, rsp_protocol, connection, event_loop, rpc_controller, this]() mutable {
     if (!rsp_msg->SerializeToString(&(rsp_protocol->m_pb_data))) {
       ERRORLOG("%s | serilize error, origin message [%s]", req_protocol->m_msg_id.c_str(), rsp_msg->ShortDebugString().c_str());
       setTinyPBError(rsp_protocol, ERROR_FAILED_SERIALIZE, "serilize error");
@@ -96,14 +170,11 @@ void RpcDispatcher::dispatch(AbstractProtocol::s_ptr request, AbstractProtocol::
       INFOLOG("%s | dispatch success, requesut[%s], response[%s]", req_protocol->m_msg_id.c_str(), req_msg->ShortDebugString().c_str(), rsp_msg->ShortDebugString().c_str());
     }
 
-    std::vector<AbstractProtocol::s_ptr> replay_messages;
-    replay_messages.emplace_back(rsp_protocol);
-    connection->reply(replay_messages);
-
+    ReplyTo(connection, event_loop, rsp_protocol);
   });
 
   service->CallMethod(method, rpc_controller, req_msg, rsp_msg, closure);
-  
+
 }
 
 
@@ -131,6 +202,65 @@ void RpcDispatcher::registerService(service_s_ptr service) {
   std::string service_name = service->GetDescriptor()->full_name();
   m_service_map[service_name] = service;
 
+  Config* config = Config::GetGlobalConfig();
+  std::shared_ptr<ServiceQueue> queue = std::make_shared<ServiceQueue>();
+  queue->max_size = config->m_worker_max_queue;
+  auto limit = config->m_worker_service_max_queue.find(service_name);
+  if (limit != config->m_worker_service_max_queue.end()) {
+    queue->max_size = limit->second;
+  }
+
+  const google::protobuf::ServiceDescriptor* descriptor = service->GetDescriptor();
+  for (int i = 0; i < descriptor->method_count(); ++i) {
+    std::string full_name = service_name + "." + descriptor->method(i)->name();
+    if (m_method_ids.find(full_name) == m_method_ids.end()) {
+      m_method_names.push_back(full_name);
+      m_method_ids[full_name] = m_method_names.size();
+      m_method_queues.push_back(queue);
+      m_inline_methods.push_back(config->m_worker_inline_methods.count(full_name) > 0);
+    }
+  }
+
+}
+
+uint32_t RpcDispatcher::getMethodId(const std::string& full_name) {
+  auto it = m_method_ids.find(full_name);
+  if (it == m_method_ids.end()) {
+    return 0;
+  }
+  return it->second;
+}
+
+std::string RpcDispatcher::getMethodName(uint32_t method_id) {
+  if (method_id == 0 || method_id > m_method_names.size()) {
+    return "";
+  }
+  return m_method_names[method_id - 1];
+}
+
+void RpcDispatcher::initWorkerPool() {
+  int threads = Config::GetGlobalConfig()->m_worker_threads;
+  if (m_worker_pool != NULL || threads <= 0) {
+    return;
+  }
+  m_worker_pool = new WorkerPool(threads);
+  m_worker_pool->start();
+  if (Config::GetGlobalConfig()->m_client_io_threads <= 0) {
+    INFOLOG("client io_threads is 0, handlers on worker threads can not call other services");
+  }
+}
+
+WorkerPool* RpcDispatcher::getWorkerPool() {
+  return m_worker_pool;
+}
+
+void RpcDispatcher::setInlineMethod(const std::string& full_name) {
+  uint32_t method_id = getMethodId(full_name);
+  if (method_id == 0) {
+    ERRORLOG("set inline method error, method [%s] not registered", full_name.c_str());
+    return;
+  }
+  m_inline_methods[method_id - 1] = true;
 }
 
 void RpcDispatcher::setTinyPBError(std::shared_ptr<TinyPBProtocol> msg, int32_t err_code, const std::string err_info) {
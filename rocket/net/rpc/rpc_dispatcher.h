@@ -2,15 +2,20 @@
 #define ROCKET_NET_RPC_RPC_DISPATCHER_H
 
 #include <map>
+#include <vector>
 #include <memory>
+#include <atomic>
 #include <google/protobuf/service.h>
 
 #include "rocket/net/coder/abstract_protocol.h"
 #include "rocket/net/coder/tinypb_protocol.h"
+#include "rocket/net/worker_pool.h"
 
 namespace rocket {
 
 class TcpConnection;
+class RpcController;
+class EventLoop;
 
 class RpcDispatcher {
 
@@ -28,11 +33,47 @@ class RpcDispatcher {
 
   void setTinyPBError(std::shared_ptr<TinyPBProtocol> msg, int32_t err_code, const std::string err_info);
 
+  // ids of "Service.method" full names, assigned from 1 in registration order, 0 if unknown
+  uint32_t getMethodId(const std::string& full_name);
+
+  // empty if the id is unknown
+  std::string getMethodName(uint32_t method_id);
+
+  // Start the <worker><threads> workers that run the handlers, TcpServer calls it.
+  // Without workers every request is handled on its connection's IO thread
+  void initWorkerPool();
+
+  // NULL without workers
+  WorkerPool* getWorkerPool();
+
+  // handle full_name ("Service.method") on the IO thread even with workers, for cheap methods
+  void setInlineMethod(const std::string& full_name);
+
  private:
+  // requests of one service waiting for a worker
+  struct ServiceQueue {
+    int max_size {0};     // 0 means no limit
+    std::atomic<int> size {0};
+  };
+
   bool parseServiceFullName(const std::string& full_name, std::string& service_name, std::string& method_name);
 
+  // deserialize the request and call the method, the reply is sent on event_loop
+  void callMethod(service_s_ptr service, const google::protobuf::MethodDescriptor* method,
+    std::shared_ptr<TinyPBProtocol> req_protocol, std::shared_ptr<TinyPBProtocol> rsp_protocol,
+    RpcController* rpc_controller, std::weak_ptr<TcpConnection> connection, EventLoop* event_loop);
+
  private:
   std::map<std::string, service_s_ptr> m_service_map;
+
+  std::map<std::string, uint32_t> m_method_ids;
+  std::vector<std::string> m_method_names;   // m_method_names[id - 1]
+
+  // by method id - 1 like m_method_names
+  std::vector<std::shared_ptr<ServiceQueue>> m_method_queues;
+  std::vector<char> m_inline_methods;
+
+  WorkerPool* m_worker_pool {NULL};
 };
 
 
@@ -0,0 +1,54 @@
+#include "rocket/net/tcp/buffer_block.h"
+
+namespace rocket {
+
+struct BufferBlockPool {
+  BufferBlock* m_free_head {NULL};
+  int m_free_count {0};
+
+  ~BufferBlockPool() {
+    while (m_free_head) {
+      BufferBlock* next = m_free_head->m_next_free;
+      delete m_free_head;
+      m_free_head = next;
+    }
+  }
+
+  BufferBlock* alloc() {
+    BufferBlock* block = m_free_head;
+    if (block) {
+      m_free_head = block->m_next_free;
+      m_free_count--;
+      block->m_next_free = NULL;
+    } else {
+      block = new BufferBlock();
+    }
+    block->m_ref = 1;
+    return block;
+  }
+
+  void release(BufferBlock* block) {
+    if (m_free_count >= BufferBlock::kMaxPooledBlocks) {
+      delete block;
+      return;
+    }
+    block->m_next_free = m_free_head;
+    m_free_head = block;
+    m_free_count++;
+  }
+};
+
+static thread_local BufferBlockPool t_block_pool;
+
+
+BufferBlock* BufferBlock::Alloc() {
+  return t_block_pool.alloc();
+}
+
+void BufferBlock::unref() {
+  if (--m_ref == 0) {
+    t_block_pool.release(this);
+  }
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef ROCKET_NET_TCP_BUFFER_BLOCK_H
+#define ROCKET_NET_TCP_BUFFER_BLOCK_H
+
+#include <stddef.h>
+
+namespace rocket {
+
+/*
+ * Fixed size, reference counted memory block for connection buffers.
+ *
+ * Freed blocks go back to a free list of the releasing thread and are reused
+ * by the next Alloc() there, so a busy IO thread stops calling malloc for its
+ * buffers. A block is only shared by buffers of one connection, which are used
+ * by one thread at a time, so the count is not atomic.
+ */
+class BufferBlock {
+ public:
+  static const size_t kBlockSize = 16 * 1024;
+
+  // blocks kept in each thread's free list, the rest go back to the heap
+  static const int kMaxPooledBlocks = 64;
+
+  // new block with one reference
+  static BufferBlock* Alloc();
+
+  void ref() {
+    m_ref++;
+  }
+
+  void unref();
+
+  int refCount() const {
+    return m_ref;
+  }
+
+  char* data() {
+    return m_data;
+  }
+
+ private:
+  BufferBlock() {}
+
+  ~BufferBlock() {}
+
+  friend struct BufferBlockPool;
+
+ private:
+  int m_ref {0};
+  BufferBlock* m_next_free {NULL};
+  char m_data[kBlockSize];
+
+};
+
+}
+
+#endif
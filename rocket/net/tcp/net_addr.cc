@@ -89,4 +89,8 @@ bool IPNetAddr::checkValid() {
   return true;
 }
 
+bool IPNetAddr::isLoopback() {
+  return (ntohl(m_addr.sin_addr.s_addr) >> 24) == 127;
+}
+
 }
\ No newline at end of file
@@ -22,6 +22,8 @@ class NetAddr {
 
   virtual bool checkValid() = 0;
 
+  virtual bool isLoopback() = 0;
+
 };
 
 
@@ -47,6 +49,9 @@ class IPNetAddr : public NetAddr {
   std::string toString();
 
   bool checkValid();
+
+  // 127.0.0.0/8
+  bool isLoopback();
  
  private:
   std::string m_ip;
@@ -0,0 +1,127 @@
+#include <limits.h>
+#include <algorithm>
+#include <string.h>
+#include "rocket/net/tcp/output_chain.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace rocket {
+
+OutputChain::OutputChain() {
+}
+
+OutputChain::~OutputChain() {
+  while (!m_segments.empty()) {
+    popFront();
+  }
+  if (m_tail_block) {
+    m_tail_block->unref();
+    m_tail_block = NULL;
+  }
+}
+
+
+void OutputChain::append(const char* buf, size_t len) {
+  while (len > 0) {
+    if (m_tail_block == NULL || m_tail_used == BufferBlock::kBlockSize) {
+      if (m_tail_block) {
+        m_tail_block->unref();
+      }
+      m_tail_block = BufferBlock::Alloc();
+      m_tail_used = 0;
+    }
+
+    size_t count = std::min(len, BufferBlock::kBlockSize - m_tail_used);
+    char* dst = m_tail_block->data() + m_tail_used;
+    memcpy(dst, buf, count);
+
+    // extend the last segment if it ends right here
+    if (!m_segments.empty() && m_segments.back().m_block == m_tail_block
+        && m_segments.back().m_data + m_segments.back().m_len == dst) {
+      m_segments.back().m_len += count;
+    } else {
+      Segment segment;
+      segment.m_data = dst;
+      segment.m_len = count;
+      segment.m_block = m_tail_block;
+      m_tail_block->ref();
+      m_segments.push_back(segment);
+    }
+
+    m_tail_used += count;
+    m_size += count;
+    buf += count;
+    len -= count;
+  }
+}
+
+
+void OutputChain::appendRef(const char* buf, size_t len, std::shared_ptr<void> holder) {
+  if (len == 0) {
+    return;
+  }
+  Segment segment;
+  segment.m_data = buf;
+  segment.m_len = len;
+  segment.m_holder = holder;
+  m_segments.push_back(segment);
+  m_size += len;
+}
+
+
+int OutputChain::peekIov(struct iovec* iov, int max_count) const {
+  int count = 0;
+  for (auto it = m_segments.begin(); it != m_segments.end() && count < max_count; ++it) {
+    iov[count].iov_base = const_cast<char*>(it->m_data);
+    iov[count].iov_len = it->m_len;
+    count++;
+  }
+  return count;
+}
+
+
+void OutputChain::popFront() {
+  Segment& segment = m_segments.front();
+  m_size -= segment.m_len;
+  if (segment.m_block) {
+    segment.m_block->unref();
+  }
+  m_segments.pop_front();
+}
+
+void OutputChain::consume(size_t size) {
+  while (size > 0 && !m_segments.empty()) {
+    Segment& segment = m_segments.front();
+    if (size < segment.m_len) {
+      segment.m_data += size;
+      segment.m_len -= size;
+      m_size -= size;
+      return;
+    }
+    size -= segment.m_len;
+    popFront();
+  }
+
+  // nothing else uses the tail block, start writing it from the beginning again
+  if (m_segments.empty() && m_tail_block && m_tail_block->refCount() == 1) {
+    m_tail_used = 0;
+  }
+}
+
+
+ssize_t OutputChain::writeTo(int fd) {
+  struct iovec iov[IOV_MAX];
+  int count = peekIov(iov, IOV_MAX);
+  if (count == 0) {
+    return 0;
+  }
+  ssize_t rt = writev(fd, iov, count);
+  if (rt > 0) {
+    consume(rt);
+  }
+  return rt;
+}
+
+}
@@ -0,0 +1,72 @@
+#ifndef ROCKET_NET_TCP_OUTPUT_CHAIN_H
+#define ROCKET_NET_TCP_OUTPUT_CHAIN_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <deque>
+#include <memory>
+#include "rocket/net/tcp/buffer_block.h"
+
+namespace rocket {
+
+/*
+ * Outbound byte stream of a TcpConnection, flushed with writev.
+ *
+ * Small pieces (frame headers, short payloads) are copied into pooled
+ * BufferBlocks, consecutive copies share one segment. Large payloads are only
+ * referenced, the holder keeps them alive until they have been written, so
+ * they are never copied in user space.
+ */
+class OutputChain {
+ public:
+  typedef std::shared_ptr<OutputChain> s_ptr;
+
+  OutputChain();
+
+  ~OutputChain();
+
+  // copy bytes to the end of the chain
+  void append(const char* buf, size_t len);
+
+  // reference bytes owned by holder, they must not change until written
+  void appendRef(const char* buf, size_t len, std::shared_ptr<void> holder);
+
+  size_t readAble() const {
+    return m_size;
+  }
+
+  size_t segmentCount() const {
+    return m_segments.size();
+  }
+
+  // fill iov with at most max_count segments from the front, return count of segments
+  int peekIov(struct iovec* iov, int max_count) const;
+
+  // drop size bytes from the front
+  void consume(size_t size);
+
+  // one writev of up to IOV_MAX segments, return value and errno as writev
+  ssize_t writeTo(int fd);
+
+ private:
+  struct Segment {
+    const char* m_data {NULL};
+    size_t m_len {0};
+    BufferBlock* m_block {NULL};        // copied bytes, NULL for referenced ones
+    std::shared_ptr<void> m_holder;     // referenced bytes
+  };
+
+  void popFront();
+
+ private:
+  std::deque<Segment> m_segments;
+  size_t m_size {0};
+
+  BufferBlock* m_tail_block {NULL};     // block being appended into
+  size_t m_tail_used {0};
+
+};
+
+}
+
+#endif
@@ -1,7 +1,9 @@
 #include <assert.h>
+#include <errno.h>
 #include <sys/socket.h>
 #include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 #include "rocket/common/log.h"
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/tcp/tcp_acceptor.h"
@@ -9,7 +11,7 @@
 
 namespace rocket {
 
-TcpAcceptor::TcpAcceptor(NetAddr::s_ptr local_addr) : m_local_addr(local_addr) {
+TcpAcceptor::TcpAcceptor(NetAddr::s_ptr local_addr, bool reuse_port /*= false*/) : m_local_addr(local_addr) {
   if (!local_addr->checkValid()) {
     ERRORLOG("invalid local addr %s", local_addr->toString().c_str());
     exit(0);
@@ -17,7 +19,7 @@ TcpAcceptor::TcpAcceptor(NetAddr::s_ptr local_addr) : m_local_addr(local_addr) {
 
   m_family = m_local_addr->getFamily();
   
-  m_listenfd = socket(m_family, SOCK_STREAM, 0);
+  m_listenfd = socket(m_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
   if (m_listenfd < 0) {
     ERRORLOG("invalid listenfd %d", m_listenfd);
@@ -29,6 +31,11 @@ TcpAcceptor::TcpAcceptor(NetAddr::s_ptr local_addr) : m_local_addr(local_addr) {
     ERRORLOG("setsockopt REUSEADDR error, errno=%d, error=%s", errno, strerror(errno));
   }
 
+  if (reuse_port && setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val)) != 0) {
+    ERRORLOG("setsockopt REUSEPORT error, errno=%d, error=%s", errno, strerror(errno));
+    exit(0);
+  }
+
   socklen_t len = m_local_addr->getSockLen();
   if(bind(m_listenfd, m_local_addr->getSockAddr(), len) != 0) {
     ERRORLOG("bind error, errno=%d, error=%s", errno, strerror(errno));
@@ -39,9 +46,17 @@ TcpAcceptor::TcpAcceptor(NetAddr::s_ptr local_addr) : m_local_addr(local_addr) {
     ERRORLOG("listen error, errno=%d, error=%s", errno, strerror(errno));
     exit(0);
   }
+
+  m_idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  if (m_idle_fd < 0) {
+    ERRORLOG("open spare fd error, errno=%d, error=%s", errno, strerror(errno));
+  }
 }
 
 TcpAcceptor::~TcpAcceptor() {
+  if (m_idle_fd >= 0) {
+    close(m_idle_fd);
+  }
 }
 
 
@@ -54,11 +69,25 @@ std::pair<int, NetAddr::s_ptr> TcpAcceptor::accept() {
   if (m_family == AF_INET) {
     sockaddr_in client_addr;
     memset(&client_addr, 0, sizeof(client_addr));
-    socklen_t clien_addr_len = sizeof(clien_addr_len);
+    socklen_t clien_addr_len = sizeof(client_addr);
 
-    int client_fd = ::accept(m_listenfd, reinterpret_cast<sockaddr*>(&client_addr), &clien_addr_len);
+    int client_fd = ::accept4(m_listenfd, reinterpret_cast<sockaddr*>(&client_addr), &clien_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (client_fd < 0) {
-      ERRORLOG("accept error, errno=%d, error=%s", errno, strerror(errno));
+      if (errno == EMFILE || errno == ENFILE) {
+        if (!m_out_of_fds) {
+          m_out_of_fds = true;
+          ERRORLOG("accept error, errno=%d, error=%s, new connections are closed until fds are free", errno, strerror(errno));
+        }
+        closePending();
+      } else if (errno != EAGAIN && errno != EINTR) {
+        ERRORLOG("accept error, errno=%d, error=%s", errno, strerror(errno));
+      }
+      return std::make_pair(-1, nullptr);
+    }
+    if (m_out_of_fds) {
+      m_out_of_fds = false;
+      ERRORLOG("accept works again, %llu connections were closed for lack of fds", (unsigned long long)m_closed_count);
+      m_closed_count = 0;
     }
     IPNetAddr::s_ptr peer_addr = std::make_shared<IPNetAddr>(client_addr);
     INFOLOG("A client have accpeted succ, peer addr [%s]", peer_addr->toString().c_str());
@@ -71,4 +100,17 @@ std::pair<int, NetAddr::s_ptr> TcpAcceptor::accept() {
 
 }
 
+void TcpAcceptor::closePending() {
+  // the spare fd is gone if reopening it failed last time
+  if (m_idle_fd >= 0) {
+    close(m_idle_fd);
+  }
+  int fd = ::accept4(m_listenfd, NULL, NULL, SOCK_CLOEXEC);
+  if (fd >= 0) {
+    close(fd);
+    m_closed_count++;
+  }
+  m_idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
 }
\ No newline at end of file
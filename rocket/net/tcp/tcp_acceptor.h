@@ -10,14 +10,22 @@ class TcpAcceptor {
  public:
   typedef std::shared_ptr<TcpAcceptor> s_ptr;
 
-  TcpAcceptor(NetAddr::s_ptr local_addr);
+  // reuse_port sets SO_REUSEPORT, so several acceptors can listen on the same address
+  TcpAcceptor(NetAddr::s_ptr local_addr, bool reuse_port = false);
 
   ~TcpAcceptor();
 
+  // the listen socket is non-blocking, fd is -1 once the backlog is empty.
+  // Accepted fds are non-blocking and close-on-exec
   std::pair<int, NetAddr::s_ptr> accept();
 
   int getListenFd();
 
+ private:
+  // out of fds (EMFILE/ENFILE): the spare fd makes room to accept the connection at the head
+  // of the backlog and close it, otherwise the level-triggered listen fd fires again at once
+  void closePending();
+
  private:
   NetAddr::s_ptr m_local_addr; 
 
@@ -25,6 +33,11 @@ class TcpAcceptor {
 
   int m_listenfd {-1}; 
 
+  int m_idle_fd {-1};     // /dev/null, only closed to make room in closePending()
+
+  bool m_out_of_fds {false};      // logged once until accept works again
+  uint64_t m_closed_count {0};    // connections closed by closePending() meanwhile
+
 };
 
 }
@@ -1,44 +1,87 @@
+#include <sys/uio.h>
+#include <errno.h>
+#include <algorithm>
 #include <memory>
 #include <string.h>
 #include "rocket/common/log.h"
+#include "rocket/common/util.h"
 #include "rocket/net/tcp/tcp_buffer.h"
 
 namespace rocket {
 
+const int TcpBuffer::kSpillSize;
 
+static const int g_block_size = (int)BufferBlock::kBlockSize;
 
-TcpBuffer::TcpBuffer(int size) : m_size(size) {
-  m_buffer.resize(size);
+
+// one readv() drains up to a block plus this much, whatever the buffer holds
+static thread_local char t_spill_buffer[TcpBuffer::kSpillSize];
+
+
+TcpBuffer::TcpBuffer(int size, int max_size) : m_size(size), m_max_size(max_size) {
+  if (size > 0) {
+    m_reserved_count = (size + g_block_size - 1) / g_block_size;
+  }
+  for (int i = 0; i < m_reserved_count; ++i) {
+    m_reserved_blocks.push_back(BufferBlock::Alloc());
+  }
 }
 
 TcpBuffer::~TcpBuffer() {
-
+  releaseAll();
+  for (size_t i = 0; i < m_reserved_blocks.size(); ++i) {
+    m_reserved_blocks[i]->unref();
+  }
+  m_reserved_blocks.clear();
 }
 
 int TcpBuffer::readAble() {
-  return m_write_index - m_read_index;
+  return m_readable;
 }
 
 int TcpBuffer::writeAble() {
-  return m_buffer.size() - m_write_index;
+  if (m_blocks.empty()) {
+    return 0;
+  }
+  return g_block_size - m_write_pos;
 }
 
-int TcpBuffer::readIndex() {
-  return m_read_index;
+void TcpBuffer::appendBlock() {
+  if (!m_reserved_blocks.empty()) {
+    m_blocks.push_back(m_reserved_blocks.back());
+    m_reserved_blocks.pop_back();
+  } else {
+    m_blocks.push_back(BufferBlock::Alloc());
+  }
+  m_write_pos = 0;
 }
 
-int TcpBuffer::writeIndex() {
-  return m_write_index;
+void TcpBuffer::releaseAll() {
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    if ((int)m_reserved_blocks.size() < m_reserved_count) {
+      m_reserved_blocks.push_back(m_blocks[i]);
+    } else {
+      m_blocks[i]->unref();
+    }
+  }
+  m_blocks.clear();
+  m_read_pos = 0;
+  m_write_pos = 0;
+  m_readable = 0;
 }
 
 void TcpBuffer::writeToBuffer(const char* buf, int size) {
-  if (size > writeAble()) {
-    // 调整 buffer 的大小，扩容
-    int new_size = (int)(1.5 * (m_write_index + size));
-    resizeBuffer(new_size);
+  while (size > 0) {
+    if (m_blocks.empty() || m_write_pos == g_block_size) {
+      appendBlock();
+    }
+    int n = std::min(size, g_block_size - m_write_pos);
+    memcpy(m_blocks.back()->data() + m_write_pos, buf, n);
+    m_write_pos += n;
+    m_readable += n;
+    buf += n;
+    size -= n;
   }
-  memcpy(&m_buffer[m_write_index], buf, size);
-  m_write_index += size; 
 }
 
 
@@ -50,62 +93,172 @@ void TcpBuffer::readFromBuffer(std::vector<char>& re, int size) {
   int read_size = readAble() > size ? size : readAble();
 
   std::vector<char> tmp(read_size);
-  memcpy(&tmp[0], &m_buffer[m_read_index], read_size);
+  peek(0, &tmp[0], read_size);
 
-  re.swap(tmp); 
-  m_read_index += read_size;
+  re.swap(tmp);
+  moveReadIndex(read_size);
+}
+
+
+void TcpBuffer::moveReadIndex(int size) {
+  if (size < 0 || size > m_readable) {
+    ERRORLOG("moveReadIndex error, invalid size %d, readable %d", size, m_readable);
+    return;
+  }
+  m_readable -= size;
+  if (m_readable == 0) {
+    releaseAll();
+    return;
+  }
 
-  adjustBuffer();
+  while (size > 0) {
+    int end = m_blocks.size() == 1 ? m_write_pos : g_block_size;
+    int avail = end - m_read_pos;
+    if (size < avail) {
+      m_read_pos += size;
+      break;
+    }
+    if ((int)m_reserved_blocks.size() < m_reserved_count) {
+      m_reserved_blocks.push_back(m_blocks.front());
+    } else {
+      m_blocks.front()->unref();
+    }
+    m_blocks.pop_front();
+    m_read_pos = 0;
+    size -= avail;
+  }
 }
 
 
-void TcpBuffer::resizeBuffer(int new_size) {
-  std::vector<char> tmp(new_size);
-  int count = std::min(new_size, readAble());
-  
-  memcpy(&tmp[0], &m_buffer[m_read_index], count);
-  m_buffer.swap(tmp);
+ssize_t TcpBuffer::readFromFd(int fd, int& read_count) {
+  int limit = m_max_size > 0 ? m_max_size - m_readable : kSpillSize + g_block_size;
+  if (limit <= 0) {
+    read_count = 0;
+    errno = ENOBUFS;
+    return -1;
+  }
+  if (m_blocks.empty() || m_write_pos == g_block_size) {
+    appendBlock();
+  }
+
+  // bytes beyond the tail block land in the spill buffer and are copied into new blocks,
+  // so a large message is read with one syscall instead of one per block
+  iovec iov[2];
+  iov[0].iov_base = m_blocks.back()->data() + m_write_pos;
+  iov[0].iov_len = std::min(g_block_size - m_write_pos, limit);
+  iov[1].iov_base = t_spill_buffer;
+  iov[1].iov_len = std::min(kSpillSize, limit - (int)iov[0].iov_len);
+  int iov_count = iov[1].iov_len > 0 ? 2 : 1;
+  read_count = (int)(iov[0].iov_len + iov[1].iov_len);
 
-  m_read_index = 0;
-  m_write_index = m_read_index + count;
+  ssize_t rt = readv(fd, iov, iov_count);
+  if (rt <= 0) {
+    if (m_readable == 0) {
+      releaseAll();
+    }
+    return rt;
+  }
 
+  int first = std::min((int)rt, (int)iov[0].iov_len);
+  m_write_pos += first;
+  m_readable += first;
+  if (rt > first) {
+    writeToBuffer(t_spill_buffer, (int)rt - first);
+  }
+  return rt;
 }
 
 
-void TcpBuffer::adjustBuffer() {
-  if (m_read_index < int(m_buffer.size() / 3)) {
-    return;
+char TcpBuffer::peekChar(int offset) {
+  int pos = m_read_pos + offset;
+  return m_blocks[pos / g_block_size]->data()[pos % g_block_size];
+}
+
+bool TcpBuffer::peek(int offset, char* out, int len) {
+  if (offset < 0 || len < 0 || offset + len > m_readable) {
+    return false;
+  }
+  int pos = m_read_pos + offset;
+  size_t index = pos / g_block_size;
+  int in_block = pos % g_block_size;
+  while (len > 0) {
+    int n = std::min(len, g_block_size - in_block);
+    memcpy(out, m_blocks[index]->data() + in_block, n);
+    out += n;
+    len -= n;
+    index++;
+    in_block = 0;
   }
-  std::vector<char> buffer(m_buffer.size());
-  int count = readAble();
+  return true;
+}
 
-  memcpy(&buffer[0], &m_buffer[m_read_index], count);
-  m_buffer.swap(buffer);
-  m_read_index = 0;
-  m_write_index = m_read_index + count;
+bool TcpBuffer::peekString(int offset, int len, std::string& out) {
+  if (offset < 0 || len < 0 || offset + len > m_readable) {
+    return false;
+  }
+  out.clear();
+  out.reserve(len);
+  int pos = m_read_pos + offset;
+  size_t index = pos / g_block_size;
+  int in_block = pos % g_block_size;
+  while (len > 0) {
+    int n = std::min(len, g_block_size - in_block);
+    out.append(m_blocks[index]->data() + in_block, n);
+    len -= n;
+    index++;
+    in_block = 0;
+  }
+  return true;
+}
 
-  buffer.clear();
+bool TcpBuffer::peekInt32(int offset, int32_t& value) {
+  char buf[sizeof(int32_t)];
+  if (!peek(offset, buf, sizeof(buf))) {
+    return false;
+  }
+  value = getInt32FromNetByte(buf);
+  return true;
 }
 
-void TcpBuffer::moveReadIndex(int size) {
-  size_t j = m_read_index + size;
-  if (j >= m_buffer.size()) {
-    ERRORLOG("moveReadIndex error, invalid size %d, old_read_index %d, buffer size %d", size, m_read_index, m_buffer.size());
-    return;
+int TcpBuffer::find(char c, int offset) {
+  if (offset < 0 || offset >= m_readable) {
+    return -1;
   }
-  m_read_index = j;
-  adjustBuffer();
+  int pos = m_read_pos + offset;
+  size_t index = pos / g_block_size;
+  int in_block = pos % g_block_size;
+  for (; index < m_blocks.size(); ++index, in_block = 0) {
+    int end = index + 1 == m_blocks.size() ? m_write_pos : g_block_size;
+    const char* begin = m_blocks[index]->data();
+    const void* p = memchr(begin + in_block, c, end - in_block);
+    if (p) {
+      return (int)(index * g_block_size + ((const char*)p - begin)) - m_read_pos;
+    }
+  }
+  return -1;
 }
 
-void TcpBuffer::moveWriteIndex(int size) {
-  size_t j = m_write_index + size;
-  if (j >= m_buffer.size()) {
-    ERRORLOG("moveWriteIndex error, invalid size %d, old_read_index %d, buffer size %d", size, m_read_index, m_buffer.size());
-    return;
+const char* TcpBuffer::contiguousData(int& len) {
+  if (m_blocks.empty()) {
+    len = 0;
+    return NULL;
   }
-  m_write_index = j;
-  adjustBuffer();
+  int end = m_blocks.size() == 1 ? m_write_pos : g_block_size;
+  len = end - m_read_pos;
+  return m_blocks.front()->data() + m_read_pos;
+}
 
+const char* TcpBuffer::segmentAt(int offset, int& len) {
+  if (offset < 0 || offset >= m_readable) {
+    len = 0;
+    return NULL;
+  }
+  int pos = m_read_pos + offset;
+  size_t index = pos / g_block_size;
+  int in_block = pos % g_block_size;
+  int end = index + 1 == m_blocks.size() ? m_write_pos : g_block_size;
+  len = end - in_block;
+  return m_blocks[index]->data() + in_block;
 }
 
-}
\ No newline at end of file
+}
@@ -1,50 +1,101 @@
 #ifndef ROCKET_NET_TCP_TCP_BUFFER_H
 #define ROCKET_NET_TCP_TCP_BUFFER_H
 
+#include <sys/types.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
 #include <vector>
 #include <memory>
+#include "rocket/net/tcp/buffer_block.h"
 
 namespace rocket {
 
+/*
+ * Byte buffer made of a chain of pooled BufferBlocks.
+ *
+ * Data is appended at the write cursor in the last block and consumed from the
+ * read cursor in the first block. A block is given back as soon as all of its
+ * bytes are read, so the buffer never moves unread bytes around to make room.
+ * Readers use offsets relative to the read cursor; a range may span blocks.
+ */
 class TcpBuffer {
 
  public:
 
   typedef std::shared_ptr<TcpBuffer> s_ptr;
 
-  TcpBuffer(int size);
+  // thread local buffer behind the block tail in readFromFd()
+  static const int kSpillSize = 64 * 1024;
+
+  // size bytes of blocks are kept by the buffer even when it is empty, the rest
+  // come from the pool on demand. max_size caps readFromFd(), 0 means no limit
+  TcpBuffer(int size, int max_size = 0);
 
   ~TcpBuffer();
 
-  
+
   int readAble();
 
-  
+  // free bytes left in the last block
   int writeAble();
 
-  int readIndex();
-
-  int writeIndex();
-
   void writeToBuffer(const char* buf, int size);
 
   void readFromBuffer(std::vector<char>& re, int size);
 
-  void resizeBuffer(int new_size);
+  // consume size bytes
+  void moveReadIndex(int size);
+
+  // readv into the free tail and the thread's spill buffer, returns what readv returns.
+  // read_count is set to the number of bytes asked for
+  ssize_t readFromFd(int fd, int& read_count);
 
-  void adjustBuffer();
+  // readFromFd() must not be called until some bytes are consumed
+  bool isFull() {
+    return m_max_size > 0 && m_readable >= m_max_size;
+  }
 
-  void moveReadIndex(int size);
 
-  void moveWriteIndex(int size);
+  // byte at offset from the read cursor, offset must be < readAble()
+  char peekChar(int offset);
+
+  // copy len bytes at offset out of the chain, returns false if they are not all readable
+  bool peek(int offset, char* out, int len);
+
+  bool peekString(int offset, int len, std::string& out);
+
+  // int32 in network byte order at offset
+  bool peekInt32(int offset, int32_t& value);
+
+  // offset of the first c at or after offset, -1 if none
+  int find(char c, int offset);
+
+  // the readable bytes in the first block
+  const char* contiguousData(int& len);
+
+  // the contiguous bytes from offset to the end of its block, for walking a range block by block
+  const char* segmentAt(int offset, int& len);
+
+  int blockCount() {
+    return (int)m_blocks.size();
+  }
 
  private:
-  int m_read_index {0};
-  int m_write_index {0};
-  int m_size {0};
+  void appendBlock();
 
- public:
-  std::vector<char> m_buffer;
+  void releaseAll();
+
+ private:
+  std::deque<BufferBlock*> m_blocks;
+  std::vector<BufferBlock*> m_reserved_blocks;   // kept for reuse while the buffer is empty
+  int m_reserved_count {0};
+  // read cursor in the first block, write cursor in the last one
+  int m_read_pos {0};
+  int m_write_pos {0};
+  int m_readable {0};
+  int m_size {0};
+  int m_max_size {0};
 
 };
 
@@ -52,4 +103,4 @@ class TcpBuffer {
 }
 
 
-#endif
\ No newline at end of file
+#endif
@@ -2,6 +2,7 @@
 #include <unistd.h>
 #include <string.h>
 #include "rocket/common/log.h"
+#include "rocket/common/config.h"
 #include "rocket/net/tcp/tcp_client.h"
 #include "rocket/net/eventloop.h"
 #include "rocket/net/fd_event_group.h"
@@ -22,7 +23,7 @@ TcpClient::TcpClient(NetAddr::s_ptr peer_addr) : m_peer_addr(peer_addr) {
   m_fd_event = FdEventGroup::GetFdEventGroup()->getFdEvent(m_fd);
   m_fd_event->setNonBlock();
 
-  m_connection = std::make_shared<TcpConnection>(m_event_loop, m_fd, 128, peer_addr, nullptr, TcpConnectionByClient);
+  m_connection = std::make_shared<TcpConnection>(m_event_loop, m_fd, Config::GetGlobalConfig()->m_buffer_initial_size, peer_addr, nullptr, TcpConnectionByClient);
   m_connection->setConnectionType(TcpConnectionByClient);
  
 }
@@ -30,24 +31,41 @@ TcpClient::TcpClient(NetAddr::s_ptr peer_addr) : m_peer_addr(peer_addr) {
 TcpClient::~TcpClient() {
   DEBUGLOG("TcpClient::~TcpClient()");
   if (m_fd > 0) {
-    close(m_fd);
+    ::close(m_fd);
   }
 }
 
 // Asynchronously establish the connection.
 // If the connection is successful, the 'done' function will be executed.
 void TcpClient::connect(std::function<void()> done) {
+  if (m_connecting || m_connection->getState() == Connected || m_connect_error_code != 0) {
+    if (m_connecting) {
+      m_connect_dones.push_back(done);
+    } else if (done) {
+      done();
+    }
+    // a failed client has run its done, there is nothing to wait for
+    if (m_connect_error_code == 0) {
+      runCallerLoop();
+    }
+    return;
+  }
+
   int rt = ::connect(m_fd, m_peer_addr->getSockAddr(), m_peer_addr->getSockLen());
   if (rt == 0) {
     DEBUGLOG("connect [%s] success", m_peer_addr->toString().c_str());
     m_connection->setState(Connected);
     initLocalAddr();
+    if (m_connection->pendingReadCount() > 0) {
+      m_connection->listenRead();
+    }
     if (done) {
       done();
     }
   } else if (rt == -1) {
     if (errno == EINPROGRESS) {
       // Listen for write events using epoll and then check the error code.
+      m_connecting = true;
       m_fd_event->listen(FdEvent::OUT_EVENT,
         [this, done]() {
           int rt = ::connect(m_fd, m_peer_addr->getSockAddr(), m_peer_addr->getSockLen());
@@ -64,24 +82,35 @@ void TcpClient::connect(std::function<void()> done) {
               m_connect_error_info = "connection unknown error, sys error = " + std::string(strerror(errno));
             }
             ERRORLOG("connect error, errno=%d, error=%s", errno, strerror(errno));
-            close(m_fd);
+            ::close(m_fd);
             m_fd = socket(m_peer_addr->getFamily(), SOCK_STREAM, 0);
           }
 
           // Remove the write event listener after connection is complete to prevent continuous triggering.
+          // OUT must not come back with this callback when the connection listens for IN first
+          m_fd_event->cancel(FdEvent::OUT_EVENT);
           m_event_loop->deleteEpollEvent(m_fd_event);
+          m_connecting = false;
+          if (m_connection->getState() == Connected && m_connection->pendingReadCount() > 0) {
+            m_connection->listenRead();
+          }
           DEBUGLOG("now begin to done");
           // Execute the callback function only when the connection is completed.
+          std::vector<std::function<void()>> dones;
+          dones.swap(m_connect_dones);
           if (done) {
             done();
           }
+          for (size_t i = 0; i < dones.size(); ++i) {
+            if (dones[i]) {
+              dones[i]();
+            }
+          }
         }
       );
       m_event_loop->addEpollEvent(m_fd_event);
 
-      if (!m_event_loop->isLooping()) {
-        m_event_loop->loop();
-      }
+      runCallerLoop();
     } else {
       ERRORLOG("connect error, errno=%d, error=%s", errno, strerror(errno));
       m_connect_error_code = ERROR_FAILED_CONNECT;
@@ -95,6 +124,15 @@ void TcpClient::connect(std::function<void()> done) {
 
 
 
+void TcpClient::runCallerLoop() {
+  // Kept on purpose for <client><io_threads> 0, where a call is made from a thread whose
+  // EventLoop is not running yet: the call blocks in it until a done calls stop(), as it always
+  // did. Runtime IO threads and callers inside their own loop are already looping
+  if (!m_event_loop->isLooping()) {
+    m_event_loop->loop();
+  }
+}
+
 void TcpClient::stop() {
   if (m_event_loop->isLooping()) {
     m_event_loop->stop();
@@ -106,20 +144,53 @@ void TcpClient::stop() {
 void TcpClient::writeMessage(AbstractProtocol::s_ptr message, std::function<void(AbstractProtocol::s_ptr)> done) {
   // 1. Write the message object to the Connection's buffer, and also write the 'done' function.
   // 2. Start listening for connection's write event.
-  m_connection->pushSendMessage(message, done);
-  m_connection->listenWrite();
+  if (m_connection->pushSendMessage(message, done)) {
+    m_connection->listenWrite();
+  }
 }
 
 
 // Asynchronously read a message.
 // If reading the message is successful, the 'done' function will be called with the message object as an argument.
-void TcpClient::readMessage(const std::string& msg_id, std::function<void(AbstractProtocol::s_ptr)> done) {
+bool TcpClient::readMessage(const std::string& msg_id, std::function<void(AbstractProtocol::s_ptr)> done) {
   // 1. Listen for read events.
   // 2. Decode the message object from the buffer, check if the msg_id matches. If matched, the read is successful, and its callback will be executed.
-  m_connection->pushReadMessage(msg_id, done);
-  m_connection->listenRead();
+  bool first = (m_connection->pendingReadCount() == 0);
+  if (!m_connection->pushReadMessage(msg_id, done)) {
+    // the response would go to the read already waiting, this one would never finish
+    done(NULL);
+    return false;
+  }
+  // a read registered before the connection is up is listened for by connect()
+  if (first && m_connection->getState() == Connected) {
+    m_connection->listenRead();
+  }
+  return true;
+}
+
+
+void TcpClient::cancelReadMessage(const std::string& msg_id) {
+  m_connection->eraseReadMessage(msg_id);
+}
+
+bool TcpClient::hasPendingRead(const std::string& msg_id) {
+  return m_connection->hasPendingRead(msg_id);
+}
+
+int TcpClient::pendingReadCount() {
+  return m_connection->pendingReadCount();
 }
 
+bool TcpClient::isHealthy() {
+  if (m_connect_error_code != 0) {
+    return false;
+  }
+  return m_connecting || m_connection->getState() == Connected;
+}
+
+void TcpClient::close() {
+  m_connection->clear();
+}
 
 int TcpClient::getConnectErrorCode() {
   return m_connect_error_code;
@@ -2,6 +2,7 @@
 #define ROCKET_NET_TCP_TCP_CLIENT_H
 
 #include <memory>
+#include <vector>
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/eventloop.h"
 #include "rocket/net/tcp/tcp_connection.h"
@@ -20,23 +21,33 @@ class TcpClient {
   ~TcpClient();
 
   // Asynchronously perform connection.
-// If the connection is successful, the 'done' function will be executed.
-void TcpClient::connect(std::function<void()> done) {
-  // Code for connecting to the server...
-}
+  // If the connection is successful, the 'done' function will be executed.
+  // May be called again on a connecting or connected client, done then runs with the same result.
+  // Runs the client's EventLoop if it is not looping yet and returns when it is stopped
+  void connect(std::function<void()> done);
 
-// Asynchronously send a message.
-// If sending the message is successful, the 'done' function will be called with the message object as an argument.
-void TcpClient::writeMessage(AbstractProtocol::s_ptr message, std::function<void(AbstractProtocol::s_ptr)> done) {
-  // Code for writing the message to the connection's buffer and listening for write events...
-}
+  // Asynchronously send a message.
+  // If sending the message is successful, the 'done' function will be called with the message object as an argument.
+  void writeMessage(AbstractProtocol::s_ptr message, std::function<void(AbstractProtocol::s_ptr)> done);
 
-// Asynchronously read a message.
-// If reading the message is successful, the 'done' function will be called with the message object as an argument.
-void TcpClient::readMessage(const std::string& msg_id, std::function<void(AbstractProtocol::s_ptr)> done) {
-  // Code for listening for read events and decoding the message object from the buffer...
-}
+  // Asynchronously read a message.
+  // If reading the message is successful, the 'done' function will be called with the message object as an argument,
+  // with NULL if the connection is closed before the response arrives.
+  // false if msg_id already waits for a response on this connection, 'done' is then called with NULL at once.
+  bool readMessage(const std::string& msg_id, std::function<void(AbstractProtocol::s_ptr)> done);
+
+  // forget the read of msg_id, e.g. when its call timed out
+  void cancelReadMessage(const std::string& msg_id);
+
+  bool hasPendingRead(const std::string& msg_id);
 
+  int pendingReadCount();
+
+  // connecting or connected and not closed by the peer
+  bool isHealthy();
+
+  // stop listening on the fd, the fd is closed with the client
+  void close();
 
   void stop();
 
@@ -53,6 +64,9 @@ void TcpClient::readMessage(const std::string& msg_id, std::function<void(Abstra
   void addTimerEvent(TimerEvent::s_ptr timer_event);
 
 
+ private:
+  void runCallerLoop();
+
  private:
   NetAddr::s_ptr m_peer_addr;
   NetAddr::s_ptr m_local_addr;
@@ -67,6 +81,9 @@ void TcpClient::readMessage(const std::string& msg_id, std::function<void(Abstra
   int m_connect_error_code {0};
   std::string m_connect_error_info;
 
+  bool m_connecting {false};
+  std::vector<std::function<void()>> m_connect_dones;   // connect() calls made while connecting
+
 };  
 }
 
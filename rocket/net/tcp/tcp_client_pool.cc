@@ -0,0 +1,141 @@
+#include <algorithm>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/util.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/tcp/tcp_client_pool.h"
+
+namespace rocket {
+
+static thread_local TcpClientPool* t_client_pool = NULL;
+
+
+TcpClientPool* TcpClientPool::GetCurrentPool() {
+  if (t_client_pool) {
+    return t_client_pool;
+  }
+  t_client_pool = new TcpClientPool();
+  return t_client_pool;
+}
+
+
+TcpClientPool::TcpClientPool() {
+  int idle_timeout = Config::GetGlobalConfig()->m_client_pool_idle_timeout;
+  int interval = std::max(idle_timeout / 2, 1000);
+  m_idle_timer = std::make_shared<TimerEvent>(interval, true, std::bind(&TcpClientPool::evictIdle, this));
+  EventLoop::GetCurrentEventLoop()->addTimerEvent(m_idle_timer);
+}
+
+TcpClientPool::~TcpClientPool() {
+  m_idle_timer->setCancled(true);
+}
+
+
+TcpClient::s_ptr TcpClientPool::acquire(NetAddr::s_ptr peer_addr, const std::string& msg_id) {
+  Config* config = Config::GetGlobalConfig();
+  std::vector<Entry>& entries = m_clients[peer_addr->toString()];
+
+  Entry* best = NULL;
+  int best_pending = 0;
+  for (size_t i = 0; i < entries.size(); ) {
+    if (!entries[i].client->isHealthy()) {
+      INFOLOG("drop unhealthy connection to [%s]", peer_addr->toString().c_str());
+      m_stats.failures++;
+      entries.erase(entries.begin() + i);
+      continue;
+    }
+    int pending = entries[i].client->pendingReadCount();
+    // the same msg_id can be in flight twice when it is passed through from the caller's request
+    if ((best == NULL || pending < best_pending) && !entries[i].client->hasPendingRead(msg_id)) {
+      best = &entries[i];
+      best_pending = pending;
+    }
+    ++i;
+  }
+
+  int max_connections = config->m_client_pool_max_connections;
+  if (best != NULL && (best_pending < config->m_client_pool_max_pending || (int)entries.size() >= max_connections)) {
+    m_stats.hits++;
+    best->last_used_ms = getNowMs();
+    best->users++;
+    return best->client;
+  }
+
+  m_stats.misses++;
+  TcpClient::s_ptr client = std::make_shared<TcpClient>(peer_addr);
+  if ((int)entries.size() < max_connections) {
+    Entry entry;
+    entry.client = client;
+    entry.last_used_ms = getNowMs();
+    entry.users = 1;
+    entries.push_back(entry);
+    DEBUGLOG("open connection %d to [%s]", (int)entries.size(), peer_addr->toString().c_str());
+  } else {
+    // pooling is off, or every pooled connection already waits for msg_id. This one is closed with its caller
+    DEBUGLOG("%s | unpooled connection to [%s], %d pooled", msg_id.c_str(), peer_addr->toString().c_str(), (int)entries.size());
+  }
+  return client;
+}
+
+
+void TcpClientPool::release(TcpClient::s_ptr client) {
+  auto it = m_clients.find(client->getPeerAddr()->toString());
+  if (it != m_clients.end()) {
+    std::vector<Entry>& entries = it->second;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (entries[i].client == client) {
+        entries[i].users--;
+        entries[i].last_used_ms = getNowMs();
+        return;
+      }
+    }
+  }
+  // an unpooled client, or one already dropped as unhealthy. Its fd leaves the EventLoop here,
+  // ~TcpClient only closes it and the next socket with the same fd would not be added again
+  client->close();
+}
+
+
+void TcpClientPool::evictIdle() {
+  int64_t now = getNowMs();
+  int idle_timeout = Config::GetGlobalConfig()->m_client_pool_idle_timeout;
+
+  for (auto it = m_clients.begin(); it != m_clients.end(); ) {
+    std::vector<Entry>& entries = it->second;
+    for (size_t i = 0; i < entries.size(); ) {
+      TcpClient::s_ptr client = entries[i].client;
+      bool healthy = client->isHealthy();
+      bool idle = entries[i].users == 0 && client->pendingReadCount() == 0 && now - entries[i].last_used_ms >= idle_timeout;
+      if (healthy && !idle) {
+        ++i;
+        continue;
+      }
+      if (healthy) {
+        DEBUGLOG("close idle connection to [%s]", it->first.c_str());
+        m_stats.evictions++;
+        client->close();
+      } else {
+        m_stats.failures++;
+      }
+      entries.erase(entries.begin() + i);
+    }
+
+    if (entries.empty()) {
+      it = m_clients.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+
+TcpClientPool::Stats TcpClientPool::getStats() {
+  Stats stats = m_stats;
+  stats.connections = 0;
+  for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
+    stats.connections += it->second.size();
+  }
+  return stats;
+}
+
+}
@@ -0,0 +1,69 @@
+#ifndef ROCKET_NET_TCP_TCP_CLIENT_POOL_H
+#define ROCKET_NET_TCP_TCP_CLIENT_POOL_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/timer_event.h"
+
+namespace rocket {
+
+/*
+ * Persistent TcpClients of one thread's EventLoop, keyed by peer address.
+ *
+ * A connection carries many calls at once, acquire() returns the least busy
+ * healthy one and opens another only when all of them have max_pending calls
+ * in flight, up to max_connections per peer. A repeated timer closes
+ * connections that had no call for idle_timeout ms.
+ */
+class TcpClientPool {
+
+ public:
+  struct Stats {
+    int64_t hits {0};         // acquire() reused an open connection
+    int64_t misses {0};       // acquire() had to open one
+    int64_t evictions {0};    // idle connections closed
+    int64_t failures {0};     // connections dropped after a connect error or a peer close
+    int connections {0};
+  };
+
+ public:
+  static TcpClientPool* GetCurrentPool();
+
+ public:
+  TcpClientPool();
+
+  ~TcpClientPool();
+
+  // A client to peer_addr on which msg_id is not waiting for a response. It may
+  // still be connecting, connect() runs the done once it is.
+  // Every acquire() is paired with a release() once the call is done
+  TcpClient::s_ptr acquire(NetAddr::s_ptr peer_addr, const std::string& msg_id);
+
+  void release(TcpClient::s_ptr client);
+
+  Stats getStats();
+
+ private:
+  struct Entry {
+    TcpClient::s_ptr client;
+    int64_t last_used_ms {0};
+    int users {0};            // acquired and not released yet, never closed as idle while above 0
+  };
+
+  void evictIdle();
+
+ private:
+  std::map<std::string, std::vector<Entry>> m_clients;
+
+  TimerEvent::s_ptr m_idle_timer;
+
+  Stats m_stats;
+
+};
+
+}
+
+#endif
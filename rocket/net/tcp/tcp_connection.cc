@@ -1,25 +1,39 @@
 #include <unistd.h>
+#include <string.h>
 #include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/msg_id_util.h"
 #include "rocket/net/fd_event_group.h"
 #include "rocket/net/tcp/tcp_connection.h"
 #include "rocket/net/coder/string_coder.h"
 #include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_v2_coder.h"
 
 namespace rocket {
 
 TcpConnection::TcpConnection(EventLoop* event_loop, int fd, int buffer_size, NetAddr::s_ptr peer_addr, NetAddr::s_ptr local_addr, TcpConnectionType type /*= TcpConnectionByServer*/)
     : m_event_loop(event_loop), m_local_addr(local_addr), m_peer_addr(peer_addr), m_state(NotConnected), m_fd(fd), m_connection_type(type) {
     
-  m_in_buffer = std::make_shared<TcpBuffer>(buffer_size);
-  m_out_buffer = std::make_shared<TcpBuffer>(buffer_size);
+  m_in_buffer = std::make_shared<TcpBuffer>(buffer_size, Config::GetGlobalConfig()->m_buffer_max_size);
+  m_out_buffer = std::make_shared<OutputChain>();
 
   m_fd_event = FdEventGroup::GetFdEventGroup()->getFdEvent(fd);
   m_fd_event->setNonBlock();
+  if (Config::GetGlobalConfig()->m_tcp_nodelay) {
+    m_fd_event->setNoDelay();
+  }
+  // the FdEvent may be reused from a closed fd
+  m_fd_event->setEdgeTriggered(false);
+  m_edge_triggered = Config::GetGlobalConfig()->m_epoll_edge_triggered;
 
-  m_coder = new TinyPBCoder();
+  if (m_connection_type == TcpConnectionByClient) {
+    createCoder(Config::GetGlobalConfig()->m_tinypb_version);
+  }
 
   if (m_connection_type == TcpConnectionByServer) {
-    listenRead();
+    // an accepted fd is already connected. The owner calls listenRead() once the connection
+    // is held by a shared_ptr, the FdEvent handlers keep a weak_ptr to it
+    m_state = Connected;
   }
 
 }
@@ -39,54 +53,97 @@ void TcpConnection::onRead() {
     return;
   }
 
-  bool is_read_all = false;
-  bool is_close = false;
-  while(!is_read_all) {
-    if (m_in_buffer->writeAble() == 0) {
-      m_in_buffer->resizeBuffer(2 * m_in_buffer->m_buffer.size());
-    }
-    int read_count = m_in_buffer->writeAble();
-    int write_index = m_in_buffer->writeIndex(); 
-
-    int rt = read(m_fd, &(m_in_buffer->m_buffer[write_index]), read_count);
-    DEBUGLOG("success read %d bytes from addr[%s], client fd[%d]", rt, m_peer_addr->toString().c_str(), m_fd);
-    if (rt > 0) {
-      m_in_buffer->moveWriteIndex(rt);
-      if (rt == read_count) {
-        continue;
-      } else if (rt < read_count) {
+  while (true) {
+    bool is_read_all = false;
+    bool is_close = false;
+    bool is_full = false;
+    while(!is_read_all) {
+      if (m_in_buffer->isFull()) {
+        is_full = true;
+        break;
+      }
+      int read_count = 0;
+      int rt = m_in_buffer->readFromFd(m_fd, read_count);
+      DEBUGLOG("success read %d bytes from addr[%s], client fd[%d]", rt, m_peer_addr->toString().c_str(), m_fd);
+      if (rt > 0) {
+        if (rt == read_count || m_edge_triggered) {
+          // edge-triggered fd won't be reported again until it is drained to EAGAIN
+          continue;
+        } else if (rt < read_count) {
+          is_read_all = true;
+          break;
+        }
+      } else if (rt == 0) {
+        is_close = true;
+        break;
+      } else if (rt == -1 && errno == EAGAIN) {
         is_read_all = true;
         break;
+      } else if (rt == -1 && errno != EINTR) {
+        ERRORLOG("read error, errno=%d, error=%s, clientfd[%d]", errno, strerror(errno), m_fd);
+        is_close = true;
+        break;
       }
-    } else if (rt == 0) {
-      is_close = true;
-      break;
-    } else if (rt == -1 && errno == EAGAIN) {
-      is_read_all = true;
-      break;
     }
-  }
 
-  if (is_close) {
-    //TODO: 
-    INFOLOG("peer closed, peer addr [%s], clientfd [%d]", m_peer_addr->toString().c_str(), m_fd);
-    clear();
-    return;
-  }
+    if (is_close) {
+      //TODO: 
+      INFOLOG("peer closed, peer addr [%s], clientfd [%d]", m_peer_addr->toString().c_str(), m_fd);
+      clear();
+      return;
+    }
 
-  if (!is_read_all) {
-    ERRORLOG("not read all data");
+    execute();
+
+    if (!is_full || m_state != Connected) {
+      return;
+    }
+    if (m_in_buffer->isFull()) {
+      ERRORLOG("message from addr[%s] exceeds max buffer size %d, close clientfd[%d]", m_peer_addr->toString().c_str(), Config::GetGlobalConfig()->m_buffer_max_size, m_fd);
+      shutdown();
+      clear();
+      return;
+    }
+    // decoded some messages, read the rest of the socket
   }
- 
-  excute();
 
 }
 
+void TcpConnection::createCoder(int version) {
+  int checksum = Config::GetGlobalConfig()->m_tinypb_checksum;
+  bool checksum_enabled = (checksum == 1 || (checksum == 2 && !m_peer_addr->isLoopback()));
+  if (version == 2) {
+    TinyPBV2Coder* coder = new TinyPBV2Coder();
+    coder->setChecksumEnabled(checksum_enabled);
+    m_coder = coder;
+  } else {
+    TinyPBCoder* coder = new TinyPBCoder();
+    coder->setChecksumEnabled(checksum_enabled);
+    m_coder = coder;
+  }
+}
+
 void TcpConnection::execute() {
+  if (m_coder == NULL) {
+    // server side, the client's first byte tells which framing it speaks
+    if (m_in_buffer->readAble() == 0) {
+      return;
+    }
+    int version = (m_in_buffer->peekChar(0) == TinyPBV2Coder::PB2_START) ? 2 : 1;
+    INFOLOG("client[%s] speaks TinyPB v%d, clientfd[%d]", m_peer_addr->toString().c_str(), version, m_fd);
+    createCoder(version);
+  }
+
   if (m_connection_type == TcpConnectionByServer) {
     // Execute business logic for RPC requests, get RPC responses, and send them back
     std::vector<AbstractProtocol::s_ptr> result;
     m_coder->decode(result, m_in_buffer);
+    // the requests before the bad bytes get no reply either, the connection is closed
+    if (closeIfDesynced()) {
+      return;
+    }
+    m_request_count.store(m_request_count.load(std::memory_order_relaxed) + result.size(), std::memory_order_relaxed);
+    m_pending_replies += result.size();
     for (size_t i = 0; i < result.size(); ++i) {
       // 1. For each request, call the RPC method to get the response message.
       // 2. Put the response message into the send buffer and listen for write events to send the response.
@@ -104,21 +161,57 @@ void TcpConnection::execute() {
     std::vector<AbstractProtocol::s_ptr> result;
     m_coder->decode(result, m_in_buffer);
 
+    std::function<void(AbstractProtocol::s_ptr)> done;
     for (size_t i = 0; i < result.size(); ++i) {
-      std::string msg_id = result[i]->m_msg_id;
-      auto it = m_read_dones.find(msg_id);
-      if (it != m_read_dones.end()) {
-        it->second(result[i]);
-        m_read_dones.erase(it);
+      const std::string& msg_id = result[i]->m_msg_id;
+      uint64_t key = 0;
+      if (MsgIDUtil::ToBinary(msg_id, key)) {
+        if (!m_read_dones.take(key, done)) {
+          continue;
+        }
+      } else {
+        auto it = m_named_read_dones.find(msg_id);
+        if (it == m_named_read_dones.end()) {
+          continue;
+        }
+        done.swap(it->second);
+        m_named_read_dones.erase(it);
       }
+      // done may push new reads
+      done(result[i]);
     }
+    // the reads still waiting fail now instead of at their timeout
+    closeIfDesynced();
+  }
+}
+
+bool TcpConnection::closeIfDesynced() {
+  if (!m_coder->isDesynced() || m_state == Closed) {
+    return false;
   }
+  ERRORLOG("lost the frames of addr[%s], close clientfd[%d]", m_peer_addr->toString().c_str(), m_fd);
+  shutdown();
+  clear();
+  return true;
 }
 
 
 
 void TcpConnection::reply(std::vector<AbstractProtocol::s_ptr>& replay_messages) {
+  m_pending_replies -= replay_messages.size();
   m_coder->encode(replay_messages, m_out_buffer);
+
+  // Write through first, EPOLLOUT is only armed when the kernel send buffer is full.
+  // Edge-triggered listenWrite() already writes directly while the socket is writable.
+  if (!m_edge_triggered && m_state == Connected && m_event_loop->isInLoopThread()) {
+    if (flushOutBuffer()) {
+      if (m_fd_event->getEpollEvent().events & EPOLLOUT) {
+        m_fd_event->cancel(FdEvent::OUT_EVENT);
+        m_event_loop->addEpollEvent(m_fd_event);
+      }
+      return;
+    }
+  }
   listenWrite();
 }
 
@@ -143,39 +236,52 @@ void TcpConnection::onWrite() {
     m_coder->encode(messages, m_out_buffer);
   }
 
-  bool is_write_all = false;
+  bool is_write_all = flushOutBuffer();
+  if (is_write_all && !m_edge_triggered) {
+    m_fd_event->cancel(FdEvent::OUT_EVENT);
+    m_event_loop->addEpollEvent(m_fd_event);
+  }
+
+  if (m_connection_type == TcpConnectionByClient) {
+    // a done may write the next message, which comes back here in edge-triggered mode
+    std::vector<std::pair<AbstractProtocol::s_ptr, std::function<void(AbstractProtocol::s_ptr)>>> dones;
+    dones.swap(m_write_dones);
+    for (size_t i = 0; i < dones.size(); ++i) {
+      dones[i].second(dones[i].first);
+    }
+  }
+}
+
+bool TcpConnection::flushOutBuffer() {
   while (true) {
     if (m_out_buffer->readAble() == 0) {
       DEBUGLOG("no data need to send to client [%s]", m_peer_addr->toString().c_str());
-      is_write_all = true;
-      break;
+      return true;
     }
-    int write_size = m_out_buffer->readAble();
-    int read_index = m_out_buffer->readIndex();
-
-    int rt = write(m_fd, &(m_out_buffer->m_buffer[read_index]), write_size);
+    // writev up to IOV_MAX segments, the chain drops what has been written
+    ssize_t write_size = m_out_buffer->readAble();
+    ssize_t rt = m_out_buffer->writeTo(m_fd);
 
     if (rt >= write_size) {
       DEBUGLOG("no data need to send to client [%s]", m_peer_addr->toString().c_str());
-      is_write_all = true;
-      break;
+      return true;
     } if (rt == -1 && errno == EAGAIN) {
       // The send buffer is full, cannot send more data.
       // We will wait and send data again when the fd becomes writable.
-      ERRORLOG("write data error, errno==EAGAIN and rt == -1");
-      break;
+      DEBUGLOG("write data blocked, errno==EAGAIN and rt == -1, clientfd[%d]", m_fd);
+      m_writable = false;
+      return false;
+    } else if (rt == -1 && errno != EINTR) {
+      ERRORLOG("write data error, errno=%d, error=%s, clientfd[%d]", errno, strerror(errno), m_fd);
+      return false;
     }
   }
-  if (is_write_all) {
-    m_fd_event->cancel(FdEvent::OUT_EVENT);
-    m_event_loop->addEpollEvent(m_fd_event);
-  }
+}
 
-  if (m_connection_type == TcpConnectionByClient) {
-    for (size_t i = 0; i < m_write_dones.size(); ++i) {
-      m_write_dones[i].second(m_write_dones[i].first);
-    }
-    m_write_dones.clear();
+void TcpConnection::onWritable() {
+  m_writable = true;
+  if (m_out_buffer->readAble() > 0 || !m_write_dones.empty()) {
+    onWrite();
   }
 }
 
@@ -199,6 +305,22 @@ void TcpConnection::clear() {
   m_event_loop->deleteEpollEvent(m_fd_event);
 
   m_state = Closed;
+
+  // no response can come any more, the reads still waiting get NULL. A done may drop the
+  // last owner of this connection
+  s_ptr self = shared_from_this();
+  std::vector<std::function<void(AbstractProtocol::s_ptr)>> dones;
+  m_read_dones.takeAll(dones);
+  for (auto it = m_named_read_dones.begin(); it != m_named_read_dones.end(); ++it) {
+    dones.push_back(std::move(it->second));
+  }
+  m_named_read_dones.clear();
+  if (!dones.empty()) {
+    INFOLOG("fail %d pending reads of closed clientfd[%d]", (int)dones.size(), m_fd);
+  }
+  for (size_t i = 0; i < dones.size(); ++i) {
+    dones[i](nullptr);
+  }
 }
 
 void TcpConnection::shutdown() {
@@ -224,25 +346,94 @@ void TcpConnection::setConnectionType(TcpConnectionType type) {
 
 
 void TcpConnection::listenWrite() {
+  if (m_edge_triggered) {
+    listenEdgeTriggered();
+    // not writable yet, the next EPOLLOUT edge flushes the buffer
+    if (m_writable) {
+      onWrite();
+    }
+    return;
+  }
 
-  m_fd_event->listen(FdEvent::OUT_EVENT, std::bind(&TcpConnection::onWrite, this));
+  m_fd_event->listen(FdEvent::OUT_EVENT, bindHandler(&TcpConnection::onWrite));
   m_event_loop->addEpollEvent(m_fd_event);
 }
 
 
 void TcpConnection::listenRead() {
+  if (m_edge_triggered) {
+    listenEdgeTriggered();
+    return;
+  }
 
-  m_fd_event->listen(FdEvent::IN_EVENT, std::bind(&TcpConnection::onRead, this));
+  m_fd_event->listen(FdEvent::IN_EVENT, bindHandler(&TcpConnection::onRead));
+  m_event_loop->addEpollEvent(m_fd_event);
+}
+
+
+void TcpConnection::listenEdgeTriggered() {
+  if (m_edge_registered) {
+    return;
+  }
+  m_fd_event->listen(FdEvent::IN_EVENT, bindHandler(&TcpConnection::onRead));
+  m_fd_event->listen(FdEvent::OUT_EVENT, bindHandler(&TcpConnection::onWritable));
+  m_fd_event->setEdgeTriggered(true);
   m_event_loop->addEpollEvent(m_fd_event);
+  m_edge_registered = true;
 }
 
 
-void TcpConnection::pushSendMessage(AbstractProtocol::s_ptr message, std::function<void(AbstractProtocol::s_ptr)> done) {
+std::function<void()> TcpConnection::bindHandler(void (TcpConnection::*handler)()) {
+  std::weak_ptr<TcpConnection> weak_self = shared_from_this();
+  return [weak_self, handler]() {
+    // the FdEvent outlives the connection, it is reused by the next owner of the fd
+    s_ptr self = weak_self.lock();
+    if (self) {
+      ((*self).*handler)();
+    }
+  };
+}
+
+
+bool TcpConnection::pushSendMessage(AbstractProtocol::s_ptr message, std::function<void(AbstractProtocol::s_ptr)> done) {
+  // a non-empty queue is already waiting for onWrite(), which encodes all queued messages into one writev
   m_write_dones.push_back(std::make_pair(message, done));
+  return m_write_dones.size() == 1;
 }
 
-void TcpConnection::pushReadMessage(const std::string& msg_id, std::function<void(AbstractProtocol::s_ptr)> done) {
-  m_read_dones.insert(std::make_pair(msg_id, done));
+bool TcpConnection::pushReadMessage(const std::string& msg_id, std::function<void(AbstractProtocol::s_ptr)> done) {
+  uint64_t key = 0;
+  bool rt = false;
+  if (MsgIDUtil::ToBinary(msg_id, key)) {
+    rt = m_read_dones.insert(key, done);
+  } else {
+    rt = m_named_read_dones.insert(std::make_pair(msg_id, done)).second;
+  }
+  if (!rt) {
+    ERRORLOG("msg_id[%s] is already waiting for a response on clientfd[%d]", msg_id.c_str(), m_fd);
+  }
+  return rt;
+}
+
+bool TcpConnection::hasPendingRead(const std::string& msg_id) {
+  uint64_t key = 0;
+  if (MsgIDUtil::ToBinary(msg_id, key)) {
+    return m_read_dones.find(key) != NULL;
+  }
+  return m_named_read_dones.find(msg_id) != m_named_read_dones.end();
+}
+
+void TcpConnection::eraseReadMessage(const std::string& msg_id) {
+  uint64_t key = 0;
+  if (MsgIDUtil::ToBinary(msg_id, key)) {
+    m_read_dones.erase(key);
+  } else {
+    m_named_read_dones.erase(msg_id);
+  }
+}
+
+int TcpConnection::pendingReadCount() {
+  return (int)(m_read_dones.size() + m_named_read_dones.size());
 }
 
 
@@ -254,6 +445,53 @@ NetAddr::s_ptr TcpConnection::getPeerAddr() {
   return m_peer_addr;
 }
 
+EventLoop* TcpConnection::getEventLoop() {
+  return m_event_loop;
+}
+
+int64_t TcpConnection::getRequestCount() {
+  return m_request_count.load(std::memory_order_relaxed);
+}
+
+
+void TcpConnection::moveToEventLoop(EventLoop* event_loop, std::function<void(bool)> done) {
+  if (m_state != Connected || event_loop == m_event_loop) {
+    done(false);
+    return;
+  }
+  // Stop watching the fd, then decide one task later. Handlers of the current loop that were
+  // queued before the fd left epoll (DispatchQueued) run in between
+  m_event_loop->deleteEpollEvent(m_fd_event);
+  s_ptr self = shared_from_this();
+  m_event_loop->addTask([self, event_loop, done]() {
+    self->finishMove(event_loop, done);
+  }, true);
+}
+
+void TcpConnection::finishMove(EventLoop* event_loop, std::function<void(bool)> done) {
+  if (m_state != Connected) {
+    done(false);
+    return;
+  }
+
+  bool idle = m_in_buffer->readAble() == 0 && m_out_buffer->readAble() == 0 && m_pending_replies == 0 && m_write_dones.empty();
+  if (!idle) {
+    // the FdEvent still holds the events it listened to
+    m_event_loop->addEpollEvent(m_fd_event);
+    done(false);
+    return;
+  }
+
+  INFOLOG("move idle connection of client[%s], clientfd[%d] to another IO thread", m_peer_addr->toString().c_str(), m_fd);
+  m_event_loop = event_loop;
+  s_ptr self = shared_from_this();
+  // bytes that arrived meanwhile are reported when the fd is added, in both epoll modes
+  event_loop->addTask([self, done]() {
+    self->m_event_loop->addEpollEvent(self->m_fd_event);
+    done(true);
+  }, true);
+}
+
 
 int TcpConnection::getFd() {
   return m_fd;
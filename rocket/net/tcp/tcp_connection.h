@@ -3,9 +3,12 @@
 
 #include <memory>
 #include <map>
+#include <atomic>
 #include <queue>
 #include "rocket/net/tcp/net_addr.h"
 #include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/tcp/output_chain.h"
+#include "rocket/common/flat_hash_map.h"
 #include "rocket/net/io_thread.h"
 #include "rocket/net/coder/abstract_coder.h"
 #include "rocket/net/rpc/rpc_dispatcher.h"
@@ -24,7 +27,7 @@ enum TcpConnectionType {
   TcpConnectionByClient = 2,  
 };
 
-class TcpConnection {
+class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
  public:
 
   typedef std::shared_ptr<TcpConnection> s_ptr;
@@ -37,7 +40,7 @@ class TcpConnection {
 
   void onRead();
 
-  void excute();
+  void execute();
 
   void onWrite();
 
@@ -57,16 +60,59 @@ class TcpConnection {
 
   void listenRead();
 
-  void pushSendMessage(AbstractProtocol::s_ptr message, std::function<void(AbstractProtocol::s_ptr)> done);
+  bool isEdgeTriggered() {
+    return m_edge_triggered;
+  }
 
-  void pushReadMessage(const std::string& msg_id, std::function<void(AbstractProtocol::s_ptr)> done);
+  // returns true if it is the only queued message, the caller must then listenWrite()
+  bool pushSendMessage(AbstractProtocol::s_ptr message, std::function<void(AbstractProtocol::s_ptr)> done);
+
+  // any number of reads may be pending, done runs when the response with msg_id arrives, in any order,
+  // or with NULL when the connection is closed first. false if msg_id is already pending
+  bool pushReadMessage(const std::string& msg_id, std::function<void(AbstractProtocol::s_ptr)> done);
+
+  int pendingReadCount();
+
+  bool hasPendingRead(const std::string& msg_id);
+
+  void eraseReadMessage(const std::string& msg_id);
 
   NetAddr::s_ptr getLocalAddr();
 
   NetAddr::s_ptr getPeerAddr();
 
+  EventLoop* getEventLoop();
+
   void reply(std::vector<AbstractProtocol::s_ptr>& replay_messages);
 
+  // requests received by a server connection so far, may be read from any thread
+  int64_t getRequestCount();
+
+  // Call on the connection's IO thread. Moves the connection to event_loop if it is idle: no
+  // unread or unsent bytes and every request answered. done(true) runs on event_loop after
+  // the move, done(false) on the current IO thread if the connection stays
+  void moveToEventLoop(EventLoop* event_loop, std::function<void(bool)> done);
+
+ private:
+  // edge-triggered mode: register IN|OUT|RDHUP once, never touch epoll again until clear()
+  void listenEdgeTriggered();
+
+  void onWritable();
+
+  // an FdEvent handler that runs handler while the connection is alive and holds it meanwhile
+  std::function<void()> bindHandler(void (TcpConnection::*handler)());
+
+  // TinyPBCoder for version 1, TinyPBV2Coder for 2, with the configured checksum
+  void createCoder(int version);
+
+  // closes the connection once its coder can not find the next frame, true if it did
+  bool closeIfDesynced();
+
+  // write m_out_buffer until it is empty or the socket would block, true if all written
+  bool flushOutBuffer();
+
+  void finishMove(EventLoop* event_loop, std::function<void(bool)> done);
+
  private:
 
   EventLoop* m_event_loop {NULL}; 
@@ -75,11 +121,11 @@ class TcpConnection {
   NetAddr::s_ptr m_peer_addr;
 
   TcpBuffer::s_ptr m_in_buffer;   
-  TcpBuffer::s_ptr m_out_buffer;  
+  OutputChain::s_ptr m_out_buffer;   // flushed with writev
 
   FdEvent* m_fd_event {NULL};
 
-  AbstractCoder* m_coder {NULL};
+  AbstractCoder* m_coder {NULL};   // a server connection creates it on the first bytes received
 
   TcpState m_state;
 
@@ -87,12 +133,20 @@ class TcpConnection {
 
   TcpConnectionType m_connection_type {TcpConnectionByServer};
 
+  bool m_edge_triggered {false};
+  bool m_edge_registered {false};
+  bool m_writable {false};      // edge-triggered mode only, false after write() got EAGAIN
+
+  std::atomic<int64_t> m_request_count {0};     // written by the IO thread only
+  int m_pending_replies {0};    // requests dispatched and not answered yet
+
   // std::pair<AbstractProtocol::s_ptr, std::function<void(AbstractProtocol::s_ptr)>>
   std::vector<std::pair<AbstractProtocol::s_ptr, std::function<void(AbstractProtocol::s_ptr)>>> m_write_dones;
 
-  
-  std::map<std::string, std::function<void(AbstractProtocol::s_ptr)>> m_read_dones;
-  
+  // pending reads by binary msg_id, ids that are not a uint64 decimal go to m_named_read_dones
+  FlatHashMap<std::function<void(AbstractProtocol::s_ptr)>> m_read_dones;
+  std::map<std::string, std::function<void(AbstractProtocol::s_ptr)>> m_named_read_dones;
+
 };
 
 }
@@ -1,8 +1,11 @@
+#include <stdlib.h>
+#include <vector>
 #include "rocket/net/tcp/tcp_server.h"
 #include "rocket/net/eventloop.h"
 #include "rocket/net/tcp/tcp_connection.h"
 #include "rocket/common/log.h"
 #include "rocket/common/config.h"
+#include "rocket/net/rpc/rpc_dispatcher.h"
 
 
 
@@ -33,36 +36,95 @@ TcpServer::~TcpServer() {
 
 void TcpServer::init() {
 
-  m_acceptor = std::make_shared<TcpAcceptor>(m_local_addr);
-
   m_main_event_loop = EventLoop::GetCurrentEventLoop();
   m_io_thread_group = new IOThreadGroup(Config::GetGlobalConfig()->m_io_threads);
+  RpcDispatcher::GetRpcDispatcher()->initWorkerPool();
+
+  if (Config::GetGlobalConfig()->m_reuse_port) {
+    // the kernel spreads new connections over the sockets, no hand-off from the main thread
+    for (int i = 0; i < m_io_thread_group->size(); ++i) {
+      TcpAcceptor::s_ptr acceptor = std::make_shared<TcpAcceptor>(m_local_addr, true);
+      FdEvent* fd_event = new FdEvent(acceptor->getListenFd());
+      fd_event->listen(FdEvent::IN_EVENT, std::bind(&TcpServer::onAcceptInIOThread, this, i));
+      m_io_thread_group->getIOThread(i)->getEventLoop()->addEpollEvent(fd_event);
+      m_io_acceptors.push_back(acceptor);
+      m_io_listen_fd_events.push_back(fd_event);
+    }
+  } else {
+    m_acceptor = std::make_shared<TcpAcceptor>(m_local_addr);
 
-  m_listen_fd_event = new FdEvent(m_acceptor->getListenFd());
-  m_listen_fd_event->listen(FdEvent::IN_EVENT, std::bind(&TcpServer::onAccept, this));
-  
-  m_main_event_loop->addEpollEvent(m_listen_fd_event);
+    m_listen_fd_event = new FdEvent(m_acceptor->getListenFd());
+    m_listen_fd_event->listen(FdEvent::IN_EVENT, std::bind(&TcpServer::onAccept, this));
+
+    m_main_event_loop->addEpollEvent(m_listen_fd_event);
+  }
 
   m_clear_client_timer_event = std::make_shared<TimerEvent>(5000, true, std::bind(&TcpServer::ClearClientTimerFunc, this));
 	m_main_event_loop->addTimerEvent(m_clear_client_timer_event);
 
+  Config* config = Config::GetGlobalConfig();
+  if (config->m_io_balance_enable && m_io_thread_group->size() > 1 && config->m_io_balance_interval > 0) {
+    m_balance_timer_event = std::make_shared<TimerEvent>(config->m_io_balance_interval, true, std::bind(&TcpServer::BalanceIOThreadsFunc, this));
+    m_main_event_loop->addTimerEvent(m_balance_timer_event);
+  }
+
 }
 
 
 void TcpServer::onAccept() {
-  auto re = m_acceptor->accept();
-  int client_fd = re.first;
-  NetAddr::s_ptr peer_addr = re.second;
+  while (true) {
+    auto re = m_acceptor->accept();
+    int client_fd = re.first;
+    NetAddr::s_ptr peer_addr = re.second;
+    if (client_fd < 0) {
+      break;
+    }
 
-  m_client_counts++;
-  
-  IOThread* io_thread = m_io_thread_group->getIOThread();
-  TcpConnection::s_ptr connetion = std::make_shared<TcpConnection>(io_thread->getEventLoop(), client_fd, 128, peer_addr, m_local_addr);
-  connetion->setState(Connected);
+    int index = 0;
+    if (Config::GetGlobalConfig()->m_io_balance_enable) {
+      index = m_io_thread_group->pickIOThread();
+    } else {
+      index = m_client_counts % m_io_thread_group->size();
+    }
+
+    IOThread* io_thread = m_io_thread_group->getIOThread(index);
+    TcpConnection::s_ptr connetion = std::make_shared<TcpConnection>(io_thread->getEventLoop(), client_fd, Config::GetGlobalConfig()->m_buffer_initial_size, peer_addr, m_local_addr);
+    connetion->listenRead();
+
+    addClient(connetion, index);
+  }
+}
+
+void TcpServer::onAcceptInIOThread(int index) {
+  EventLoop* event_loop = m_io_thread_group->getIOThread(index)->getEventLoop();
+  std::vector<TcpConnection::s_ptr> connections;
+  while (true) {
+    auto re = m_io_acceptors[index]->accept();
+    if (re.first < 0) {
+      break;
+    }
+    TcpConnection::s_ptr connection = std::make_shared<TcpConnection>(event_loop, re.first, Config::GetGlobalConfig()->m_buffer_initial_size, re.second, m_local_addr);
+    connection->listenRead();
+    connections.push_back(connection);
+  }
+  if (connections.empty()) {
+    return;
+  }
+
+  // m_client belongs to the main loop, one task for the whole batch
+  m_main_event_loop->addTask([this, connections, index]() {
+    for (size_t i = 0; i < connections.size(); ++i) {
+      addClient(connections[i], index);
+    }
+  }, true);
+}
 
-  m_client.insert(connetion);
+void TcpServer::addClient(TcpConnection::s_ptr connection, int index) {
+  m_client_counts++;
+  m_io_thread_group->addConnection(index);
+  m_client[connection].io_thread = index;
 
-  INFOLOG("TcpServer succ get client, fd=%d", client_fd);
+  INFOLOG("TcpServer succ get client, fd=%d", connection->getFd());
 }
 
 void TcpServer::start() {
@@ -76,9 +138,9 @@ void TcpServer::ClearClientTimerFunc() {
   for (it = m_client.begin(); it != m_client.end(); ) {
     // TcpConnection::ptr s_conn = i.second;
 		// DebugLog << "state = " << s_conn->getState();
-    if ((*it) != nullptr && (*it).use_count() > 0 && (*it)->getState() == Closed) {
+    if (it->first != nullptr && it->first.use_count() > 0 && it->first->getState() == Closed) {
       // need to delete TcpConnection
-      DEBUGLOG("TcpConection [fd:%d] will delete, state=%d", (*it)->getFd(), (*it)->getState());
+      DEBUGLOG("TcpConection [fd:%d] will delete, state=%d", it->first->getFd(), it->first->getState());
       it = m_client.erase(it);
     } else {
       it++;
@@ -88,4 +150,87 @@ void TcpServer::ClearClientTimerFunc() {
 
 }
 
-}
\ No newline at end of file
+
+void TcpServer::BalanceIOThreadsFunc() {
+  int size = m_io_thread_group->size();
+  std::vector<int64_t> requests(size, 0);
+  std::vector<int> connections(size, 0);
+  for (auto it = m_client.begin(); it != m_client.end(); ++it) {
+    ClientLoad& load = it->second;
+    if (it->first->getState() == Closed) {
+      load.requests = 0;
+      continue;
+    }
+    int64_t count = it->first->getRequestCount();
+    load.requests = count - load.request_count;
+    load.request_count = count;
+    requests[load.io_thread] += load.requests;
+    connections[load.io_thread]++;
+  }
+  for (int i = 0; i < size; ++i) {
+    m_io_thread_group->setLoad(i, requests[i], connections[i]);
+  }
+
+  // Move from the busiest to the least busy IO thread the connection whose load is closest
+  // to half of their difference, while that makes the two more even
+  int min_imbalance = Config::GetGlobalConfig()->m_io_balance_min_imbalance;
+  for (int moves = 0; moves < size; ++moves) {
+    int busiest = 0;
+    int idlest = 0;
+    for (int i = 1; i < size; ++i) {
+      if (requests[i] > requests[busiest]) {
+        busiest = i;
+      }
+      if (requests[i] < requests[idlest]) {
+        idlest = i;
+      }
+    }
+    int64_t gap = requests[busiest] - requests[idlest];
+    if (gap <= 0 || gap < min_imbalance) {
+      return;
+    }
+
+    auto candidate = m_client.end();
+    for (auto it = m_client.begin(); it != m_client.end(); ++it) {
+      const ClientLoad& load = it->second;
+      if (load.io_thread != busiest || load.moving || load.requests <= 0 || load.requests >= gap) {
+        continue;
+      }
+      if (candidate == m_client.end() || std::abs(gap - 2 * load.requests) < std::abs(gap - 2 * candidate->second.requests)) {
+        candidate = it;
+      }
+    }
+    if (candidate == m_client.end()) {
+      return;
+    }
+    requests[busiest] -= candidate->second.requests;
+    requests[idlest] += candidate->second.requests;
+    moveClient(candidate->first, busiest, idlest);
+  }
+}
+
+void TcpServer::moveClient(TcpConnection::s_ptr connection, int from, int to) {
+  m_client[connection].moving = true;
+
+  EventLoop* main_event_loop = m_main_event_loop;
+  EventLoop* event_loop = m_io_thread_group->getIOThread(to)->getEventLoop();
+  // the result comes back to the main loop, which owns m_client
+  std::function<void(bool)> done = [this, main_event_loop, connection, to](bool moved) {
+    main_event_loop->addTask([this, connection, to, moved]() {
+      auto it = m_client.find(connection);
+      if (it == m_client.end()) {
+        return;
+      }
+      it->second.moving = false;
+      if (moved) {
+        it->second.io_thread = to;
+      }
+    }, true);
+  };
+
+  m_io_thread_group->getIOThread(from)->getEventLoop()->addTask([connection, event_loop, done]() {
+    connection->moveToEventLoop(event_loop, done);
+  }, true);
+}
+
+}
@@ -1,7 +1,8 @@
 #ifndef ROCKET_NET_TCP_SERVER_H
 #define ROCKET_NET_TCP_SERVER_H
 
-#include <set>
+#include <map>
+#include <vector>
 #include "rocket/net/tcp/tcp_acceptor.h"
 #include "rocket/net/tcp/tcp_connection.h"
 #include "rocket/net/tcp/net_addr.h"
@@ -22,13 +23,28 @@ class TcpServer {
  private:
   void init();
 
+  // accepts the whole backlog of the main acceptor
   void onAccept();
 
+  // <reuse_port> mode, IO thread index accepts on its own socket
+  void onAcceptInIOThread(int index);
+
+  // in the main loop, connection runs on IO thread index
+  void addClient(TcpConnection::s_ptr connection, int index);
+
   void ClearClientTimerFunc();
 
+  // sample the requests of every IO thread and move idle connections off the busiest ones
+  void BalanceIOThreadsFunc();
+
+  void moveClient(TcpConnection::s_ptr connection, int from, int to);
+
 
  private:
-  TcpAcceptor::s_ptr m_acceptor;
+  TcpAcceptor::s_ptr m_acceptor;     // NULL in <reuse_port> mode
+
+  std::vector<TcpAcceptor::s_ptr> m_io_acceptors;     // one per IO thread in <reuse_port> mode
+  std::vector<FdEvent*> m_io_listen_fd_events;
 
   NetAddr::s_ptr m_local_addr;    
 
@@ -36,14 +52,23 @@ class TcpServer {
   
   IOThreadGroup* m_io_thread_group {NULL};
 
-  FdEvent* m_listen_fd_event;
+  FdEvent* m_listen_fd_event {NULL};
 
   int m_client_counts {0};
 
-  std::set<TcpConnection::s_ptr> m_client;
+  struct ClientLoad {
+    int io_thread {0};
+    int64_t request_count {0};    // at the last sample
+    int64_t requests {0};         // in the last interval
+    bool moving {false};
+  };
+
+  std::map<TcpConnection::s_ptr, ClientLoad> m_client;
 
   TimerEvent::s_ptr m_clear_client_timer_event;
 
+  TimerEvent::s_ptr m_balance_timer_event;
+
 };
 
 }
@@ -6,9 +6,19 @@
 
 namespace rocket {
 
+// first slot and tick shift of every level
+static const int g_level_base[] = {0, 256, 320, 384};
+static const int g_level_shift[] = {0, 8, 14, 20};
+
+static const int64_t g_max_delay = (int64_t)1 << 26;
+
 
 Timer::Timer() : FdEvent() {
 
+  memset(m_slots, 0, sizeof(m_slots));
+  memset(m_bitmap, 0, sizeof(m_bitmap));
+  m_current_tick = getNowMs();
+  m_thread_id = getThreadId();
 
   m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
   DEBUGLOG("timer fd=%d", m_fd);
@@ -17,136 +27,361 @@ Timer::Timer() : FdEvent() {
 }
 
 Timer::~Timer() {
+  for (int i = 0; i < kSlots; ++i) {
+    TimerEvent* event = takeSlot(i);
+    while (event) {
+      TimerEvent* next = event->m_next;
+      event->m_prev = NULL;
+      event->m_next = NULL;
+      event->m_slot = -1;
+      event->m_owner = NULL;
+      event->m_self.reset();
+      event = next;
+    }
+  }
+  m_count = 0;
 }
 
 
-void Timer::onTimer() {
-  // DEBUGLOG("ontimer");
-  char buf[8];
-  while(1) {
-    if ((read(m_fd, buf, 8) == -1) && errno == EAGAIN) {
-      break;
+bool Timer::isInLoopThread() {
+  return getThreadId() == m_thread_id;
+}
+
+
+void Timer::link(TimerEvent* event, int slot) {
+  event->m_prev = NULL;
+  event->m_next = m_slots[slot];
+  if (event->m_next) {
+    event->m_next->m_prev = event;
+  }
+  m_slots[slot] = event;
+  m_bitmap[slot / 64] |= (uint64_t)1 << (slot % 64);
+  event->m_slot = slot;
+  event->m_owner = this;
+  m_count++;
+}
+
+TimerEvent::s_ptr Timer::unlink(TimerEvent* event) {
+  int slot = event->m_slot;
+  if (event->m_prev) {
+    event->m_prev->m_next = event->m_next;
+  } else {
+    m_slots[slot] = event->m_next;
+    if (m_slots[slot] == NULL) {
+      m_bitmap[slot / 64] &= ~((uint64_t)1 << (slot % 64));
     }
   }
+  if (event->m_next) {
+    event->m_next->m_prev = event->m_prev;
+  }
+  event->m_prev = NULL;
+  event->m_next = NULL;
+  event->m_slot = -1;
+  event->m_owner = NULL;
+  m_count--;
+
+  TimerEvent::s_ptr self;
+  self.swap(event->m_self);
+  return self;
+}
 
+void Timer::skipIdleTicks() {
+  if (m_count != 0) {
+    return;
+  }
+  // nothing to cascade, jump straight to now instead of walking the idle ticks
   int64_t now = getNowMs();
+  if (now > m_current_tick) {
+    m_current_tick = now;
+  }
+}
 
-  std::vector<TimerEvent::s_ptr> tmps;
-  std::vector<std::pair<int64_t, std::function<void()>>> tasks;
+TimerEvent* Timer::takeSlot(int slot) {
+  TimerEvent* head = m_slots[slot];
+  m_slots[slot] = NULL;
+  m_bitmap[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+  return head;
+}
 
-  ScopeMutex<Mutex> lock(m_mutex);
-  auto it = m_pending_events.begin();
 
-  for (it = m_pending_events.begin(); it != m_pending_events.end(); ++it) {
-    if ((*it).first <= now) {
-      if (!(*it).second->isCancled()) {
-        tmps.push_back((*it).second);
-        tasks.push_back(std::make_pair((*it).second->getArriveTime(), (*it).second->getCallBack()));
+void Timer::insert(TimerEvent::s_ptr event) {
+  if (event->m_owner == this) {
+    unlink(event.get());
+  } else if (event->m_owner != NULL) {
+    ERRORLOG("TimerEvent is already scheduled in another loop, ignore it");
+    return;
+  }
+
+  int64_t expire = event->getArriveTime();
+  if (expire < m_current_tick) {
+    expire = m_current_tick;
+  }
+  int64_t delay = expire - m_current_tick;
+  if (delay >= g_max_delay) {
+    // beyond the last level, it is cascaded again when this slot is reached
+    expire = m_current_tick + g_max_delay - 1;
+    delay = g_max_delay - 1;
+  }
+
+  int level = 0;
+  while (level < kLevels - 1 && delay >= ((int64_t)1 << g_level_shift[level + 1])) {
+    level++;
+  }
+
+  // the tick at which this slot is fired (level 0) or cascaded (upper levels)
+  int64_t tick = expire;
+  int slot = g_level_base[level] + (int)(expire & (kLevel0Size - 1));
+  if (level > 0) {
+    tick = (expire >> g_level_shift[level]) << g_level_shift[level];
+    slot = g_level_base[level] + (int)((expire >> g_level_shift[level]) & (kLevelSize - 1));
+  }
+
+  event->m_self = event;
+  link(event.get(), slot);
+
+  if (m_next_tick == -1 || tick < m_next_tick) {
+    m_next_tick = tick;
+  }
+}
+
+
+void Timer::cascade(int level, int index) {
+  TimerEvent* event = takeSlot(g_level_base[level] + index);
+  while (event) {
+    TimerEvent* next = event->m_next;
+    event->m_prev = NULL;
+    event->m_next = NULL;
+    event->m_slot = -1;
+    event->m_owner = NULL;
+    m_count--;
+
+    TimerEvent::s_ptr self;
+    self.swap(event->m_self);
+    if (!self->isCancled()) {
+      insert(self);
+    }
+    event = next;
+  }
+}
+
+
+void Timer::advance(int64_t now, std::vector<TimerEvent::s_ptr>& expired) {
+  while (m_current_tick <= now) {
+    if (m_count == 0) {
+      m_current_tick = now + 1;
+      break;
+    }
+
+    int index = (int)(m_current_tick & (kLevel0Size - 1));
+    if (index == 0) {
+      for (int level = 1; level < kLevels; ++level) {
+        int i = (int)((m_current_tick >> g_level_shift[level]) & (kLevelSize - 1));
+        cascade(level, i);
+        if (i != 0) {
+          break;
+        }
       }
-    } else {
+    } else if ((m_bitmap[0] | m_bitmap[1] | m_bitmap[2] | m_bitmap[3]) == 0) {
+      // level 0 is empty, skip to the next cascade
+      int64_t boundary = ((m_current_tick >> kLevel0Bits) + 1) << kLevel0Bits;
+      m_current_tick = boundary < now + 1 ? boundary : now + 1;
+      continue;
+    }
+
+    TimerEvent* event = takeSlot(index);
+    while (event) {
+      TimerEvent* next = event->m_next;
+      event->m_prev = NULL;
+      event->m_next = NULL;
+      event->m_slot = -1;
+      event->m_owner = NULL;
+      m_count--;
+
+      TimerEvent::s_ptr self;
+      self.swap(event->m_self);
+      if (!self->isCancled()) {
+        expired.push_back(self);
+      }
+      event = next;
+    }
+    m_current_tick++;
+  }
+}
+
+
+// distance from start to the first set bit in a circular bitmap of nbits (multiple of 64), -1 if none
+static int findNextSlot(const uint64_t* bitmap, int nbits, int start) {
+  int distance = 0;
+  while (distance < nbits) {
+    int i = (start + distance) & (nbits - 1);
+    uint64_t word = bitmap[i / 64] >> (i % 64);
+    if (word) {
+      int d = distance + __builtin_ctzll(word);
+      return d < nbits ? d : -1;
+    }
+    distance += 64 - (i % 64);
+  }
+  return -1;
+}
+
+int64_t Timer::calcNextTick() {
+  if (m_count == 0) {
+    return -1;
+  }
+
+  int64_t next = -1;
+  int d = findNextSlot(m_bitmap, kLevel0Size, (int)(m_current_tick & (kLevel0Size - 1)));
+  if (d >= 0) {
+    next = m_current_tick + d;
+  }
+
+  for (int level = 1; level < kLevels; ++level) {
+    int shift = g_level_shift[level];
+    int64_t boundary = ((m_current_tick + ((int64_t)1 << shift) - 1) >> shift) << shift;
+    int start = (int)((boundary >> shift) & (kLevelSize - 1));
+    d = findNextSlot(&m_bitmap[g_level_base[level] / 64], kLevelSize, start);
+    if (d >= 0) {
+      int64_t tick = boundary + ((int64_t)d << shift);
+      if (next == -1 || tick < next) {
+        next = tick;
+      }
+    }
+  }
+  return next;
+}
+
+
+void Timer::onTimer() {
+  // DEBUGLOG("ontimer");
+  char buf[8];
+  while(1) {
+    if ((read(m_fd, buf, 8) == -1) && errno == EAGAIN) {
       break;
     }
   }
+  m_armed_time = -1;
 
-  m_pending_events.erase(m_pending_events.begin(), it);
-  lock.unlock();
+  addCrossThreadEvents();
 
+  int64_t now = getNowMs();
+  std::vector<TimerEvent::s_ptr> expired;
+  advance(now, expired);
 
-  for (auto i = tmps.begin(); i != tmps.end(); ++i) {
+  for (auto i = expired.begin(); i != expired.end(); ++i) {
     if ((*i)->isRepeated()) {
       (*i)->resetArriveTime();
-      addTimerEvent(*i);
+      insert(*i);
     }
   }
 
+  m_next_tick = calcNextTick();
   resetArriveTime();
 
-  for (auto i: tasks) {
-    if (i.second) {
-      i.second();
+  for (auto i = expired.begin(); i != expired.end(); ++i) {
+    // may be cancled by a callback run before it
+    if (!(*i)->isCancled() && (*i)->m_task) {
+      (*i)->m_task();
     }
   }
 
 }
 
-void Timer::resetArriveTime() {
+int64_t Timer::getNextArriveTime() {
+  return m_next_tick;
+}
+
+
+void Timer::addCrossThreadEvents() {
+  if (!m_has_cross_thread_events.exchange(false)) {
+    return;
+  }
+  std::vector<TimerEvent::s_ptr> tmps;
   ScopeMutex<Mutex> lock(m_mutex);
-  auto tmp = m_pending_events;
+  tmps.swap(m_cross_thread_events);
   lock.unlock();
 
-  if (tmp.size() == 0) {
-    return;
+  skipIdleTicks();
+  for (auto i = tmps.begin(); i != tmps.end(); ++i) {
+    insert(*i);
   }
+}
 
-  int64_t now = getNowMs();
 
-  auto it = tmp.begin();
-  int64_t inteval = 0;
-  if (it->second->getArriveTime() > now) {
-    inteval = it->second->getArriveTime() - now;
-  } else {
-    inteval = 100;
+void Timer::resetArriveTime() {
+  armTimerFd(m_next_tick);
+
+  // a cross thread add may have set the timerfd just before we overwrote it
+  while (m_has_cross_thread_events.load()) {
+    addCrossThreadEvents();
+    armTimerFd(m_next_tick);
   }
+}
 
-  timespec ts;
-  memset(&ts, 0, sizeof(ts));
-  ts.tv_sec = inteval / 1000;
-  ts.tv_nsec = (inteval % 1000) * 1000000;
+void Timer::armTimerFd(int64_t arrive_time) {
+  if (arrive_time == m_armed_time) {
+    return;
+  }
+  m_armed_time = arrive_time;
 
   itimerspec value;
   memset(&value, 0, sizeof(value));
-  value.it_value = ts;
+
+  if (arrive_time != -1) {
+    int64_t inteval = arrive_time - getNowMs();
+    if (inteval > 0) {
+      value.it_value.tv_sec = inteval / 1000;
+      value.it_value.tv_nsec = (inteval % 1000) * 1000000;
+    } else {
+      // already due, fire as soon as possible (a zero it_value would disarm the timer)
+      value.it_value.tv_nsec = 1000;
+    }
+  }
 
   int rt = timerfd_settime(m_fd, 0, &value, NULL);
   if (rt != 0) {
     ERRORLOG("timerfd_settime error, errno=%d, error=%s", errno, strerror(errno));
   }
-  // DEBUGLOG("timer reset to %lld", now + inteval);
+  // DEBUGLOG("timer reset to %lld", arrive_time);
 
 }
 
 void Timer::addTimerEvent(TimerEvent::s_ptr event) {
-  bool is_reset_timerfd = false;
-
-  ScopeMutex<Mutex> lock(m_mutex);
-  if (m_pending_events.empty()) {
-    is_reset_timerfd = true;
-  } else {
-    auto it = m_pending_events.begin();
-    if ((*it).second->getArriveTime() > event->getArriveTime()) {
-      is_reset_timerfd = true;
+  if (!isInLoopThread()) {
+    ScopeMutex<Mutex> lock(m_mutex);
+    m_cross_thread_events.push_back(event);
+    lock.unlock();
+    m_has_cross_thread_events.store(true);
+
+    // wake up the loop thread, it inserts the event in onTimer
+    itimerspec value;
+    memset(&value, 0, sizeof(value));
+    value.it_value.tv_nsec = 1000;
+    if (timerfd_settime(m_fd, 0, &value, NULL) != 0) {
+      ERRORLOG("timerfd_settime error, errno=%d, error=%s", errno, strerror(errno));
     }
+    return;
   }
-  m_pending_events.emplace(event->getArriveTime(), event);
-  lock.unlock();
 
-  if (is_reset_timerfd) {
+  skipIdleTicks();
+  insert(event);
+
+  // a timerfd set to an earlier time just wakes up once more for nothing
+  if (m_armed_time == -1 || m_next_tick < m_armed_time) {
     resetArriveTime();
   }
 
-
 }
 
 void Timer::deleteTimerEvent(TimerEvent::s_ptr event) {
   event->setCancled(true);
 
-  ScopeMutex<Mutex> lock(m_mutex);
-
-  auto begin = m_pending_events.lower_bound(event->getArriveTime());
-  auto end = m_pending_events.upper_bound(event->getArriveTime());
-
-  auto it = begin;
-  for (it = begin; it != end; ++it) {
-    if (it->second == event) {
-      break;
+  if (isInLoopThread() && event->m_owner == this) {
+    unlink(event.get());
+    if (m_count == 0) {
+      m_next_tick = -1;
     }
   }
 
-  if (it != end) {
-    m_pending_events.erase(it);
-  }
-  lock.unlock();
-
   DEBUGLOG("success delete TimerEvent at arrive time %lld", event->getArriveTime());
 
 }
@@ -154,5 +389,5 @@ void Timer::deleteTimerEvent(TimerEvent::s_ptr event) {
 
 
 
-  
-}
\ No newline at end of file
+
+}
@@ -1,13 +1,28 @@
 #ifndef ROCKET_NET_TIMER_H
 #define ROCKET_NET_TIMER_H
 
-#include <map>
+#include <atomic>
+#include <vector>
+#include <sys/types.h>
 #include "rocket/common/mutex.h"
 #include "rocket/net/fd_event.h"
 #include "rocket/net/timer_event.h"
 
 namespace rocket {
 
+/*
+ * Hierarchical timing wheel with 1ms ticks.
+ *
+ * Level 0 has 256 slots of 1ms, levels 1..3 have 64 slots each covering
+ * 256ms, 16.4s and 17.5min. An event lives in the lowest level that can hold
+ * its delay and is cascaded down when the level below wraps around, so
+ * add/delete are O(1) list operations.
+ *
+ * The wheel is owned by the loop thread that created the Timer and is not
+ * locked. Events added from other threads are queued under m_mutex and picked
+ * up by the loop thread; deleting from another thread only marks the event
+ * cancled and it is dropped when its slot is reached.
+ */
 class Timer : public FdEvent {
  public:
 
@@ -21,12 +36,62 @@ class Timer : public FdEvent {
 
   void onTimer(); 
 
+  // next time (ms) the wheel has to be advanced, -1 if there is no pending event
+  int64_t getNextArriveTime();
+
+  // count of scheduled events, loop thread only
+  size_t size() const {
+    return m_count;
+  }
+
  private:
+  static const int kLevel0Bits = 8;
+  static const int kLevelBits = 6;
+  static const int kLevel0Size = 1 << kLevel0Bits;
+  static const int kLevelSize = 1 << kLevelBits;
+  static const int kLevels = 4;
+  static const int kSlots = kLevel0Size + (kLevels - 1) * kLevelSize;
+  static const int kBitmapWords = kSlots / 64;
+
+  bool isInLoopThread();
+
+  void skipIdleTicks();
+
+  void insert(TimerEvent::s_ptr event);
+
+  void link(TimerEvent* event, int slot);
+
+  TimerEvent::s_ptr unlink(TimerEvent* event);
+
+  // detach all events of the slot, return the list head
+  TimerEvent* takeSlot(int slot);
+
+  void cascade(int level, int index);
+
+  void advance(int64_t now, std::vector<TimerEvent::s_ptr>& expired);
+
+  int64_t calcNextTick();
+
+  void addCrossThreadEvents();
+
   void resetArriveTime();
 
+  void armTimerFd(int64_t arrive_time);
+
  private:
-  std::multimap<int64_t, TimerEvent::s_ptr> m_pending_events;
-  Mutex m_mutex;
+  TimerEvent* m_slots[kSlots];
+  uint64_t m_bitmap[kBitmapWords];
+
+  int64_t m_current_tick {0};   // next tick (ms) to be processed
+  int64_t m_next_tick {-1};     // lower bound of the next tick with work, -1 if empty
+  int64_t m_armed_time {-1};    // expire time the timerfd is set to
+  size_t m_count {0};
+
+  pid_t m_thread_id {0};
+
+  Mutex m_mutex;                // guards m_cross_thread_events only
+  std::vector<TimerEvent::s_ptr> m_cross_thread_events;
+  std::atomic<bool> m_has_cross_thread_events {false};
 
 };
 
@@ -34,4 +99,4 @@ class Timer : public FdEvent {
 
 }
 
-#endif
\ No newline at end of file
+#endif
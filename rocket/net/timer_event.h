@@ -1,11 +1,14 @@
 #ifndef ROCKET_NET_TIMEREVENT
 #define ROCKET_NET_TIMEREVENT
 
+#include <atomic>
 #include <functional>
 #include <memory>
 
 namespace rocket {
 
+class Timer;
+
 class TimerEvent {
 
  public:
@@ -18,11 +21,11 @@ class TimerEvent {
   }
 
   void setCancled(bool value) {
-    m_is_cancled = value;
+    m_is_cancled.store(value, std::memory_order_release);
   }
 
   bool isCancled() {
-    return m_is_cancled;
+    return m_is_cancled.load(std::memory_order_acquire);
   }
 
   bool isRepeated() {
@@ -36,17 +39,24 @@ class TimerEvent {
   void resetArriveTime();
 
  private:
+  friend class Timer;
+
   int64_t m_arrive_time;    // ms
   int64_t m_interval;       // ms
   bool m_is_repeated {false};
-  bool m_is_cancled {false}; 
+  std::atomic<bool> m_is_cancled {false};
 
   std::function<void()> m_task;
 
-
+  // wheel slot list links, only touched by the owning Timer in its loop thread
+  TimerEvent* m_prev {NULL};
+  TimerEvent* m_next {NULL};
+  int m_slot {-1};          // -1 if not scheduled
+  Timer* m_owner {NULL};
+  s_ptr m_self;             // holds the event while it is scheduled
 
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,144 @@
+#include <assert.h>
+#include "rocket/net/worker_pool.h"
+#include "rocket/common/log.h"
+
+namespace rocket {
+
+static thread_local bool t_in_worker_thread = false;
+
+
+WorkerPool::WorkerPool(int size) {
+  int rt = pthread_cond_init(&m_sleep_condition, NULL);
+  assert(rt == 0);
+
+  m_workers.resize(size);
+  for (int i = 0; i < size; ++i) {
+    m_workers[i] = new Worker();
+    m_workers[i]->pool = this;
+    m_workers[i]->index = i;
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  stop();
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    delete m_workers[i];
+  }
+  pthread_cond_destroy(&m_sleep_condition);
+}
+
+
+void WorkerPool::start() {
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    pthread_create(&m_workers[i]->thread, NULL, &WorkerPool::Main, m_workers[i]);
+  }
+  INFOLOG("worker pool started with %d threads", (int)m_workers.size());
+}
+
+void WorkerPool::stop() {
+  if (m_stop.exchange(true)) {
+    return;
+  }
+  {
+    ScopeMutex<Mutex> lock(m_sleep_mutex);
+    pthread_cond_broadcast(&m_sleep_condition);
+  }
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    if (m_workers[i]->thread != 0) {
+      pthread_join(m_workers[i]->thread, NULL);
+    }
+  }
+}
+
+
+void WorkerPool::submit(std::function<void()> task) {
+  Worker* worker = m_workers[m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size()];
+  {
+    ScopeMutex<Mutex> lock(worker->mutex);
+    worker->tasks.push_back(std::move(task));
+  }
+
+  // a worker going to sleep counts itself in m_sleeping before it checks m_pending, so one of
+  // the two sides sees the other
+  m_pending++;
+  if (m_sleeping.load() > 0) {
+    ScopeMutex<Mutex> lock(m_sleep_mutex);
+    pthread_cond_signal(&m_sleep_condition);
+  }
+}
+
+
+bool WorkerPool::take(int index, std::function<void()>& task) {
+  Worker* self = m_workers[index];
+  {
+    ScopeMutex<Mutex> lock(self->mutex);
+    if (!self->tasks.empty()) {
+      task = std::move(self->tasks.front());
+      self->tasks.pop_front();
+      m_pending--;
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < m_workers.size(); ++i) {
+    Worker* victim = m_workers[(index + i) % m_workers.size()];
+    ScopeMutex<Mutex> lock(victim->mutex);
+    if (!victim->tasks.empty()) {
+      // the victim works from the front, take the other end
+      task = std::move(victim->tasks.back());
+      victim->tasks.pop_back();
+      m_pending--;
+      self->stolen++;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void* WorkerPool::Main(void* arg) {
+  Worker* worker = static_cast<Worker*>(arg);
+  WorkerPool* pool = worker->pool;
+  t_in_worker_thread = true;
+
+  std::function<void()> task;
+  while (true) {
+    if (pool->take(worker->index, task)) {
+      task();
+      task = nullptr;
+      worker->executed++;
+      continue;
+    }
+
+    ScopeMutex<Mutex> lock(pool->m_sleep_mutex);
+    pool->m_sleeping++;
+    while (pool->m_pending.load() <= 0 && !pool->m_stop.load()) {
+      pthread_cond_wait(&pool->m_sleep_condition, pool->m_sleep_mutex.getMutex());
+    }
+    pool->m_sleeping--;
+    if (pool->m_pending.load() <= 0 && pool->m_stop.load()) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+
+bool WorkerPool::IsInWorkerThread() {
+  return t_in_worker_thread;
+}
+
+int WorkerPool::size() {
+  return m_workers.size();
+}
+
+WorkerPool::Stats WorkerPool::getStats() {
+  Stats stats;
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    stats.executed += m_workers[i]->executed.load();
+    stats.stolen += m_workers[i]->stolen.load();
+  }
+  return stats;
+}
+
+}
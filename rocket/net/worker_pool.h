@@ -0,0 +1,79 @@
+#ifndef ROCKET_NET_WORKER_POOL_H
+#define ROCKET_NET_WORKER_POOL_H
+
+#include <pthread.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "rocket/common/mutex.h"
+
+namespace rocket {
+
+/*
+ * Threads that run business handlers away from the IO threads.
+ *
+ * Every worker has a deque of its own. submit() spreads tasks over the deques round
+ * robin, a worker takes the oldest task of its deque and, when that is empty, steals
+ * the newest one of another worker. Idle workers sleep until a task is submitted.
+ */
+class WorkerPool {
+
+ public:
+  struct Stats {
+    int64_t executed {0};
+    int64_t stolen {0};     // executed by another worker than the one it was submitted to
+  };
+
+ public:
+  WorkerPool(int size);
+
+  ~WorkerPool();
+
+  void start();
+
+  // can be called from any thread
+  void submit(std::function<void()> task);
+
+  // lets the workers finish the queued tasks and joins them
+  void stop();
+
+  int size();
+
+  Stats getStats();
+
+  // whether the calling thread is a worker of any WorkerPool
+  static bool IsInWorkerThread();
+
+ private:
+  struct Worker {
+    WorkerPool* pool {NULL};
+    int index {0};
+    pthread_t thread {0};
+    Mutex mutex;
+    std::deque<std::function<void()>> tasks;
+    std::atomic<int64_t> executed {0};
+    std::atomic<int64_t> stolen {0};
+  };
+
+  static void* Main(void* arg);
+
+  // a task of worker index or stolen from another one
+  bool take(int index, std::function<void()>& task);
+
+ private:
+  std::vector<Worker*> m_workers;
+
+  std::atomic<uint32_t> m_next {0};
+  std::atomic<int> m_pending {0};     // tasks in all deques
+  std::atomic<int> m_sleeping {0};
+  std::atomic<bool> m_stop {false};
+
+  Mutex m_sleep_mutex;
+  pthread_cond_t m_sleep_condition;
+
+};
+
+}
+
+#endif
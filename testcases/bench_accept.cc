@@ -0,0 +1,164 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/common/msg_id_util.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// Reconnect flood: 8 client threads open a connection, make one call on it and close it,
+// again and again for 2 seconds. Server with 4 IO threads:
+// 1. the main thread accepts and hands every connection to an IO thread.
+// 2. <reuse_port>, every IO thread accepts on a SO_REUSEPORT socket of its own.
+// Every setting runs in a child process, the dispatcher is global.
+
+static const int g_client_threads = 8;
+static const int64_t g_duration_ns = 2000 * 1000000LL;
+
+static int g_port = 0;
+
+static std::vector<char> g_request;
+
+static int64_t g_end_ns = 0;
+
+static bool readFull(int fd, char* buf, int size) {
+  int done = 0;
+  while (done < size) {
+    int rt = read(fd, buf + done, size - done);
+    if (rt <= 0) {
+      return false;
+    }
+    done += rt;
+  }
+  return true;
+}
+
+// connect, send the request and read its whole response frame
+static bool callOnce(const sockaddr_in& addr) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0
+    && write(fd, &g_request[0], g_request.size()) == (ssize_t)g_request.size();
+
+  char head[5];
+  if (ok) {
+    ok = readFull(fd, head, sizeof(head));
+  }
+  if (ok) {
+    int32_t pk_len = 0;
+    memcpy(&pk_len, &head[1], sizeof(pk_len));
+    pk_len = ntohl(pk_len);
+    std::vector<char> rest(pk_len - sizeof(head));
+    ok = readFull(fd, &rest[0], rest.size());
+  }
+  close(fd);
+  return ok;
+}
+
+struct ClientThread {
+  int calls {0};
+  int failed {0};
+  LatencyHistogram latency;
+};
+
+void* clientMain(void* arg) {
+  ClientThread* thread = reinterpret_cast<ClientThread*>(arg);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(g_port);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  while (true) {
+    int64_t begin = benchNowNs();
+    if (begin >= g_end_ns) {
+      break;
+    }
+    if (callOnce(addr)) {
+      thread->calls++;
+      thread->latency.add(benchNowNs() - begin);
+    } else {
+      thread->failed++;
+    }
+  }
+  return NULL;
+}
+
+
+static void run(const char* name, bool reuse_port, int port) {
+  g_port = port;
+  startBenchServer(port, [reuse_port](rocket::Config* config) {
+    config->m_io_threads = 4;
+    config->m_reuse_port = reuse_port;
+  });
+
+  makeOrderRequest request;
+  request.set_price(100);
+  request.set_goods("apple");
+  std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+  message->m_msg_id = rocket::MsgIDUtil::GenMsgID();
+  message->m_method_name = "Order.makeOrder";
+  request.SerializeToString(&message->m_pb_data);
+  std::vector<rocket::AbstractProtocol::s_ptr> messages;
+  messages.push_back(message);
+  rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(0);
+  rocket::TinyPBCoder coder;
+  coder.encode(messages, buffer);
+  buffer->readFromBuffer(g_request, buffer->readAble());
+
+  std::vector<ClientThread> threads(g_client_threads);
+  std::vector<pthread_t> thread_ids(g_client_threads);
+  g_end_ns = benchNowNs() + g_duration_ns;
+  for (int i = 0; i < g_client_threads; ++i) {
+    pthread_create(&thread_ids[i], NULL, &clientMain, &threads[i]);
+  }
+
+  int calls = 0;
+  int failed = 0;
+  LatencyHistogram latency;
+  for (int i = 0; i < g_client_threads; ++i) {
+    pthread_join(thread_ids[i], NULL);
+    calls += threads[i].calls;
+    failed += threads[i].failed;
+    latency.merge(threads[i].latency);
+  }
+
+  printf("%-16s %10.0f %10.1f %10.1f %8d\n", name, calls / (g_duration_ns / 1e9),
+    latency.percentile(50) / 1000.0, latency.percentile(99) / 1000.0, failed);
+  exit(0);
+}
+
+
+int main(int argc, char* argv[]) {
+  printf("%-16s %10s %10s %10s %8s\n", "acceptor", "conns/s", "p50 us", "p99 us", "failed");
+  const char* names[] = {"main thread", "reuse_port"};
+  for (int i = 0; i < 2; ++i) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(names[i], i == 1, 12397 + i);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      exit(1);
+    }
+  }
+  return 0;
+}
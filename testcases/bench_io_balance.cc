@@ -0,0 +1,184 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/common/msg_id_util.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// Skewed load on a server with 2 IO threads. 8 connections are opened one after another,
+// every other one is hot (16 requests in flight), the others are cold (a request every ms).
+// Round robin puts all hot connections on the same IO thread. With <io_balance> on, the
+// busy thread hands idle connections over until both carry about the same load.
+// Every handler holds its IO thread for 50us without using the CPU, so the result does not
+// depend on the cores of the box. Latency is measured after a warm up of 3 intervals.
+// Every setting runs in a child process, the dispatcher is global.
+
+static const int g_connections = 8;
+static const int g_hot_in_flight = 16;
+static const int g_interval_ms = 200;
+
+static rocket::NetAddr::s_ptr g_addr;
+
+
+struct Connection {
+  bool hot {false};
+  rocket::TcpClient* client {NULL};
+};
+
+struct ClientRun {
+  std::vector<Connection> connections;
+  int connected {0};
+  int failed {0};
+  int64_t measure_begin_ns {0};
+  int64_t end_ns {0};
+  std::string pb_data;
+  std::shared_ptr<rocket::TimerEvent> cold_timer;
+  LatencyHistogram all;
+  LatencyHistogram hot;
+  LatencyHistogram cold;
+};
+
+static ClientRun* g_run = NULL;
+
+static void sendNext(Connection* connection) {
+  int64_t begin = benchNowNs();
+  if (begin >= g_run->end_ns) {
+    return;
+  }
+  std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+  message->m_msg_id = rocket::MsgIDUtil::GenMsgID();
+  message->m_method_name = "Order.makeOrder";
+  message->m_pb_data = g_run->pb_data;
+
+  connection->client->readMessage(message->m_msg_id, [connection, begin](rocket::AbstractProtocol::s_ptr msg) {
+    if (!msg) {
+      printf("connection closed by the server\n");
+      exit(1);
+    }
+    std::shared_ptr<rocket::TinyPBProtocol> response = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg);
+    if (response->m_err_code != 0) {
+      g_run->failed++;
+    }
+    if (begin >= g_run->measure_begin_ns) {
+      int64_t cost = benchNowNs() - begin;
+      g_run->all.add(cost);
+      (connection->hot ? g_run->hot : g_run->cold).add(cost);
+    }
+    if (connection->hot) {
+      sendNext(connection);
+    }
+  });
+  connection->client->writeMessage(message, [](rocket::AbstractProtocol::s_ptr) {});
+}
+
+static void start() {
+  int64_t now = benchNowNs();
+  g_run->measure_begin_ns = now + 3 * g_interval_ms * 1000000LL;
+  g_run->end_ns = g_run->measure_begin_ns + 2000 * 1000000LL;
+  for (size_t i = 0; i < g_run->connections.size(); ++i) {
+    if (g_run->connections[i].hot) {
+      for (int j = 0; j < g_hot_in_flight; ++j) {
+        sendNext(&g_run->connections[i]);
+      }
+    }
+  }
+  g_run->cold_timer = std::make_shared<rocket::TimerEvent>(1, true, []() {
+    for (size_t i = 0; i < g_run->connections.size(); ++i) {
+      if (!g_run->connections[i].hot) {
+        sendNext(&g_run->connections[i]);
+      }
+    }
+  });
+  rocket::EventLoop::GetCurrentEventLoop()->addTimerEvent(g_run->cold_timer);
+}
+
+// the server accepts in this order, so round robin alternates hot and cold
+static void connectNext() {
+  Connection* connection = &g_run->connections[g_run->connected];
+  connection->client->connect([connection]() {
+    if (connection->client->getConnectErrorCode() != 0) {
+      printf("connect error %s\n", connection->client->getConnectErrorInfo().c_str());
+      exit(1);
+    }
+    g_run->connected++;
+    if (g_run->connected == (int)g_run->connections.size()) {
+      start();
+    } else {
+      connectNext();
+    }
+  });
+}
+
+static void run(const char* name, bool balance, int port) {
+  std::shared_ptr<BenchOrderImpl> service = std::make_shared<BenchOrderImpl>([](const makeOrderRequest&) {
+    usleep(50);
+  });
+  g_addr = startBenchServer(port, [balance](rocket::Config* config) {
+    config->m_io_threads = 2;
+    config->m_io_balance_enable = balance;
+    config->m_io_balance_interval = g_interval_ms;
+    config->m_io_balance_min_imbalance = 100;
+  }, service);
+
+  ClientRun client_run;
+  g_run = &client_run;
+  makeOrderRequest request;
+  request.set_price(100);
+  request.set_goods("apple");
+  request.SerializeToString(&client_run.pb_data);
+
+  // all connections share the EventLoop of this thread
+  std::vector<rocket::TcpClient*> clients;
+  client_run.connections.resize(g_connections);
+  for (int i = 0; i < g_connections; ++i) {
+    clients.push_back(new rocket::TcpClient(g_addr));
+    client_run.connections[i].client = clients[i];
+    client_run.connections[i].hot = (i % 2 == 0);
+  }
+  rocket::EventLoop* event_loop = rocket::EventLoop::GetCurrentEventLoop();
+  std::shared_ptr<rocket::TimerEvent> stop_timer = std::make_shared<rocket::TimerEvent>(3 * g_interval_ms + 2000 + 500, false, [event_loop]() {
+    event_loop->stop();
+  });
+  event_loop->addTimerEvent(stop_timer);
+  connectNext();
+  event_loop->loop();
+
+  if (client_run.failed != 0) {
+    printf("%d requests failed\n", client_run.failed);
+    exit(1);
+  }
+  LatencyHistogram& all = client_run.all;
+  printf("%-12s %10.0f %10.1f %10.1f %10.1f %10.1f\n", name, all.count() / 2.0, all.percentile(50) / 1000.0,
+    all.percentile(99) / 1000.0, client_run.hot.percentile(99) / 1000.0, client_run.cold.percentile(99) / 1000.0);
+  exit(0);
+}
+
+
+int main(int argc, char* argv[]) {
+  printf("%-12s %10s %10s %10s %10s %10s\n", "placement", "rpc/s", "p50", "p99", "hot p99", "cold p99");
+  const char* names[] = {"round robin", "io_balance"};
+  for (int i = 0; i < 2; ++i) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(names[i], i == 1, 12395 + i);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      exit(1);
+    }
+  }
+  printf("latency in us\n");
+  return 0;
+}
@@ -0,0 +1,128 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/eventloop.h"
+#include "bench_util.h"
+
+// Cost of a log call with 1 to 16 threads that each INFOLOG a burst of 50000 lines, formatted
+// by the threads, then in <log_binary> mode by the log thread. The 8 MB ring of a thread holds
+// the whole burst, so this is the hot path and not the speed of the disk.
+// Lines go to <dir>/bench_log_rpc_*, argv[1] or /tmp/, and are removed at the end.
+// CPU is the thread CPU time per line. Every setting runs in a child process, the logger is global.
+
+static const int g_lines = 50000;
+
+static std::atomic<bool> g_start {false};
+
+struct LogThread {
+  int64_t end_ns {0};
+  int64_t cpu_ns {0};
+};
+
+static int64_t threadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void* logMain(void* arg) {
+  LogThread* thread = reinterpret_cast<LogThread*>(arg);
+  while (!g_start) {
+    usleep(100);
+  }
+  std::string method = "Order.makeOrder";
+  int64_t cpu_begin = threadCpuNs();
+  for (int i = 0; i < g_lines; ++i) {
+    INFOLOG("call [%s] done, msg_id=%d, response bytes=%d", method.c_str(), i, 128 + i % 64);
+  }
+  thread->end_ns = benchNowNs();
+  thread->cpu_ns = threadCpuNs() - cpu_begin;
+  return NULL;
+}
+
+
+static void run(const char* name, bool binary, int thread_count, const char* dir) {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config* config = rocket::Config::GetGlobalConfig();
+  config->m_log_level = "INFO";
+  config->m_log_file_name = "bench_log";
+  config->m_log_file_path = dir;
+  config->m_log_max_file_size = 1000000000;
+  config->m_log_sync_inteval = 10;
+  config->m_log_binary = binary;
+  config->m_log_thread_buffer_size = 8 * 1024 * 1024;
+  rocket::Logger::InitGlobalLogger(1);
+
+  std::vector<LogThread> threads(thread_count);
+  std::vector<pthread_t> thread_ids(thread_count);
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&thread_ids[i], NULL, &logMain, &threads[i]);
+  }
+
+  // this thread's EventLoop runs Logger::syncLoop
+  rocket::EventLoop* event_loop = rocket::EventLoop::GetCurrentEventLoop();
+  std::shared_ptr<rocket::TimerEvent> stop_timer = std::make_shared<rocket::TimerEvent>(2000, false, [event_loop]() {
+    event_loop->stop();
+  });
+  event_loop->addTimerEvent(stop_timer);
+  int64_t begin = benchNowNs();
+  g_start = true;
+  event_loop->loop();
+
+  int64_t end = begin;
+  int64_t cpu_ns = 0;
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(thread_ids[i], NULL);
+    end = std::max(end, threads[i].end_ns);
+    cpu_ns += threads[i].cpu_ns;
+  }
+  int64_t lines = (int64_t)g_lines * thread_count;
+  rocket::Logger::GetGlobalLogger()->syncLoop();
+
+  printf("%-8s %8d %14.0f %12.1f\n", name, thread_count, lines / ((end - begin) / 1e9), (double)cpu_ns / lines);
+  exit(0);
+}
+
+
+int main(int argc, char* argv[]) {
+  const char* dir = "/tmp/";
+  if (argc > 1) {
+    dir = argv[1];
+  }
+
+  printf("%-8s %8s %14s %12s\n", "mode", "threads", "lines/s", "cpu ns/line");
+  const char* names[] = {"text", "binary"};
+  int thread_counts[] = {1, 2, 4, 8, 16};
+  for (int mode = 0; mode < 2; ++mode) {
+    for (int i = 0; i < 5; ++i) {
+      fflush(stdout);
+      pid_t pid = fork();
+      if (pid == 0) {
+        run(names[mode], mode == 1, thread_counts[i], dir);
+      }
+      int status = 0;
+      waitpid(pid, &status, 0);
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        exit(1);
+      }
+    }
+  }
+
+  glob_t files;
+  std::string pattern = std::string(dir) + "bench_log_*_log.*";
+  if (glob(pattern.c_str(), 0, NULL, &files) == 0) {
+    for (size_t i = 0; i < files.gl_pathc; ++i) {
+      unlink(files.gl_pathv[i]);
+    }
+    globfree(&files);
+  }
+  return 0;
+}
@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string.h>
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/eventloop.h"
+#include "bench_util.h"
+
+// Memory of the log pipeline when the disk is slower than the threads. The rpc log file is a
+// FIFO read at 32 MB/s, 4 threads log 100000 lines of about 200 bytes each, every tenth at
+// ERROR. Without a cap the lines pile up in the AsyncLogger, with <log_max_buffer_size> of 8 MB
+// they are dropped or the threads wait, by <log_overflow_policy>.
+// "log secs" is until the last thread is done, "ERROR lines" the ones that reached the FIFO.
+// The FIFO is <dir>/bench_log_pressure_rpc_<date>_log.0, argv[1] or /tmp/, removed at the end.
+// Every setting runs in a child process, the logger is global.
+
+static const int g_lines = 100000;
+
+static const int g_threads = 4;
+
+static const int64_t g_read_rate = 32 * 1024 * 1024;
+
+static std::atomic<bool> g_start {false};
+
+static std::atomic<int64_t> g_read_bytes {0};
+
+static std::atomic<int64_t> g_read_errors {0};
+
+static std::atomic<int64_t> g_end_ns {0};
+
+static std::vector<pthread_t> g_thread_ids;
+
+static std::string g_fifo;
+
+void* logMain(void* arg) {
+  while (!g_start) {
+    usleep(100);
+  }
+  std::string payload(64, 'x');
+  for (int i = 0; i < g_lines; ++i) {
+    if (i % 10 == 0) {
+      ERRORLOG("call failed, msg_id=%010d, data=%s", i, payload.c_str());
+    } else {
+      INFOLOG("call [Order.makeOrder] done, msg_id=%010d, data=%s", i, payload.c_str());
+    }
+  }
+  return NULL;
+}
+
+void* joinMain(void* arg) {
+  for (size_t i = 0; i < g_thread_ids.size(); ++i) {
+    pthread_join(g_thread_ids[i], NULL);
+  }
+  g_end_ns = benchNowNs();
+  return NULL;
+}
+
+// the slow disk, counts the ERROR lines that made it
+void* readMain(void* arg) {
+  int fd = open(g_fifo.c_str(), O_RDONLY);
+  std::vector<char> buf(64 * 1024);
+  int64_t begin = benchNowNs();
+  int64_t total = 0;
+  bool line_start = true;
+  while (true) {
+    int64_t allowed = (benchNowNs() - begin) * g_read_rate / 1000000000 - total;
+    if (allowed <= 0) {
+      usleep(1000);
+      continue;
+    }
+    ssize_t rt = read(fd, &buf[0], std::min((int64_t)buf.size(), allowed));
+    if (rt <= 0) {
+      break;
+    }
+    for (ssize_t i = 0; i < rt; ++i) {
+      if (line_start && rt - i > 3 && memcmp(&buf[i], "[ERR", 4) == 0) {
+        g_read_errors++;
+      }
+      line_start = buf[i] == '\n';
+    }
+    total += rt;
+    g_read_bytes += rt;
+  }
+  close(fd);
+  return NULL;
+}
+
+
+static void run(const char* policy, int max_buffer_size) {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config* config = rocket::Config::GetGlobalConfig();
+  config->m_log_level = "INFO";
+  config->m_log_file_name = "bench_log_pressure";
+  config->m_log_file_path = g_fifo.substr(0, g_fifo.rfind('/') + 1);
+  config->m_log_max_file_size = 1000000000;
+  config->m_log_sync_inteval = 10;
+  config->m_log_thread_buffer_size = 1024 * 1024;
+  config->m_log_max_buffer_size = max_buffer_size;
+  config->m_log_overflow_policy = policy;
+  rocket::Logger::InitGlobalLogger(1);
+  rocket::AsyncLogger::s_ptr writer = rocket::Logger::GetGlobalLogger()->getAsyncLopger();
+
+  pthread_t reader;
+  pthread_create(&reader, NULL, &readMain, NULL);
+  g_thread_ids.resize(g_threads);
+  for (int i = 0; i < g_threads; ++i) {
+    pthread_create(&g_thread_ids[i], NULL, &logMain, NULL);
+  }
+
+  // this thread's EventLoop runs Logger::syncLoop, it stops once every line is written or dropped
+  rocket::EventLoop* event_loop = rocket::EventLoop::GetCurrentEventLoop();
+  std::shared_ptr<rocket::TimerEvent> check_timer = std::make_shared<rocket::TimerEvent>(20, true, [event_loop, writer]() {
+    rocket::AsyncLogger::Stats stats = writer->getStats();
+    if (g_end_ns != 0 && stats.written_lines + stats.dropped_lines >= (uint64_t)g_lines * g_threads
+        && g_read_bytes == (int64_t)stats.written_bytes) {
+      event_loop->stop();
+    }
+  });
+  event_loop->addTimerEvent(check_timer);
+  int64_t begin = benchNowNs();
+  g_start = true;
+  pthread_t joiner;
+  pthread_create(&joiner, NULL, &joinMain, NULL);
+  event_loop->loop();
+  pthread_join(joiner, NULL);
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  rocket::AsyncLogger::Stats stats = writer->getStats();
+  printf("%-18s %8d %12.2f %10ld %10lu %10lu %12ld\n", policy, max_buffer_size / (1024 * 1024),
+    (g_end_ns - begin) / 1e9, usage.ru_maxrss / 1024, (unsigned long)stats.written_lines, (unsigned long)stats.dropped_lines,
+    (long)g_read_errors.load());
+  exit(0);
+}
+
+
+int main(int argc, char* argv[]) {
+  std::string dir = "/tmp/";
+  if (argc > 1) {
+    dir = argv[1];
+  }
+  time_t now = time(NULL);
+  struct tm now_time;
+  localtime_r(&now, &now_time);
+  char date[32];
+  strftime(date, sizeof(date), "%Y%m%d", &now_time);
+  g_fifo = dir + "bench_log_pressure_rpc_" + date + "_log.0";
+  unlink(g_fifo.c_str());
+  if (mkfifo(g_fifo.c_str(), 0644) != 0) {
+    printf("mkfifo %s failed\n", g_fifo.c_str());
+    return 1;
+  }
+
+  printf("%-18s %8s %12s %10s %10s %10s %12s\n", "policy", "cap MB", "log secs", "peak MB", "written", "dropped", "ERROR lines");
+  const char* policies[] = {"drop_newest", "drop_newest", "drop_below_level", "block"};
+  int caps[] = {0, 8 * 1024 * 1024, 8 * 1024 * 1024, 8 * 1024 * 1024};
+  for (int i = 0; i < 4; ++i) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(policies[i], caps[i]);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      unlink(g_fifo.c_str());
+      exit(1);
+    }
+  }
+  unlink(g_fifo.c_str());
+  unlink((dir + "bench_log_pressure_app_" + date + "_log.0").c_str());
+  return 0;
+}
@@ -0,0 +1,134 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <glob.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/eventloop.h"
+#include "bench_util.h"
+
+// Sustained throughput of the AsyncLogger thread: 1, 2 and 4 threads INFOLOG lines of about
+// 256 bytes, 1 GB (argv[2] MB) in all. The threads wait while more than 64 MB of lines are not
+// written yet, so the rate is the one of the writer and the disk, not of the rings.
+// Lines go to <dir>/bench_log_writer_*, argv[1] or /tmp/, and are removed after every setting.
+// Every setting runs in a child process, the logger is global.
+
+static const int g_line_bytes = 256;
+
+static const int64_t g_max_gap = 64 * 1024 * 1024 / g_line_bytes;
+
+static int64_t g_total_lines = 1024LL * 1024 * 1024 / g_line_bytes;
+
+static std::atomic<bool> g_start {false};
+
+static std::atomic<int64_t> g_produced_lines {0};
+
+static std::atomic<int> g_done_threads {0};
+
+static rocket::AsyncLogger::s_ptr g_writer;
+
+void* logMain(void* arg) {
+  int64_t lines = (int64_t)(long)arg;
+  while (!g_start) {
+    usleep(100);
+  }
+  // about 100 bytes of prefix
+  std::string payload(g_line_bytes - 100 - 50, 'x');
+  std::string method = "Order.makeOrder";
+  for (int64_t i = 0; i < lines; ++i) {
+    if ((i & 255) == 0) {
+      while (g_produced_lines - (int64_t)g_writer->getStats().written_lines > g_max_gap) {
+        usleep(1000);
+      }
+    }
+    INFOLOG("call [%s] done, msg_id=%010ld, data=%s", method.c_str(), (long)i, payload.c_str());
+    g_produced_lines++;
+  }
+  g_done_threads++;
+  return NULL;
+}
+
+
+static void removeFiles(const char* dir) {
+  glob_t files;
+  std::string pattern = std::string(dir) + "bench_log_writer_*_log.*";
+  if (glob(pattern.c_str(), 0, NULL, &files) == 0) {
+    for (size_t i = 0; i < files.gl_pathc; ++i) {
+      unlink(files.gl_pathv[i]);
+    }
+    globfree(&files);
+  }
+}
+
+static void run(int thread_count, const char* dir) {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config* config = rocket::Config::GetGlobalConfig();
+  config->m_log_level = "INFO";
+  config->m_log_file_name = "bench_log_writer";
+  config->m_log_file_path = dir;
+  config->m_log_max_file_size = 256 * 1024 * 1024;
+  config->m_log_sync_inteval = 10;
+  config->m_log_thread_buffer_size = 8 * 1024 * 1024;
+  rocket::Logger::InitGlobalLogger(1);
+  g_writer = rocket::Logger::GetGlobalLogger()->getAsyncLopger();
+
+  std::vector<pthread_t> thread_ids(thread_count);
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&thread_ids[i], NULL, &logMain, (void*)(long)(g_total_lines / thread_count));
+  }
+
+  // this thread's EventLoop runs Logger::syncLoop, it stops once every line is written
+  rocket::EventLoop* event_loop = rocket::EventLoop::GetCurrentEventLoop();
+  std::shared_ptr<rocket::TimerEvent> check_timer = std::make_shared<rocket::TimerEvent>(50, true, [event_loop, thread_count]() {
+    if (g_done_threads == thread_count && (int64_t)g_writer->getStats().written_lines >= g_produced_lines) {
+      event_loop->stop();
+    }
+  });
+  event_loop->addTimerEvent(check_timer);
+  int64_t begin = benchNowNs();
+  g_start = true;
+  event_loop->loop();
+  int64_t end = benchNowNs();
+
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(thread_ids[i], NULL);
+  }
+  rocket::AsyncLogger::Stats stats = g_writer->getStats();
+  printf("%8d %10.1f %10lu %12.0f %10lu\n", thread_count, stats.written_bytes / ((end - begin) / 1e9) / (1024 * 1024),
+    (unsigned long)stats.writes, (double)stats.written_bytes / (stats.writes ? stats.writes : 1),
+    (unsigned long)(stats.dropped_lines + stats.failed_lines));
+  exit(0);
+}
+
+
+int main(int argc, char* argv[]) {
+  const char* dir = "/tmp/";
+  if (argc > 1) {
+    dir = argv[1];
+  }
+  if (argc > 2) {
+    g_total_lines = atoll(argv[2]) * 1024 * 1024 / g_line_bytes;
+  }
+
+  printf("%8s %10s %10s %12s %10s\n", "threads", "MB/s", "writes", "bytes/write", "dropped");
+  int thread_counts[] = {1, 2, 4};
+  for (int i = 0; i < 3; ++i) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(thread_counts[i], dir);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    removeFiles(dir);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      exit(1);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <string>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_client_pool.h"
+#include "rocket/net/rpc/rpc_channel.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_closure.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// RpcChannel calls one after another, with a connection per call (client_pool max_connections 0)
+// and with the per thread TcpClientPool. Prints the call latency and the pool counters.
+
+struct ClientRun {
+  const char* name {NULL};
+  int max_connections {0};
+  int count {0};
+  int done {0};
+  int failed {0};
+  int64_t begin_ns {0};
+  LatencyHistogram histogram;
+};
+
+static void callNext(ClientRun* run) {
+  NEWMESSAGE(makeOrderRequest, request);
+  NEWMESSAGE(makeOrderResponse, response);
+  request->set_price(100);
+  request->set_goods("apple");
+  NEWRPCCONTROLLER(controller);
+  controller->SetTimeout(5000);
+
+  run->begin_ns = benchNowNs();
+  std::shared_ptr<rocket::RpcClosure> closure = std::make_shared<rocket::RpcClosure>(nullptr, [run, request, response, controller]() mutable {
+    run->histogram.add(benchNowNs() - run->begin_ns);
+    if (controller->GetErrorCode() != 0) {
+      run->failed++;
+    }
+    if (++run->done == run->count) {
+      rocket::EventLoop::GetCurrentEventLoop()->stop();
+      return;
+    }
+    // start the next call from the loop, not inside this one's callback
+    rocket::EventLoop::GetCurrentEventLoop()->addTask([run]() {
+      callNext(run);
+    });
+  });
+  CALLRPRC("127.0.0.1:12383", Order_Stub, makeOrder, controller, request, response, closure);
+}
+
+void* clientMain(void* arg) {
+  ClientRun* run = reinterpret_cast<ClientRun*>(arg);
+  rocket::Config::GetGlobalConfig()->m_client_pool_max_connections = run->max_connections;
+  rocket::EventLoop::GetCurrentEventLoop()->addTask([run]() {
+    callNext(run);
+  });
+  rocket::EventLoop::GetCurrentEventLoop()->loop();
+
+  if (run->failed != 0) {
+    printf("%s: %d of %d calls failed\n", run->name, run->failed, run->count);
+    exit(1);
+  }
+  run->histogram.print(run->name);
+  rocket::TcpClientPool::Stats stats = rocket::TcpClientPool::GetCurrentPool()->getStats();
+  printf("  pool hits %ld, misses %ld, open connections %d\n", stats.hits, stats.misses, stats.connections);
+  return NULL;
+}
+
+
+int main(int argc, char* argv[]) {
+  int count = 20000;
+  if (argc > 1) {
+    count = std::atoi(argv[1]);
+  }
+
+  startBenchServer(12383);
+
+  // each run gets a thread of its own, a stopped EventLoop does not loop again
+  ClientRun runs[2];
+  runs[0].name = "connection per call";
+  runs[0].max_connections = 0;
+  runs[1].name = "pooled connection";
+  runs[1].max_connections = 4;
+  for (int i = 0; i < 2; ++i) {
+    runs[i].count = count;
+    pthread_t client_thread;
+    pthread_create(&client_thread, NULL, &clientMain, &runs[i]);
+    pthread_join(client_thread, NULL);
+  }
+  exit(0);
+}
@@ -0,0 +1,118 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/io_thread.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/rpc/rpc_channel.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_closure.h"
+#include "rocket/net/rpc/rpc_client_runtime.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// Async RpcChannel calls from business threads that have no EventLoop, carried by
+// the client runtime's IO threads (<client><io_threads> 2). Each business thread
+// keeps up to 64 calls in flight. Prints the calls per second and the time a
+// CallMethod takes in the business thread, with the closures run on the IO
+// threads and on an executor loop of their own.
+
+static const int g_window = 64;
+
+
+struct BusinessRun {
+  int count {0};
+  sem_t window;
+  std::atomic<int> done {0};
+  std::atomic<int> failed {0};
+  int64_t submit_ns {0};
+};
+
+void* businessMain(void* arg) {
+  BusinessRun* run = reinterpret_cast<BusinessRun*>(arg);
+  for (int i = 0; i < run->count; ++i) {
+    sem_wait(&run->window);
+
+    NEWMESSAGE(makeOrderRequest, request);
+    NEWMESSAGE(makeOrderResponse, response);
+    request->set_price(100);
+    request->set_goods("apple");
+    NEWRPCCONTROLLER(controller);
+    controller->SetTimeout(5000);
+
+    std::shared_ptr<rocket::RpcClosure> closure = std::make_shared<rocket::RpcClosure>(nullptr, [run, request, response, controller]() mutable {
+      if (controller->GetErrorCode() != 0) {
+        run->failed++;
+      }
+      run->done++;
+      sem_post(&run->window);
+    });
+
+    int64_t begin = benchNowNs();
+    CALLRPRC("127.0.0.1:12385", Order_Stub, makeOrder, controller, request, response, closure);
+    run->submit_ns += benchNowNs() - begin;
+  }
+  return NULL;
+}
+
+static void runBusinessThreads(const char* name, int threads, int count) {
+  std::vector<BusinessRun> runs(threads);
+  std::vector<pthread_t> ids(threads);
+  int64_t begin = benchNowNs();
+  for (int i = 0; i < threads; ++i) {
+    runs[i].count = count;
+    sem_init(&runs[i].window, 0, g_window);
+    pthread_create(&ids[i], NULL, &businessMain, &runs[i]);
+  }
+
+  int64_t submit_ns = 0;
+  for (int i = 0; i < threads; ++i) {
+    pthread_join(ids[i], NULL);
+    // the last window of calls is still in flight
+    for (int j = 0; j < g_window; ++j) {
+      sem_wait(&runs[i].window);
+    }
+    if (runs[i].failed != 0 || runs[i].done != count) {
+      printf("%s: %d of %d calls done, %d failed\n", name, runs[i].done.load(), count, runs[i].failed.load());
+      exit(1);
+    }
+    submit_ns += runs[i].submit_ns;
+  }
+  double seconds = (benchNowNs() - begin) / 1e9;
+  printf("%-16s %8d %12.0f %14.1f\n", name, threads, threads * count / seconds, (double)submit_ns / (threads * count) / 1000);
+}
+
+
+int main(int argc, char* argv[]) {
+  int count = 20000;
+  if (argc > 1) {
+    count = std::atoi(argv[1]);
+  }
+
+  startBenchServer(12385, [](rocket::Config* config) {
+    config->m_client_io_threads = 2;
+  });
+
+  rocket::RpcClientRuntime* runtime = rocket::RpcClientRuntime::GetRpcClientRuntime();
+
+  printf("%-16s %8s %12s %14s\n", "closures on", "threads", "rpc/s", "submit us");
+  int threads[] = {1, 4};
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+    runBusinessThreads("io thread", threads[i], count);
+  }
+
+  rocket::IOThread executor_thread;
+  executor_thread.start();
+  runtime->setCallbackExecutor(rocket::RpcClientRuntime::EventLoopExecutor(executor_thread.getEventLoop()));
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+    runBusinessThreads("executor loop", threads[i], count);
+  }
+  exit(0);
+}
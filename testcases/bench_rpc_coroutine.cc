@@ -0,0 +1,154 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/net/io_thread.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/rpc/rpc_channel.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "rocket/net/rpc/rpc_coroutine.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// Fan out: every front request calls a downstream service 4 times in parallel and
+// is done when all 4 responses are in. 128 front requests are in flight at a time,
+// the calls are carried by 2 client runtime IO threads.
+// 1. thread per request, each request thread waits for the futures of its calls.
+// 2. coroutines on one EventLoop thread, each awaits an RpcCallGroup of its calls.
+// Needs C++20, the makefile builds it with -std=c++20.
+
+static const int g_fan_out = 4;
+static const int g_in_flight = 128;
+
+static rocket::NetAddr::s_ptr g_addr;
+
+static std::atomic<int> g_failed {0};
+
+
+struct Call {
+  std::shared_ptr<rocket::RpcChannel> channel;
+  std::shared_ptr<rocket::RpcController> controller;
+  std::shared_ptr<makeOrderRequest> request;
+  std::shared_ptr<makeOrderResponse> response;
+};
+
+static Call newCall() {
+  Call call;
+  call.channel = std::make_shared<rocket::RpcChannel>(g_addr);
+  call.controller = std::make_shared<rocket::RpcController>();
+  call.controller->SetTimeout(5000);
+  call.request = std::make_shared<makeOrderRequest>();
+  call.request->set_price(100);
+  call.request->set_goods("apple");
+  call.response = std::make_shared<makeOrderResponse>();
+  return call;
+}
+
+
+void* requestThreadMain(void* arg) {
+  std::vector<Call> calls;
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < g_fan_out; ++i) {
+    calls.push_back(newCall());
+    futures.push_back(calls[i].channel->CallAsync(&Order_Stub::makeOrder, calls[i].controller, calls[i].request, calls[i].response));
+  }
+  for (int i = 0; i < g_fan_out; ++i) {
+    futures[i].wait();
+    if (calls[i].controller->GetErrorCode() != 0) {
+      g_failed++;
+    }
+  }
+  return NULL;
+}
+
+static double threadPerRequest(int requests) {
+  int64_t begin = benchNowNs();
+  std::vector<pthread_t> threads(g_in_flight);
+  for (int done = 0; done < requests; done += g_in_flight) {
+    for (int i = 0; i < g_in_flight; ++i) {
+      pthread_create(&threads[i], NULL, &requestThreadMain, NULL);
+    }
+    for (int i = 0; i < g_in_flight; ++i) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+  return requests / ((benchNowNs() - begin) / 1e9);
+}
+
+
+struct CoroutineRun {
+  int requests {0};
+  int running {0};
+  int64_t begin_ns {0};
+  double rps {0};
+  sem_t finished;
+};
+
+static rocket::Task frontRequests(CoroutineRun* run, int count) {
+  for (int r = 0; r < count; ++r) {
+    std::vector<Call> calls;
+    rocket::RpcCallGroup group;
+    for (int i = 0; i < g_fan_out; ++i) {
+      calls.push_back(newCall());
+      group.add(calls[i].channel, &Order_Stub::makeOrder, calls[i].controller, calls[i].request, calls[i].response);
+    }
+    co_await group.wait();
+    for (int i = 0; i < g_fan_out; ++i) {
+      if (calls[i].controller->GetErrorCode() != 0) {
+        g_failed++;
+      }
+    }
+  }
+  // every coroutine resumes on the same loop thread, no lock needed
+  if (--run->running == 0) {
+    run->rps = run->requests / ((benchNowNs() - run->begin_ns) / 1e9);
+    sem_post(&run->finished);
+  }
+}
+
+static double coroutines(int requests) {
+  CoroutineRun run;
+  run.requests = requests;
+  sem_init(&run.finished, 0, 0);
+
+  rocket::IOThread loop_thread;
+  loop_thread.start();
+  loop_thread.getEventLoop()->addTask([&run, requests]() {
+    run.begin_ns = benchNowNs();
+    run.running = g_in_flight;
+    for (int i = 0; i < g_in_flight; ++i) {
+      rocket::CoSpawn(frontRequests(&run, requests / g_in_flight));
+    }
+  }, true);
+  sem_wait(&run.finished);
+  return run.rps;
+}
+
+
+int main(int argc, char* argv[]) {
+  int requests = 5120;
+  if (argc > 1) {
+    requests = std::atoi(argv[1]) / g_in_flight * g_in_flight;
+  }
+
+  g_addr = startBenchServer(12389, [](rocket::Config* config) {
+    config->m_client_io_threads = 2;
+  });
+
+  printf("%d front requests, %d in flight, %d downstream calls each\n", requests, g_in_flight, g_fan_out);
+  printf("%-20s %12s %16s\n", "handler", "requests/s", "handler threads");
+  printf("%-20s %12.0f %16d\n", "thread per request", threadPerRequest(requests), g_in_flight);
+  printf("%-20s %12.0f %16d\n", "coroutines", coroutines(requests), 1);
+  if (g_failed != 0) {
+    printf("%d calls failed\n", g_failed.load());
+    exit(1);
+  }
+  exit(0);
+}
@@ -0,0 +1,116 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <future>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/rpc/rpc_channel.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// RpcChannel::CallSync and CallAsync from worker threads without an EventLoop,
+// carried by 2 client runtime IO threads.
+// 1. CallSync, one call after another per worker.
+// 2. CallAsync fan out, every worker starts a batch of 256 calls and waits for all their futures.
+
+static const int g_batch = 256;
+
+static rocket::NetAddr::s_ptr g_addr;
+
+
+struct WorkerRun {
+  bool fan_out {false};
+  int count {0};
+  int failed {0};
+};
+
+static std::shared_ptr<makeOrderRequest> makeRequest() {
+  NEWMESSAGE(makeOrderRequest, request);
+  request->set_price(100);
+  request->set_goods("apple");
+  return request;
+}
+
+void* workerMain(void* arg) {
+  WorkerRun* run = reinterpret_cast<WorkerRun*>(arg);
+
+  if (!run->fan_out) {
+    for (int i = 0; i < run->count; ++i) {
+      NEWMESSAGE(makeOrderResponse, response);
+      NEWRPCCONTROLLER(controller);
+      controller->SetTimeout(5000);
+      rocket::RpcChannel::s_ptr channel = std::make_shared<rocket::RpcChannel>(g_addr);
+      if (channel->CallSync(&Order_Stub::makeOrder, controller, makeRequest(), response) != 0) {
+        run->failed++;
+      }
+    }
+    return NULL;
+  }
+
+  std::vector<std::future<void>> futures;
+  std::vector<std::shared_ptr<rocket::RpcController>> controllers;
+  for (int done = 0; done < run->count; done += g_batch) {
+    for (int i = 0; i < g_batch; ++i) {
+      NEWMESSAGE(makeOrderResponse, response);
+      NEWRPCCONTROLLER(controller);
+      controller->SetTimeout(5000);
+      rocket::RpcChannel::s_ptr channel = std::make_shared<rocket::RpcChannel>(g_addr);
+      futures.push_back(channel->CallAsync(&Order_Stub::makeOrder, controller, makeRequest(), response));
+      controllers.push_back(controller);
+    }
+    for (int i = 0; i < g_batch; ++i) {
+      futures[i].wait();
+      if (controllers[i]->GetErrorCode() != 0) {
+        run->failed++;
+      }
+    }
+    futures.clear();
+    controllers.clear();
+  }
+  return NULL;
+}
+
+static void runWorkers(const char* name, bool fan_out, int threads, int count) {
+  std::vector<WorkerRun> runs(threads);
+  std::vector<pthread_t> ids(threads);
+  int64_t begin = benchNowNs();
+  for (int i = 0; i < threads; ++i) {
+    runs[i].fan_out = fan_out;
+    runs[i].count = count;
+    pthread_create(&ids[i], NULL, &workerMain, &runs[i]);
+  }
+  for (int i = 0; i < threads; ++i) {
+    pthread_join(ids[i], NULL);
+    if (runs[i].failed != 0) {
+      printf("%s: %d of %d calls failed\n", name, runs[i].failed, count);
+      exit(1);
+    }
+  }
+  double seconds = (benchNowNs() - begin) / 1e9;
+  double rps = threads * count / seconds;
+  printf("%-16s %8d %12.0f %14.1f\n", name, threads, rps, 1e6 / rps);
+}
+
+
+int main(int argc, char* argv[]) {
+  int count = 10240;
+  if (argc > 1) {
+    count = std::atoi(argv[1]) / g_batch * g_batch;
+  }
+
+  g_addr = startBenchServer(12387, [](rocket::Config* config) {
+    config->m_client_io_threads = 2;
+  });
+
+  printf("%-16s %8s %12s %14s\n", "style", "workers", "rpc/s", "us per call");
+  runWorkers("CallSync", false, 1, count / 4);
+  runWorkers("CallSync", false, 8, count / 4);
+  runWorkers("CallAsync x256", true, 1, count);
+  runWorkers("CallAsync x256", true, 4, count);
+  exit(0);
+}
@@ -0,0 +1,126 @@
+#include <assert.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_server.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "rocket/net/rpc/rpc_dispatcher.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// Request latency of the test_rpc_server path (TcpServer -> TinyPBCoder -> RpcDispatcher -> reply)
+// for the queued and inline EventLoop dispatch modes.
+// The client is a plain blocking socket so only the server side is measured.
+
+void startServer(int port, rocket::EventLoop::DispatchMode mode) {
+  rocket::EventLoop::SetDefaultDispatchMode(mode);
+  // returns once the server's event loops are created with this dispatch mode
+  startBenchServerThread(port);
+}
+
+
+int connectServer(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in server_addr;
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(port);
+  inet_aton("127.0.0.1", &server_addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&server_addr), sizeof(server_addr)) != 0) {
+    printf("connect to port %d error, errno=%d\n", port, errno);
+    exit(1);
+  }
+  int val = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+  return fd;
+}
+
+bool callOnce(int fd, rocket::TinyPBCoder& coder, int64_t seq) {
+  std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+  message->m_msg_id = std::to_string(seq);
+  message->m_method_name = "Order.makeOrder";
+  makeOrderRequest request;
+  request.set_price(100);
+  request.set_goods("apple");
+  request.SerializeToString(&(message->m_pb_data));
+
+  std::vector<rocket::AbstractProtocol::s_ptr> messages;
+  messages.push_back(message);
+  rocket::TcpBuffer::s_ptr out_buffer = std::make_shared<rocket::TcpBuffer>(256);
+  coder.encode(messages, out_buffer);
+
+  std::vector<char> bytes;
+  out_buffer->readFromBuffer(bytes, out_buffer->readAble());
+  size_t sent = 0;
+  while (sent < bytes.size()) {
+    int rt = write(fd, &bytes[sent], bytes.size() - sent);
+    if (rt <= 0) {
+      return false;
+    }
+    sent += rt;
+  }
+
+  rocket::TcpBuffer::s_ptr in_buffer = std::make_shared<rocket::TcpBuffer>(256);
+  std::vector<rocket::AbstractProtocol::s_ptr> result;
+  char buf[4096];
+  while (result.empty()) {
+    int rt = read(fd, buf, sizeof(buf));
+    if (rt <= 0) {
+      return false;
+    }
+    in_buffer->writeToBuffer(buf, rt);
+    coder.decode(result, in_buffer);
+  }
+  return result[0]->m_msg_id == message->m_msg_id;
+}
+
+void runClient(const char* name, int port, int warmup, int count) {
+  int fd = connectServer(port);
+  rocket::TinyPBCoder coder;
+  LatencyHistogram histogram;
+  for (int i = 0; i < warmup + count; ++i) {
+    int64_t begin = benchNowNs();
+    if (!callOnce(fd, coder, i)) {
+      printf("%s: call %d failed\n", name, i);
+      exit(1);
+    }
+    if (i >= warmup) {
+      histogram.add(benchNowNs() - begin);
+    }
+  }
+  close(fd);
+  histogram.print(name);
+}
+
+
+int main(int argc, char* argv[]) {
+  int count = 20000;
+  if (argc > 1) {
+    count = std::atoi(argv[1]);
+  }
+
+  initBenchConfig([](rocket::Config* config) {
+    config->m_io_threads = 2;
+  });
+
+  startServer(12371, rocket::EventLoop::DispatchQueued);
+  startServer(12372, rocket::EventLoop::DispatchInline);
+
+  runClient("queued dispatch", 12371, 1000, count);
+  runClient("inline dispatch", 12372, 1000, count);
+
+  exit(0);
+}
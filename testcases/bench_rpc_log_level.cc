@@ -0,0 +1,146 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/common/msg_id_util.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// CPU time of the whole process (server, client and log threads) per rpc, with the log level
+// set to DEBUG, INFO and ERROR at runtime. Build it once as is and once with
+// make ROCKET_MIN_LOG_LEVEL=3 to see what compiling the levels out saves on top.
+// One client calls one after another over a single connection to a server with one IO thread.
+// Logs go to <dir>, argv[1] or /tmp/, and are removed at the end.
+// Every setting runs in a child process, the dispatcher and the logger are global.
+
+static const int g_calls = 50000;
+
+static rocket::NetAddr::s_ptr g_addr;
+
+static int64_t processCpuNs() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return ((int64_t)usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000
+    + ((int64_t)usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+}
+
+struct ClientRun {
+  rocket::TcpClient* client {NULL};
+  std::string pb_data;
+  int done {0};
+  int failed {0};
+};
+
+static ClientRun* g_run = NULL;
+
+static void callNext() {
+  std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+  message->m_msg_id = rocket::MsgIDUtil::GenMsgID();
+  message->m_method_name = "Order.makeOrder";
+  message->m_pb_data = g_run->pb_data;
+
+  g_run->client->readMessage(message->m_msg_id, [](rocket::AbstractProtocol::s_ptr msg) {
+    if (!msg) {
+      printf("connection closed by the server\n");
+      exit(1);
+    }
+    std::shared_ptr<rocket::TinyPBProtocol> response = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg);
+    if (response->m_err_code != 0) {
+      g_run->failed++;
+    }
+    g_run->done++;
+    if (g_run->done == g_calls) {
+      rocket::EventLoop::GetCurrentEventLoop()->stop();
+    } else {
+      callNext();
+    }
+  });
+  g_run->client->writeMessage(message, [](rocket::AbstractProtocol::s_ptr) {});
+}
+
+static void run(const char* level, int port, const char* dir) {
+  // logs go to files, InitGlobalLogger(1)
+  initBenchConfig([level, dir](rocket::Config* config) {
+    config->m_log_level = level;
+    config->m_log_file_name = "bench_rpc_log_level";
+    config->m_log_file_path = dir;
+    config->m_log_max_file_size = 1000000000;
+    config->m_log_sync_inteval = 10;
+  }, NULL, 1);
+  g_addr = startBenchServerThread(port);
+
+  ClientRun client_run;
+  g_run = &client_run;
+  makeOrderRequest request;
+  request.set_price(100);
+  request.set_goods("apple");
+  request.SerializeToString(&client_run.pb_data);
+
+  // the client runs in this thread's EventLoop, which also runs Logger::syncLoop
+  rocket::TcpClient client(g_addr);
+  client_run.client = &client;
+  int64_t cpu_begin = 0;
+  int64_t begin = 0;
+  client.connect([&cpu_begin, &begin]() {
+    if (g_run->client->getConnectErrorCode() != 0) {
+      printf("connect error %s\n", g_run->client->getConnectErrorInfo().c_str());
+      exit(1);
+    }
+    cpu_begin = processCpuNs();
+    begin = benchNowNs();
+    callNext();
+  });
+  int64_t cpu_ns = processCpuNs() - cpu_begin;
+  int64_t wall_ns = benchNowNs() - begin;
+
+  if (client_run.failed != 0) {
+    printf("%d calls failed\n", client_run.failed);
+    exit(1);
+  }
+  printf("%-8s %12.0f %14.1f\n", level, g_calls / (wall_ns / 1e9), (double)cpu_ns / g_calls / 1000.0);
+  exit(0);
+}
+
+
+int main(int argc, char* argv[]) {
+  const char* dir = "/tmp/";
+  if (argc > 1) {
+    dir = argv[1];
+  }
+
+  printf("ROCKET_MIN_LOG_LEVEL %d\n", ROCKET_MIN_LOG_LEVEL);
+  printf("%-8s %12s %14s\n", "level", "rpc/s", "cpu us/rpc");
+  const char* levels[] = {"DEBUG", "INFO", "ERROR"};
+  for (int i = 0; i < 3; ++i) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(levels[i], 12399 + i, dir);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      exit(1);
+    }
+  }
+
+  glob_t files;
+  std::string pattern = std::string(dir) + "bench_rpc_log_level_*_log.*";
+  if (glob(pattern.c_str(), 0, NULL, &files) == 0) {
+    for (size_t i = 0; i < files.gl_pathc; ++i) {
+      unlink(files.gl_pathv[i]);
+    }
+    globfree(&files);
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <string>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/common/msg_id_util.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// Throughput of one multiplexed client connection with 1, 64 and 1024 requests in flight.
+// Every response issues the next request, responses are matched by msg_id in any order.
+
+static const int g_port = 12381;
+
+
+struct ClientRun {
+  int concurrency {0};
+  int count {0};
+  int sent {0};
+  int received {0};
+  int failed {0};
+  int64_t begin_ns {0};
+  int64_t cost_ns {0};
+  std::string pb_data;
+  rocket::TcpClient* client {NULL};
+};
+
+static void sendNext(ClientRun* run) {
+  if (run->sent == run->count) {
+    return;
+  }
+  run->sent++;
+  std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+  message->m_msg_id = rocket::MsgIDUtil::GenMsgID();
+  message->m_method_name = "Order.makeOrder";
+  message->m_pb_data = run->pb_data;
+
+  run->client->readMessage(message->m_msg_id, [run](rocket::AbstractProtocol::s_ptr msg) {
+    if (!msg) {
+      printf("connection closed by the server\n");
+      exit(1);
+    }
+    std::shared_ptr<rocket::TinyPBProtocol> response = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg);
+    if (response->m_err_code != 0) {
+      run->failed++;
+    }
+    run->received++;
+    if (run->received == run->count) {
+      run->cost_ns = benchNowNs() - run->begin_ns;
+      run->client->stop();
+      return;
+    }
+    sendNext(run);
+  });
+  run->client->writeMessage(message, [](rocket::AbstractProtocol::s_ptr) {});
+}
+
+void* clientMain(void* arg) {
+  ClientRun* run = reinterpret_cast<ClientRun*>(arg);
+  rocket::IPNetAddr::s_ptr addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", g_port);
+  rocket::TcpClient client(addr);
+  run->client = &client;
+  client.connect([run]() {
+    if (run->client->getConnectErrorCode() != 0) {
+      printf("connect error %s\n", run->client->getConnectErrorInfo().c_str());
+      exit(1);
+    }
+    run->begin_ns = benchNowNs();
+    for (int i = 0; i < run->concurrency; ++i) {
+      sendNext(run);
+    }
+  });
+  return NULL;
+}
+
+
+int main(int argc, char* argv[]) {
+  int count = 200000;
+  if (argc > 1) {
+    count = std::atoi(argv[1]);
+  }
+
+  startBenchServer(g_port);
+
+  makeOrderRequest request;
+  request.set_price(100);
+  request.set_goods("apple");
+
+  printf("%-12s %10s %12s %14s\n", "in flight", "requests", "rpc/s", "avg us");
+  int levels[] = {1, 64, 1024};
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+    // every level gets a thread of its own, a stopped EventLoop does not loop again
+    ClientRun run;
+    run.concurrency = levels[i];
+    run.count = (levels[i] == 1) ? count / 10 : count;
+    request.SerializeToString(&run.pb_data);
+
+    pthread_t client_thread;
+    pthread_create(&client_thread, NULL, &clientMain, &run);
+    pthread_join(client_thread, NULL);
+
+    if (run.received != run.count || run.failed != 0) {
+      printf("received %d of %d, %d failed\n", run.received, run.count, run.failed);
+      exit(1);
+    }
+    double rps = run.count / (run.cost_ns / 1e9);
+    printf("%-12d %10d %12.0f %14.1f\n", run.concurrency, run.count, rps, run.concurrency * 1e6 / rps);
+  }
+  exit(0);
+}
@@ -0,0 +1,199 @@
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// Server side syscalls per RPC for level-triggered and edge-triggered TcpConnections.
+// read/write/epoll calls are interposed in this binary and counted for every thread
+// except the client's, so the numbers cover the server's IO thread and accept loop.
+
+enum SyscallKind {
+  SysEpollWait = 0,
+  SysEpollCtl = 1,
+  SysRead = 2,
+  SysWrite = 3,
+  SysKindCount = 4,
+};
+
+static const char* g_syscall_names[] = {"epoll_wait", "epoll_ctl", "read/readv", "write/writev"};
+
+static std::atomic<long> g_syscalls[SysKindCount];
+static thread_local bool t_not_counted = false;
+
+static void countSyscall(SyscallKind kind) {
+  if (!t_not_counted) {
+    g_syscalls[kind].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+extern "C" {
+
+ssize_t read(int fd, void* buf, size_t count) {
+  countSyscall(SysRead);
+  return syscall(SYS_read, fd, buf, count);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+  countSyscall(SysWrite);
+  return syscall(SYS_write, fd, buf, count);
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+  countSyscall(SysRead);
+  return syscall(SYS_readv, fd, iov, iovcnt);
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+  countSyscall(SysWrite);
+  return syscall(SYS_writev, fd, iov, iovcnt);
+}
+
+int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout) {
+  countSyscall(SysEpollWait);
+  return syscall(SYS_epoll_pwait, epfd, events, maxevents, timeout, NULL, 8);
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) throw() {
+  countSyscall(SysEpollCtl);
+  return syscall(SYS_epoll_ctl, epfd, op, fd, event);
+}
+
+}
+
+
+static int g_port = 12381;
+
+
+int connectServer(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in server_addr;
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(port);
+  inet_aton("127.0.0.1", &server_addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&server_addr), sizeof(server_addr)) != 0) {
+    printf("connect to port %d error, errno=%d\n", port, errno);
+    exit(1);
+  }
+  int val = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+  return fd;
+}
+
+bool callOnce(int fd, rocket::TinyPBCoder& coder, int64_t seq) {
+  std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+  message->m_msg_id = std::to_string(seq);
+  message->m_method_name = "Order.makeOrder";
+  makeOrderRequest request;
+  request.set_price(100);
+  request.set_goods("apple");
+  request.SerializeToString(&(message->m_pb_data));
+
+  std::vector<rocket::AbstractProtocol::s_ptr> messages;
+  messages.push_back(message);
+  rocket::TcpBuffer::s_ptr out_buffer = std::make_shared<rocket::TcpBuffer>(256);
+  coder.encode(messages, out_buffer);
+
+  std::vector<char> bytes;
+  out_buffer->readFromBuffer(bytes, out_buffer->readAble());
+  size_t sent = 0;
+  while (sent < bytes.size()) {
+    int rt = write(fd, &bytes[sent], bytes.size() - sent);
+    if (rt <= 0) {
+      return false;
+    }
+    sent += rt;
+  }
+
+  rocket::TcpBuffer::s_ptr in_buffer = std::make_shared<rocket::TcpBuffer>(256);
+  std::vector<rocket::AbstractProtocol::s_ptr> result;
+  char buf[4096];
+  while (result.empty()) {
+    int rt = read(fd, buf, sizeof(buf));
+    if (rt <= 0) {
+      return false;
+    }
+    in_buffer->writeToBuffer(buf, rt);
+    coder.decode(result, in_buffer);
+  }
+  return result[0]->m_msg_id == message->m_msg_id;
+}
+
+void runClient(const char* name, int warmup, int count) {
+  int fd = connectServer(g_port);
+  rocket::TinyPBCoder coder;
+  LatencyHistogram histogram;
+  long begin_counts[SysKindCount];
+  for (int i = 0; i < warmup + count; ++i) {
+    if (i == warmup) {
+      for (int k = 0; k < SysKindCount; ++k) {
+        begin_counts[k] = g_syscalls[k].load();
+      }
+    }
+    int64_t begin = benchNowNs();
+    if (!callOnce(fd, coder, i)) {
+      printf("%s: call %d failed\n", name, i);
+      exit(1);
+    }
+    if (i >= warmup) {
+      histogram.add(benchNowNs() - begin);
+    }
+  }
+
+  printf("%-16s", name);
+  double total = 0;
+  for (int k = 0; k < SysKindCount; ++k) {
+    double per_call = (double)(g_syscalls[k].load() - begin_counts[k]) / count;
+    total += per_call;
+    printf(" %14.2f", per_call);
+  }
+  printf(" %10.2f %12.1f\n", total, histogram.percentile(50) / 1000.0);
+  close(fd);
+}
+
+
+int main(int argc, char* argv[]) {
+  t_not_counted = true;
+
+  int count = 20000;
+  if (argc > 1) {
+    count = std::atoi(argv[1]);
+  }
+
+  startBenchServer(g_port);
+
+  printf("server syscalls per rpc, %d calls\n", count);
+  printf("%-16s", "mode");
+  for (int k = 0; k < SysKindCount; ++k) {
+    printf(" %14s", g_syscall_names[k]);
+  }
+  printf(" %10s %12s\n", "total", "p50(us)");
+
+  // the trigger mode is taken when the server accepts the connection
+  rocket::Config::GetGlobalConfig()->m_epoll_edge_triggered = false;
+  runClient("level-triggered", 1000, count);
+
+  rocket::Config::GetGlobalConfig()->m_epoll_edge_triggered = true;
+  runClient("edge-triggered", 1000, count);
+
+  exit(0);
+}
@@ -0,0 +1,109 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+#include <memory>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/rpc/rpc_channel.h"
+#include "rocket/net/rpc/rpc_controller.h"
+#include "bench_util.h"
+
+#include "order.pb.h"
+
+// Latency of cheap calls while slow calls (a handler that blocks for 2ms) hit the
+// same server, which has one IO thread. Handlers on the IO thread, then on 4 workers.
+// Every setting runs in a child process, the dispatcher and its workers are global.
+
+static const int g_slow_in_flight = 8;
+
+static rocket::NetAddr::s_ptr g_addr;
+
+static std::atomic<bool> g_stop_slow {false};
+
+static std::future<void> call(const std::string& goods, std::shared_ptr<rocket::RpcController>& controller) {
+  std::shared_ptr<makeOrderRequest> request = std::make_shared<makeOrderRequest>();
+  request->set_price(100);
+  request->set_goods(goods);
+  std::shared_ptr<makeOrderResponse> response = std::make_shared<makeOrderResponse>();
+  controller = std::make_shared<rocket::RpcController>();
+  controller->SetTimeout(10000);
+  rocket::RpcChannel::s_ptr channel = std::make_shared<rocket::RpcChannel>(g_addr);
+  return channel->CallAsync(&Order_Stub::makeOrder, controller, request, response);
+}
+
+void* slowMain(void* arg) {
+  std::vector<std::future<void>> futures(g_slow_in_flight);
+  std::vector<std::shared_ptr<rocket::RpcController>> controllers(g_slow_in_flight);
+  while (!g_stop_slow) {
+    for (int i = 0; i < g_slow_in_flight; ++i) {
+      futures[i] = call("slow", controllers[i]);
+    }
+    for (int i = 0; i < g_slow_in_flight; ++i) {
+      futures[i].wait();
+    }
+  }
+  return NULL;
+}
+
+static void run(const char* name, int workers, int port, int count) {
+  // the slow calls block their handler for 2ms
+  std::shared_ptr<BenchOrderImpl> service = std::make_shared<BenchOrderImpl>([](const makeOrderRequest& request) {
+    if (request.goods() == "slow") {
+      usleep(2000);
+    }
+  });
+  g_addr = startBenchServer(port, [workers](rocket::Config* config) {
+    config->m_client_io_threads = 1;
+    config->m_worker_threads = workers;
+  }, service);
+
+  pthread_t slow_thread;
+  pthread_create(&slow_thread, NULL, &slowMain, NULL);
+  usleep(50 * 1000);
+
+  LatencyHistogram histogram;
+  for (int i = 0; i < count; ++i) {
+    std::shared_ptr<rocket::RpcController> controller;
+    int64_t begin = benchNowNs();
+    call("fast", controller).wait();
+    histogram.add(benchNowNs() - begin);
+    if (controller->GetErrorCode() != 0) {
+      printf("%s: call failed, %s\n", name, controller->GetErrorInfo().c_str());
+      exit(1);
+    }
+  }
+  g_stop_slow = true;
+  pthread_join(slow_thread, NULL);
+
+  printf("%s: count=%zu p50=%.1fus p99=%.1fus max=%.1fus\n", name, histogram.count(),
+    histogram.percentile(50) / 1000.0, histogram.percentile(99) / 1000.0, histogram.percentile(100) / 1000.0);
+  exit(0);
+}
+
+
+int main(int argc, char* argv[]) {
+  int count = 2000;
+  if (argc > 1) {
+    count = std::atoi(argv[1]);
+  }
+
+  const char* names[] = {"handlers on the io thread", "4 worker threads"};
+  int workers[] = {0, 4};
+  for (int i = 0; i < 2; ++i) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(names[i], workers[i], 12391 + i, count);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      exit(1);
+    }
+  }
+  return 0;
+}
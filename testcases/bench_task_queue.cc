@@ -0,0 +1,167 @@
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <queue>
+#include <vector>
+#include <functional>
+#include "rocket/common/mutex.h"
+#include "rocket/net/mpsc_task_queue.h"
+
+// Compare EventLoop::addTask's old mutex + std::queue task queue with MpscTaskQueue.
+// Every producer posts tasks with wakeup, as IO threads / business threads do.
+// The old queue writes the eventfd for every task, the new one coalesces wakeups.
+
+static const int g_tasks_per_producer = 200000;
+
+static int64_t nowUs() {
+  timeval val;
+  gettimeofday(&val, NULL);
+  return (int64_t)val.tv_sec * 1000000 + val.tv_usec;
+}
+
+static void writeWakeup(int fd, std::atomic<long>& writes) {
+  uint64_t one = 1;
+  if (write(fd, &one, sizeof(one)) == sizeof(one)) {
+    writes++;
+  }
+}
+
+static void drainWakeup(int fd) {
+  uint64_t val = 0;
+  while (read(fd, &val, sizeof(val)) == sizeof(val)) {
+  }
+}
+
+
+struct MutexQueue {
+  rocket::Mutex m_mutex;
+  std::queue<std::function<void()>> m_pending_tasks;
+  int m_wakeup_fd {-1};
+  std::atomic<long> m_wakeup_writes {0};
+
+  void addTask(std::function<void()> cb) {
+    rocket::ScopeMutex<rocket::Mutex> lock(m_mutex);
+    m_pending_tasks.push(cb);
+    lock.unlock();
+    writeWakeup(m_wakeup_fd, m_wakeup_writes);
+  }
+
+  long runTasks() {
+    rocket::ScopeMutex<rocket::Mutex> lock(m_mutex);
+    std::queue<std::function<void()>> tmp_tasks;
+    m_pending_tasks.swap(tmp_tasks);
+    lock.unlock();
+
+    long count = 0;
+    while (!tmp_tasks.empty()) {
+      std::function<void()> cb = tmp_tasks.front();
+      tmp_tasks.pop();
+      if (cb) {
+        cb();
+      }
+      count++;
+    }
+    return count;
+  }
+};
+
+
+struct LockFreeQueue {
+  rocket::MpscTaskQueue m_pending_tasks;
+  std::atomic<bool> m_wakeup_pending {false};
+  int m_wakeup_fd {-1};
+  std::atomic<long> m_wakeup_writes {0};
+
+  template <class F>
+  void addTask(F&& cb) {
+    m_pending_tasks.push(std::forward<F>(cb));
+    if (!m_wakeup_pending.exchange(true)) {
+      writeWakeup(m_wakeup_fd, m_wakeup_writes);
+    }
+  }
+
+  long runTasks() {
+    m_wakeup_pending.store(false);
+    return m_pending_tasks.runTasks();
+  }
+};
+
+
+template <class Queue>
+struct BenchArg {
+  Queue* queue;
+  std::atomic<long>* counter;
+  std::atomic<bool>* start;
+};
+
+template <class Queue>
+void* producer(void* arg) {
+  BenchArg<Queue>* bench = reinterpret_cast<BenchArg<Queue>*>(arg);
+  while (!bench->start->load()) {
+  }
+  std::atomic<long>* counter = bench->counter;
+  for (int i = 0; i < g_tasks_per_producer; ++i) {
+    // capture a few words, about the size of a typical addEpollEvent/reply closure
+    long a = i, b = i + 1, c = i + 2;
+    bench->queue->addTask([counter, a, b, c]() {
+      if (a + b + c >= 0) {
+        counter->fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  return NULL;
+}
+
+template <class Queue>
+double runBench(int producers, long& wakeup_writes) {
+  Queue queue;
+  queue.m_wakeup_fd = eventfd(0, EFD_NONBLOCK);
+  std::atomic<long> counter {0};
+  std::atomic<bool> start {false};
+  BenchArg<Queue> arg {&queue, &counter, &start};
+
+  std::vector<pthread_t> threads(producers);
+  for (int i = 0; i < producers; ++i) {
+    pthread_create(&threads[i], NULL, &producer<Queue>, &arg);
+  }
+
+  long total = (long)producers * g_tasks_per_producer;
+  int64_t begin = nowUs();
+  start.store(true);
+  long executed = 0;
+  while (executed < total) {
+    drainWakeup(queue.m_wakeup_fd);
+    executed += queue.runTasks();
+  }
+  int64_t cost = nowUs() - begin;
+
+  for (int i = 0; i < producers; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  close(queue.m_wakeup_fd);
+
+  if (counter.load() != total) {
+    printf("task count mismatch, expect %ld, got %ld\n", total, counter.load());
+    exit(1);
+  }
+  wakeup_writes = queue.m_wakeup_writes.load();
+  return total * 1000000.0 / (cost > 0 ? cost : 1);
+}
+
+
+int main() {
+  printf("%-10s %18s %18s %16s %16s\n", "producers", "mutex tasks/s", "mpsc tasks/s", "mutex wakeups", "mpsc wakeups");
+  int producers[] = {1, 2, 4, 8, 16, 32};
+  for (size_t i = 0; i < sizeof(producers) / sizeof(producers[0]); ++i) {
+    long mutex_wakeups = 0;
+    long mpsc_wakeups = 0;
+    double mutex_qps = runBench<MutexQueue>(producers[i], mutex_wakeups);
+    double mpsc_qps = runBench<LockFreeQueue>(producers[i], mpsc_wakeups);
+    printf("%-10d %18.0f %18.0f %16ld %16ld\n", producers[i], mutex_qps, mpsc_qps, mutex_wakeups, mpsc_wakeups);
+  }
+  return 0;
+}
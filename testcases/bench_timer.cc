@@ -0,0 +1,149 @@
+#include <sys/timerfd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <map>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/mutex.h"
+#include "rocket/common/util.h"
+#include "rocket/net/timer.h"
+#include "rocket/net/timer_event.h"
+#include "bench_util.h"
+
+// 1M schedule/cancel cycles, the pattern of RpcChannel's per call timeout timer:
+// every call schedules a timeout and cancels it when the response arrives.
+// `inflight` timers stay pending meanwhile, like concurrent calls on one loop.
+// Compares the old mutex + std::multimap Timer with the timing wheel.
+
+static const int g_cycles = 1000000;
+
+
+// the previous Timer's add/delete path, kept here for comparison
+class MultimapTimer {
+ public:
+  MultimapTimer() {
+    m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  }
+
+  ~MultimapTimer() {
+    close(m_fd);
+  }
+
+  void addTimerEvent(rocket::TimerEvent::s_ptr event) {
+    bool is_reset_timerfd = false;
+
+    rocket::ScopeMutex<rocket::Mutex> lock(m_mutex);
+    if (m_pending_events.empty()) {
+      is_reset_timerfd = true;
+    } else {
+      auto it = m_pending_events.begin();
+      if ((*it).second->getArriveTime() > event->getArriveTime()) {
+        is_reset_timerfd = true;
+      }
+    }
+    m_pending_events.emplace(event->getArriveTime(), event);
+    lock.unlock();
+
+    if (is_reset_timerfd) {
+      resetArriveTime();
+    }
+  }
+
+  void deleteTimerEvent(rocket::TimerEvent::s_ptr event) {
+    event->setCancled(true);
+
+    rocket::ScopeMutex<rocket::Mutex> lock(m_mutex);
+    auto begin = m_pending_events.lower_bound(event->getArriveTime());
+    auto end = m_pending_events.upper_bound(event->getArriveTime());
+    auto it = begin;
+    for (it = begin; it != end; ++it) {
+      if (it->second == event) {
+        break;
+      }
+    }
+    if (it != end) {
+      m_pending_events.erase(it);
+    }
+  }
+
+ private:
+  void resetArriveTime() {
+    rocket::ScopeMutex<rocket::Mutex> lock(m_mutex);
+    auto tmp = m_pending_events;
+    lock.unlock();
+
+    if (tmp.size() == 0) {
+      return;
+    }
+    int64_t inteval = tmp.begin()->second->getArriveTime() - rocket::getNowMs();
+    if (inteval <= 0) {
+      inteval = 100;
+    }
+    itimerspec value;
+    memset(&value, 0, sizeof(value));
+    value.it_value.tv_sec = inteval / 1000;
+    value.it_value.tv_nsec = (inteval % 1000) * 1000000;
+    timerfd_settime(m_fd, 0, &value, NULL);
+  }
+
+ private:
+  int m_fd {-1};
+  std::multimap<int64_t, rocket::TimerEvent::s_ptr> m_pending_events;
+  rocket::Mutex m_mutex;
+};
+
+
+template <class TimerType>
+double runBench(int inflight, int timeout_ms) {
+  TimerType timer;
+  std::vector<rocket::TimerEvent::s_ptr> window(inflight > 0 ? inflight : 1);
+  srand(1);
+
+  int64_t begin = benchNowNs();
+  for (int i = 0; i < g_cycles; ++i) {
+    // jitter the timeout a little, calls do not all start in the same ms
+    rocket::TimerEvent::s_ptr event = std::make_shared<rocket::TimerEvent>(timeout_ms + rand() % 64, false, []() {});
+    timer.addTimerEvent(event);
+
+    int slot = i % window.size();
+    if (inflight == 0) {
+      timer.deleteTimerEvent(event);
+    } else {
+      if (window[slot]) {
+        timer.deleteTimerEvent(window[slot]);
+      }
+      window[slot] = event;
+    }
+  }
+  int64_t cost = benchNowNs() - begin;
+
+  for (size_t i = 0; i < window.size(); ++i) {
+    if (window[i]) {
+      timer.deleteTimerEvent(window[i]);
+    }
+  }
+  return (double)cost / g_cycles;
+}
+
+
+int main() {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config::GetGlobalConfig()->m_log_level = "ERROR";
+  rocket::Logger::InitGlobalLogger(0);
+
+  printf("%d schedule/cancel cycles, ns per cycle\n", g_cycles);
+  printf("%-10s %-12s %16s %16s\n", "inflight", "timeout", "multimap", "timing wheel");
+  int inflights[] = {0, 100, 10000, 100000};
+  int timeouts[] = {1000, 30000};
+  for (size_t t = 0; t < sizeof(timeouts) / sizeof(timeouts[0]); ++t) {
+    for (size_t i = 0; i < sizeof(inflights) / sizeof(inflights[0]); ++i) {
+      double old_ns = runBench<MultimapTimer>(inflights[i], timeouts[t]);
+      double wheel_ns = runBench<rocket::Timer>(inflights[i], timeouts[t]);
+      printf("%-10d %-12d %16.1f %16.1f\n", inflights[i], timeouts[t], old_ns, wheel_ns);
+    }
+  }
+  return 0;
+}
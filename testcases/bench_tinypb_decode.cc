@@ -0,0 +1,222 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/util.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "bench_util.h"
+
+// TinyPBCoder::decode throughput for 100B, 4KB and 1MB pb_data.
+// A stream of pipelined frames is fed to the buffer in 64KB reads, the amount
+// one readv() takes, and decode() runs after every read as in TcpConnection::onRead.
+// Compares the previous vector buffer + copying decoder with the current one.
+
+static const int g_read_size = 64 * 1024;
+
+
+// the previous TcpBuffer and TinyPBCoder::decode, kept here for comparison
+class LegacyBuffer {
+ public:
+  void writeToBuffer(const char* buf, int size) {
+    if (size > (int)m_buffer.size() - m_write_index) {
+      std::vector<char> tmp((int)(1.5 * (m_write_index + size)));
+      memcpy(&tmp[0], &m_buffer[m_read_index], readAble());
+      m_buffer.swap(tmp);
+      m_write_index -= m_read_index;
+      m_read_index = 0;
+    }
+    memcpy(&m_buffer[m_write_index], buf, size);
+    m_write_index += size;
+  }
+
+  int readAble() {
+    return m_write_index - m_read_index;
+  }
+
+  void moveReadIndex(int size) {
+    m_read_index += size;
+    if (m_read_index < int(m_buffer.size() / 3)) {
+      return;
+    }
+    std::vector<char> buffer(m_buffer.size());
+    int count = readAble();
+    memcpy(&buffer[0], &m_buffer[m_read_index], count);
+    m_buffer.swap(buffer);
+    m_read_index = 0;
+    m_write_index = count;
+  }
+
+ public:
+  std::vector<char> m_buffer = std::vector<char>(128);
+  int m_read_index {0};
+  int m_write_index {0};
+};
+
+static void legacyDecode(std::vector<rocket::AbstractProtocol::s_ptr>& out_messages, LegacyBuffer& buffer) {
+  while (true) {
+    std::vector<char> tmp = buffer.m_buffer;
+    int start_index = buffer.m_read_index;
+    int end_index = -1;
+
+    int pk_len = 0;
+    bool parse_success = false;
+    int i = 0;
+    for (i = start_index; i < buffer.m_write_index; ++i) {
+      if (tmp[i] == rocket::TinyPBProtocol::PB_START) {
+        // the original only checked i + 1, which reads pk_len past the written bytes at a read boundary
+        if (i + (int)sizeof(int32_t) < buffer.m_write_index) {
+          pk_len = rocket::getInt32FromNetByte(&tmp[i + 1]);
+          int j = i + pk_len - 1;
+          if (j >= buffer.m_write_index) {
+            continue;
+          }
+          if (tmp[j] == rocket::TinyPBProtocol::PB_END) {
+            start_index = i;
+            end_index = j;
+            parse_success = true;
+            break;
+          }
+        }
+      }
+    }
+
+    if (i >= buffer.m_write_index) {
+      return;
+    }
+
+    if (parse_success) {
+      buffer.moveReadIndex(end_index - start_index + 1);
+      std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+      message->m_pk_len = pk_len;
+
+      int msg_id_len_index = start_index + sizeof(char) + sizeof(message->m_pk_len);
+      message->m_msg_id_len = rocket::getInt32FromNetByte(&tmp[msg_id_len_index]);
+      int msg_id_index = msg_id_len_index + sizeof(message->m_msg_id_len);
+      char msg_id[100] = {0};
+      memcpy(&msg_id[0], &tmp[msg_id_index], message->m_msg_id_len);
+      message->m_msg_id = std::string(msg_id);
+
+      int method_name_len_index = msg_id_index + message->m_msg_id_len;
+      message->m_method_name_len = rocket::getInt32FromNetByte(&tmp[method_name_len_index]);
+      int method_name_index = method_name_len_index + sizeof(message->m_method_name_len);
+      char method_name[512] = {0};
+      memcpy(&method_name[0], &tmp[method_name_index], message->m_method_name_len);
+      message->m_method_name = std::string(method_name);
+
+      int err_code_index = method_name_index + message->m_method_name_len;
+      message->m_err_code = rocket::getInt32FromNetByte(&tmp[err_code_index]);
+      int error_info_len_index = err_code_index + sizeof(message->m_err_code);
+      message->m_err_info_len = rocket::getInt32FromNetByte(&tmp[error_info_len_index]);
+      int err_info_index = error_info_len_index + sizeof(message->m_err_info_len);
+      char error_info[512] = {0};
+      memcpy(&error_info[0], &tmp[err_info_index], message->m_err_info_len);
+      message->m_err_info = std::string(error_info);
+
+      int pb_data_len = message->m_pk_len - message->m_method_name_len - message->m_msg_id_len - message->m_err_info_len - 2 - 24;
+      int pd_data_index = err_info_index + message->m_err_info_len;
+      message->m_pb_data = std::string(&tmp[pd_data_index], pb_data_len);
+      message->parse_success = true;
+      out_messages.push_back(message);
+    }
+  }
+}
+
+
+static std::vector<char> makeStream(int pb_data_size, int count) {
+  std::vector<rocket::AbstractProtocol::s_ptr> messages;
+  for (int i = 0; i < count; ++i) {
+    std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+    message->m_msg_id = std::to_string(100000000 + i);
+    message->m_method_name = "Order.makeOrder";
+    message->m_pb_data = std::string(pb_data_size, 'a' + i % 26);
+    messages.push_back(message);
+  }
+  rocket::TinyPBCoder coder;
+  rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(0);
+  coder.encode(messages, buffer);
+
+  std::vector<char> stream;
+  buffer->readFromBuffer(stream, buffer->readAble());
+  return stream;
+}
+
+struct DecodeResult {
+  double mb_per_sec;
+  double msgs_per_sec;
+};
+
+static DecodeResult result(const std::vector<char>& stream, size_t decoded, int count, int64_t cost_ns) {
+  if ((int)decoded != count) {
+    printf("decoded %zu of %d messages\n", decoded, count);
+    exit(1);
+  }
+  DecodeResult re;
+  re.mb_per_sec = (double)stream.size() / (1024 * 1024) / (cost_ns / 1e9);
+  re.msgs_per_sec = count / (cost_ns / 1e9);
+  return re;
+}
+
+static DecodeResult runCurrent(const std::vector<char>& stream, int count) {
+  rocket::TinyPBCoder coder;
+  rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(0);
+  std::vector<rocket::AbstractProtocol::s_ptr> out;
+  out.reserve(count);
+
+  int64_t begin = benchNowNs();
+  for (size_t pos = 0; pos < stream.size(); pos += g_read_size) {
+    int n = (int)std::min(stream.size() - pos, (size_t)g_read_size);
+    buffer->writeToBuffer(&stream[pos], n);
+    coder.decode(out, buffer);
+  }
+  return result(stream, out.size(), count, benchNowNs() - begin);
+}
+
+static DecodeResult runLegacy(const std::vector<char>& stream, int count) {
+  LegacyBuffer buffer;
+  std::vector<rocket::AbstractProtocol::s_ptr> out;
+  out.reserve(count);
+
+  int64_t begin = benchNowNs();
+  for (size_t pos = 0; pos < stream.size(); pos += g_read_size) {
+    int n = (int)std::min(stream.size() - pos, (size_t)g_read_size);
+    buffer.writeToBuffer(&stream[pos], n);
+    legacyDecode(out, buffer);
+  }
+  return result(stream, out.size(), count, benchNowNs() - begin);
+}
+
+
+int main() {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config::GetGlobalConfig()->m_log_level = "ERROR";
+  rocket::Logger::InitGlobalLogger(0);
+
+  struct Case {
+    const char* name;
+    int pb_data_size;
+    int count;
+  };
+  // the legacy decoder copies the whole buffer per message, so small frames get fewer rounds
+  Case cases[] = {
+    {"100B", 100, 20000},
+    {"4KB", 4 * 1024, 4000},
+    {"1MB", 1024 * 1024, 32},
+  };
+
+  printf("pipelined frames fed in %dKB reads\n", g_read_size / 1024);
+  printf("%-8s %10s %14s %14s %14s %14s\n", "pb_data", "messages", "legacy MB/s", "legacy msgs/s", "MB/s", "msgs/s");
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    std::vector<char> stream = makeStream(cases[i].pb_data_size, cases[i].count);
+    DecodeResult legacy = runLegacy(stream, cases[i].count);
+    DecodeResult current = runCurrent(stream, cases[i].count);
+    printf("%-8s %10d %14.1f %14.0f %14.1f %14.0f\n", cases[i].name, cases[i].count,
+      legacy.mb_per_sec, legacy.msgs_per_sec, current.mb_per_sec, current.msgs_per_sec);
+  }
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/msg_id_util.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_v2_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "bench_util.h"
+
+// TinyPB v1 against the compact v2 framing for small requests.
+// 1. wire bytes of one request, for v2 both the first one (full method name)
+//    and the following ones (method id learned from the first response).
+// 2. ns per request of encode + decode, checksum on, v2 in the learned state.
+
+static const int g_count = 1000000;
+
+
+static std::shared_ptr<rocket::TinyPBProtocol> makeRequest(int pb_data_size) {
+  std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+  message->m_msg_id = rocket::MsgIDUtil::GenMsgID();
+  message->m_method_name = "Order.makeOrder";
+  message->m_pb_data = std::string(pb_data_size, 'a');
+  return message;
+}
+
+static int encodedSize(rocket::AbstractCoder& coder, std::shared_ptr<rocket::TinyPBProtocol> message) {
+  std::vector<rocket::AbstractProtocol::s_ptr> messages;
+  messages.push_back(message);
+  rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(0);
+  coder.encode(messages, buffer);
+  return buffer->readAble();
+}
+
+// client and server side of one connection after the first response told the client the method id
+static void learnMethodId(rocket::TinyPBV2Coder& client, rocket::TinyPBV2Coder& server) {
+  std::shared_ptr<rocket::TinyPBProtocol> response = makeRequest(0);
+  response->m_method_id = 1;
+  std::vector<rocket::AbstractProtocol::s_ptr> messages;
+  messages.push_back(response);
+  std::vector<rocket::AbstractProtocol::s_ptr> out;
+  rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(0);
+  server.encode(messages, buffer);
+  client.decode(out, buffer);
+}
+
+static double codecNsPerMsg(rocket::AbstractCoder& encoder, rocket::AbstractCoder& decoder, int pb_data_size) {
+  std::vector<rocket::AbstractProtocol::s_ptr> messages;
+  messages.push_back(makeRequest(pb_data_size));
+  rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(0);
+  std::vector<rocket::AbstractProtocol::s_ptr> out;
+
+  int64_t begin = benchNowNs();
+  for (int i = 0; i < g_count; ++i) {
+    encoder.encode(messages, buffer);
+    decoder.decode(out, buffer);
+    if (out.size() != 1) {
+      printf("decode failed\n");
+      exit(1);
+    }
+    out.clear();
+  }
+  return (double)(benchNowNs() - begin) / g_count;
+}
+
+
+int main() {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config::GetGlobalConfig()->m_log_level = "ERROR";
+  rocket::Logger::InitGlobalLogger(0);
+
+  printf("request with method \"Order.makeOrder\" and a %d digit msg_id\n", (int)rocket::MsgIDUtil::GenMsgID().length());
+  printf("%-8s %10s %12s %12s %12s %12s\n", "pb_data", "v1 bytes", "v2 first", "v2 bytes", "v1 ns", "v2 ns");
+  int sizes[] = {0, 16, 64, 256, 1024};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    rocket::TinyPBCoder v1_encoder;
+    rocket::TinyPBCoder v1_decoder;
+    rocket::TinyPBV2Coder v2_client;
+    rocket::TinyPBV2Coder v2_server;
+
+    int v1_bytes = encodedSize(v1_encoder, makeRequest(sizes[i]));
+    int v2_first = encodedSize(v2_client, makeRequest(sizes[i]));
+    learnMethodId(v2_client, v2_server);
+    int v2_bytes = encodedSize(v2_client, makeRequest(sizes[i]));
+
+    double v1_ns = codecNsPerMsg(v1_encoder, v1_decoder, sizes[i]);
+    double v2_ns = codecNsPerMsg(v2_client, v2_server, sizes[i]);
+    printf("%-8d %10d %12d %12d %12.1f %12.1f\n", sizes[i], v1_bytes, v2_first, v2_bytes, v1_ns, v2_ns);
+  }
+  return 0;
+}
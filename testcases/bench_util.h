@@ -0,0 +1,171 @@
+#ifndef ROCKET_TESTCASES_BENCH_UTIL_H
+#define ROCKET_TESTCASES_BENCH_UTIL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <google/protobuf/service.h>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/tcp/net_addr.h"
+#include "rocket/net/tcp/tcp_server.h"
+#include "rocket/net/rpc/rpc_dispatcher.h"
+
+#include "order.pb.h"
+
+// helpers shared by the bench_* programs
+
+inline int64_t benchNowNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+// Latency histogram with log2 buckets (in us) plus exact percentiles.
+class LatencyHistogram {
+ public:
+  void add(int64_t ns) {
+    m_samples.push_back(ns);
+  }
+
+  size_t count() const {
+    return m_samples.size();
+  }
+
+  // samples of a histogram filled by another thread
+  void merge(const LatencyHistogram& other) {
+    m_samples.insert(m_samples.end(), other.m_samples.begin(), other.m_samples.end());
+    m_sorted = false;
+  }
+
+  // p in [0, 100]
+  int64_t percentile(double p) {
+    if (m_samples.empty()) {
+      return 0;
+    }
+    if (!m_sorted) {
+      std::sort(m_samples.begin(), m_samples.end());
+      m_sorted = true;
+    }
+    size_t i = (size_t)(p / 100.0 * (m_samples.size() - 1));
+    return m_samples[i];
+  }
+
+  void print(const char* name) {
+    printf("%s: count=%zu p50=%.1fus p90=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n", name, count(),
+      percentile(50) / 1000.0, percentile(90) / 1000.0, percentile(99) / 1000.0,
+      percentile(99.9) / 1000.0, percentile(100) / 1000.0);
+
+    std::vector<size_t> buckets(32, 0);
+    for (size_t i = 0; i < m_samples.size(); ++i) {
+      int64_t us = m_samples[i] / 1000;
+      int b = 0;
+      while (us > 1 && b < 31) {
+        us >>= 1;
+        b++;
+      }
+      buckets[b]++;
+    }
+    for (size_t b = 0; b < buckets.size(); ++b) {
+      if (buckets[b] == 0) {
+        continue;
+      }
+      int bar = (int)(buckets[b] * 50 / m_samples.size());
+      printf("  <%8lldus %8zu |%s\n", 1LL << (b + 1), buckets[b], std::string(bar, '#').c_str());
+    }
+  }
+
+ private:
+  std::vector<int64_t> m_samples;
+  bool m_sorted {false};
+};
+
+
+// Order service of the rpc benches, every makeOrder is answered with order_id 20230514.
+// work, if set, runs in the handler before the reply, e.g. to hold the thread like real work.
+class BenchOrderImpl : public Order {
+ public:
+  BenchOrderImpl(std::function<void(const makeOrderRequest&)> work = nullptr) : m_work(work) {}
+
+  void makeOrder(google::protobuf::RpcController* controller,
+                      const ::makeOrderRequest* request,
+                      ::makeOrderResponse* response,
+                      ::google::protobuf::Closure* done) {
+    if (m_work) {
+      m_work(*request);
+    }
+    response->set_order_id("20230514");
+    if (done) {
+      done->Run();
+    }
+  }
+
+ private:
+  std::function<void(const makeOrderRequest&)> m_work;
+};
+
+
+// the global config of the rpc benches: no xml, ERROR logs, one IO thread. config_fn changes it
+// before the logger starts, then service, a BenchOrderImpl by default, is registered
+inline void initBenchConfig(std::function<void(rocket::Config*)> config_fn = nullptr,
+    std::shared_ptr<google::protobuf::Service> service = nullptr, int logger_type = 0) {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config* config = rocket::Config::GetGlobalConfig();
+  config->m_log_level = "ERROR";
+  config->m_io_threads = 1;
+  if (config_fn) {
+    config_fn(config);
+  }
+  rocket::Logger::InitGlobalLogger(logger_type);
+
+  if (!service) {
+    service = std::make_shared<BenchOrderImpl>();
+  }
+  rocket::RpcDispatcher::GetRpcDispatcher()->registerService(service);
+}
+
+
+struct BenchServerArg {
+  rocket::NetAddr::s_ptr addr;
+  sem_t ready;
+};
+
+inline void* benchServerMain(void* arg) {
+  BenchServerArg* server_arg = reinterpret_cast<BenchServerArg*>(arg);
+  rocket::TcpServer* tcp_server = new rocket::TcpServer(server_arg->addr);
+  sem_post(&server_arg->ready);
+  tcp_server->start();
+  return NULL;
+}
+
+// a TcpServer on 127.0.0.1:port with the current global config, started in a thread of its own.
+// Returns its address 100ms after its event loops are created
+inline rocket::NetAddr::s_ptr startBenchServerThread(int port) {
+  BenchServerArg arg;
+  arg.addr = std::make_shared<rocket::IPNetAddr>("127.0.0.1", port);
+  sem_init(&arg.ready, 0, 0);
+  pthread_t thread;
+  pthread_create(&thread, NULL, &benchServerMain, &arg);
+  sem_wait(&arg.ready);
+  sem_destroy(&arg.ready);
+  usleep(100 * 1000);
+  return arg.addr;
+}
+
+// initBenchConfig() and startBenchServerThread() for the benches with one server
+inline rocket::NetAddr::s_ptr startBenchServer(int port, std::function<void(rocket::Config*)> config_fn = nullptr,
+    std::shared_ptr<google::protobuf::Service> service = nullptr) {
+  initBenchConfig(config_fn, service);
+  return startBenchServerThread(port);
+}
+
+#endif
@@ -63,6 +63,10 @@ void test_tcp_client() {
     });
 
     client.readMessage("123456789", [](rocket::AbstractProtocol::s_ptr msg_ptr) {
+      if (!msg_ptr) {
+        ERRORLOG("connection closed before the response");
+        return;
+      }
       std::shared_ptr<rocket::TinyPBProtocol> message = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg_ptr);
       DEBUGLOG("msg_id[%s], get response %s", message->m_msg_id.c_str(), message->m_pb_data.c_str());
     });
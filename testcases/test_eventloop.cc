@@ -74,8 +74,14 @@ void test_io_thread() {
   io_thread->getEventLoop()->addEpollEvent(&event);
   io_thread->getEventLoop()->addTimerEvent(timer_event);
 
+  // a TimerEvent belongs to one loop's timer, give the second loop its own
+  rocket::TimerEvent::s_ptr timer_event2 = std::make_shared<rocket::TimerEvent>(
+    1000, true, [&i]() {
+      INFOLOG("trigger timer event2, count=%d", i++);
+    }
+  );
   rocket::IOThread* io_thread2 = io_thread_group.getIOThread();
-  io_thread2->getEventLoop()->addTimerEvent(timer_event);
+  io_thread2->getEventLoop()->addTimerEvent(timer_event2);
 
   io_thread_group.start();
   io_thread_group.join();
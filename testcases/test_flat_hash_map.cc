@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rocket/common/flat_hash_map.h"
+
+// FlatHashMap: erase shifting a cluster back, growing by rehash, takeAll, and a random mix of
+// inserts, takes and finds against std::unordered_map.
+
+static int g_failed = 0;
+
+#define CHECK(cond) \
+  if (!(cond)) { \
+    printf("FAILED %s:%d %s\n", __FILE__, __LINE__, #cond); \
+    g_failed++; \
+  } \
+
+// the slot a key starts probing from in a table of capacity slots, as FlatHashMap::indexOf
+static size_t homeOf(uint64_t key, size_t capacity) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31;
+  return (size_t)key & (capacity - 1);
+}
+
+// erase from the middle of a cluster, the entries behind it must still be found
+static void testEraseShiftsBack() {
+  // 3 keys with the same home in the 16 slot table, and one whose home is the slot after it,
+  // so they form one cluster of 4
+  std::vector<uint64_t> same_home;
+  uint64_t next_home = 0;
+  size_t home = homeOf(1, 16);
+  for (uint64_t key = 2; same_home.size() < 3 || next_home == 0; ++key) {
+    if (homeOf(key, 16) == home && same_home.size() < 3) {
+      same_home.push_back(key);
+    } else if (homeOf(key, 16) == ((home + 1) & 15) && next_home == 0) {
+      next_home = key;
+    }
+  }
+
+  rocket::FlatHashMap<std::string> map;
+  CHECK(map.insert(same_home[0], "a"));
+  CHECK(map.insert(same_home[1], "b"));
+  CHECK(map.insert(next_home, "n"));
+  CHECK(map.insert(same_home[2], "c"));
+  CHECK(!map.insert(same_home[1], "x"));
+  CHECK(map.size() == 4);
+
+  std::string value;
+  CHECK(map.take(same_home[0], value) && value == "a");
+  CHECK(map.find(same_home[0]) == NULL);
+  CHECK(map.find(same_home[1]) && *map.find(same_home[1]) == "b");
+  CHECK(map.find(same_home[2]) && *map.find(same_home[2]) == "c");
+  CHECK(map.find(next_home) && *map.find(next_home) == "n");
+
+  CHECK(map.erase(same_home[1]));
+  CHECK(!map.erase(same_home[1]));
+  CHECK(map.find(same_home[2]) && *map.find(same_home[2]) == "c");
+  CHECK(map.find(next_home) && *map.find(next_home) == "n");
+  CHECK(map.size() == 2);
+}
+
+// the table doubles at half full, every key keeps its value
+static void testRehash() {
+  rocket::FlatHashMap<int> map;
+  for (int i = 0; i < 1000; ++i) {
+    CHECK(map.insert(1000000 + i, i));
+  }
+  CHECK(map.size() == 1000);
+  for (int i = 0; i < 1000; ++i) {
+    int* value = map.find(1000000 + i);
+    CHECK(value && *value == i);
+  }
+  CHECK(map.find(999999) == NULL);
+}
+
+static void testTakeAll() {
+  rocket::FlatHashMap<std::string> map;
+  for (int i = 0; i < 100; ++i) {
+    map.insert(i, std::to_string(i));
+  }
+  std::vector<std::string> all;
+  map.takeAll(all);
+  CHECK(all.size() == 100);
+  CHECK(map.empty() && map.find(5) == NULL);
+  std::sort(all.begin(), all.end());
+  CHECK(std::unique(all.begin(), all.end()) == all.end());
+
+  // the map is usable again
+  CHECK(map.insert(5, "5") && map.size() == 1);
+}
+
+static void testAgainstUnorderedMap() {
+  rocket::FlatHashMap<std::string> map;
+  std::unordered_map<uint64_t, std::string> expected;
+  std::mt19937_64 random(1);
+  for (int i = 0; i < 200000; ++i) {
+    uint64_t key = random() % 2000;
+    int op = random() % 3;
+    if (op == 0) {
+      std::string value = std::to_string(i);
+      CHECK(map.insert(key, value) == expected.emplace(key, value).second);
+    } else if (op == 1) {
+      std::string value;
+      bool taken = map.take(key, value);
+      auto it = expected.find(key);
+      CHECK(taken == (it != expected.end()));
+      if (taken && it != expected.end()) {
+        CHECK(value == it->second);
+        expected.erase(it);
+      }
+    } else {
+      std::string* value = map.find(key);
+      auto it = expected.find(key);
+      CHECK((value != NULL) == (it != expected.end()));
+      if (value && it != expected.end()) {
+        CHECK(*value == it->second);
+      }
+    }
+    if (g_failed) {
+      return;
+    }
+  }
+  CHECK(map.size() == expected.size());
+}
+
+
+int main() {
+  testEraseShiftsBack();
+  testRehash();
+  testTakeAll();
+  testAgainstUnorderedMap();
+
+  if (g_failed) {
+    printf("%d checks failed\n", g_failed);
+    return 1;
+  }
+  printf("test_flat_hash_map ok\n");
+  return 0;
+}
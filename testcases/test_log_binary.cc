@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/run_time.h"
+
+// The same lines logged in text mode, formatted by snprintf in the calling thread, and in binary
+// mode, formatted from the raw arguments by the AsyncLogger thread, are the same byte for byte
+// but for the time: %s, %p of a pointer cast to void*, widths, precisions and the msgid prefix.
+
+static int g_failed = 0;
+
+#define CHECK(cond) \
+  if (!(cond)) { \
+    printf("FAILED %s:%d %s\n", __FILE__, __LINE__, #cond); \
+    g_failed++; \
+  } \
+
+// one site per call, shared by both loggers
+#define LOG_TO(logger, str, ...) \
+  { \
+    static const rocket::LogSite rocket_log_site = {rocket::LogLevel::Info, false, __FILE__, __LINE__, str}; \
+    logger.log(&rocket_log_site, ##__VA_ARGS__); \
+  } \
+
+enum Color {
+  Red = 3
+};
+
+static void logAll(rocket::Logger& logger) {
+  const char* null_str = NULL;
+  char mutable_str[] = "mutable";
+  std::string long_str(1000, 'L');
+  int value = 42;
+
+  LOG_TO(logger, "no arguments");
+  LOG_TO(logger, "%s|%s|%s|%s", "literal", mutable_str, null_str, long_str.c_str());
+  LOG_TO(logger, "%p|%p|%p", (void*)mutable_str, (void*)&value, (void*)NULL);
+  LOG_TO(logger, "%d|%u|%ld|%lu|%lld|%x|%#o|%c|%d|%%", -5, 7u, -9L, 11UL, 1LL << 40, 255, 8, 'z', Red);
+  LOG_TO(logger, "[%8s][%-8s][%.3s][%-10.2s][%*s]", "right", "left", "precision", "ab", 6, "star");
+  LOG_TO(logger, "[%5d][%-5d][%05d][%+d][%.3d][%*d]", 42, 42, 42, 42, 7, -4, 9);
+  LOG_TO(logger, "[%f][%.3f][%10.2f][%-10.1e][%g][%.*f]", 3.14159, 3.14159, 2.5f, 12345.678, 0.0001, 2, 1.005);
+
+  rocket::RunTime::GetRunTime()->m_msgid = "123456789";
+  rocket::RunTime::GetRunTime()->m_method_name = "Order.makeOrder";
+  LOG_TO(logger, "with msgid %s", "and method");
+  rocket::RunTime::GetRunTime()->m_msgid = "";
+  rocket::RunTime::GetRunTime()->m_method_name = "";
+}
+
+// a logger of that mode writing to name
+static rocket::Logger* newLogger(bool binary, const std::string& name) {
+  rocket::Config::GetGlobalConfig()->m_log_binary = binary;
+  rocket::Config::GetGlobalConfig()->m_log_file_name = name;
+  return new rocket::Logger(rocket::LogLevel::Debug, 1);
+}
+
+// logs every line and returns the lines of the file. No init(), flush() syncs the ring and
+// waits for the file
+static std::vector<std::string> logLines(rocket::Logger& logger, const std::string& name) {
+  logAll(logger);
+  logger.flush();
+
+  char date[32];
+  time_t now = time(NULL);
+  struct tm now_time;
+  localtime_r(&now, &now_time);
+  strftime(date, sizeof(date), "%Y%m%d", &now_time);
+  std::string file = rocket::Config::GetGlobalConfig()->m_log_file_path + name + "_rpc_" + date + "_log.0";
+
+  std::vector<std::string> lines;
+  std::ifstream in(file.c_str());
+  std::string line;
+  while (std::getline(in, line)) {
+    lines.push_back(line);
+  }
+  unlink(file.c_str());
+  return lines;
+}
+
+// "[level]\t[time]\t..." without the time
+static std::string withoutTime(const std::string& line) {
+  size_t begin = line.find('\t');
+  size_t end = begin == std::string::npos ? begin : line.find('\t', begin + 1);
+  if (end == std::string::npos) {
+    return line;
+  }
+  return line.substr(0, begin) + line.substr(end);
+}
+
+
+int main() {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config* config = rocket::Config::GetGlobalConfig();
+  config->m_log_level = "DEBUG";
+  config->m_log_file_path = "/tmp/";
+  config->m_log_max_file_size = 100000000;
+  rocket::Logger::InitGlobalLogger(0);
+
+  std::string name = "test_log_binary_" + std::to_string(getpid());
+  // both stay alive, a thread only takes a new ring for a logger at another address
+  rocket::Logger* text_logger = newLogger(false, name + "_text");
+  rocket::Logger* binary_logger = newLogger(true, name + "_bin");
+  std::vector<std::string> text = logLines(*text_logger, name + "_text");
+  std::vector<std::string> binary = logLines(*binary_logger, name + "_bin");
+
+  CHECK(text.size() == 8);
+  if (text.size() == 8) {
+    CHECK(text[4].find("[   right][left    ][pre][ab        ][  star]") != std::string::npos);
+    CHECK(text[7].find("[123456789]\t[Order.makeOrder]\t") != std::string::npos);
+    CHECK(withoutTime(text[0]).size() < text[0].size());
+  }
+  CHECK(binary.size() == text.size());
+  for (size_t i = 0; i < text.size() && i < binary.size(); ++i) {
+    CHECK(withoutTime(binary[i]) == withoutTime(text[i]));
+    if (withoutTime(binary[i]) != withoutTime(text[i])) {
+      printf("  text:   %s\n  binary: %s\n", text[i].c_str(), binary[i].c_str());
+    }
+  }
+
+  if (g_failed) {
+    printf("%d checks failed\n", g_failed);
+    return 1;
+  }
+  printf("test_log_binary ok\n");
+  return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "rocket/net/mpsc_task_queue.h"
+
+// MpscTaskQueue: order of one producer, tasks pushed by a running task, pool exhaustion,
+// closures too big for a node, pending tasks destroyed with the queue, and 4 producers at once.
+
+static int g_failed = 0;
+
+#define CHECK(cond) \
+  if (!(cond)) { \
+    printf("FAILED %s:%d %s\n", __FILE__, __LINE__, #cond); \
+    g_failed++; \
+  } \
+
+static void testOrder() {
+  rocket::MpscTaskQueue queue;
+  std::vector<int> ran;
+  for (int i = 0; i < 10; ++i) {
+    queue.push([&ran, i]() {
+      ran.push_back(i);
+    });
+  }
+  // a null std::function is not queued
+  queue.push(std::function<void()>());
+  CHECK(!queue.empty());
+  CHECK(queue.runTasks() == 10);
+  CHECK(queue.empty());
+  CHECK(ran.size() == 10);
+  for (size_t i = 0; i < ran.size(); ++i) {
+    CHECK(ran[i] == (int)i);
+  }
+  CHECK(queue.runTasks() == 0);
+}
+
+// a task pushed while runTasks() runs waits for the next call
+static void testPushWhileRunning() {
+  rocket::MpscTaskQueue queue;
+  int second = 0;
+  queue.push([&queue, &second]() {
+    queue.push([&second]() {
+      second++;
+    });
+  });
+  CHECK(queue.runTasks() == 1);
+  CHECK(second == 0);
+  CHECK(queue.runTasks() == 1);
+  CHECK(second == 1);
+}
+
+// more tasks than pool nodes, and closures bigger than kInlineSize, come from the heap
+static void testHeapNodes() {
+  rocket::MpscTaskQueue queue(4);
+  int sum = 0;
+  char big[rocket::MpscTaskQueue::kInlineSize * 2] = {1};
+  for (int i = 0; i < 100; ++i) {
+    if (i % 2) {
+      queue.push([&sum, big]() {
+        sum += big[0];
+      });
+    } else {
+      queue.push([&sum]() {
+        sum += 1;
+      });
+    }
+  }
+  CHECK(queue.runTasks() == 100);
+  CHECK(sum == 100);
+}
+
+static void testDestroyPending() {
+  std::shared_ptr<int> counted = std::make_shared<int>(0);
+  {
+    rocket::MpscTaskQueue queue(2);
+    for (int i = 0; i < 5; ++i) {
+      queue.push([counted]() {
+        (*counted)++;
+      });
+    }
+    CHECK(counted.use_count() == 6);
+  }
+  CHECK(counted.use_count() == 1);
+  CHECK(*counted == 0);
+}
+
+struct Producer {
+  rocket::MpscTaskQueue* queue {NULL};
+  int id {0};
+  int count {0};
+  std::vector<int>* last {NULL};    // last value run per producer, written by the consumer only
+  int* out_of_order {NULL};
+};
+
+static void* producerMain(void* arg) {
+  Producer* producer = reinterpret_cast<Producer*>(arg);
+  for (int i = 0; i < producer->count; ++i) {
+    std::vector<int>* last = producer->last;
+    int* out_of_order = producer->out_of_order;
+    int id = producer->id;
+    producer->queue->push([last, out_of_order, id, i]() {
+      if ((*last)[id] != i - 1) {
+        (*out_of_order)++;
+      }
+      (*last)[id] = i;
+    });
+  }
+  return NULL;
+}
+
+// every task runs once, and the tasks of one producer run in the order it pushed them
+static void testProducers() {
+  const int kProducers = 4;
+  const int kCount = 100000;
+  rocket::MpscTaskQueue queue(256);
+  std::vector<int> last(kProducers, -1);
+  int out_of_order = 0;
+
+  Producer producers[kProducers];
+  pthread_t threads[kProducers];
+  for (int i = 0; i < kProducers; ++i) {
+    producers[i].queue = &queue;
+    producers[i].id = i;
+    producers[i].count = kCount;
+    producers[i].last = &last;
+    producers[i].out_of_order = &out_of_order;
+    pthread_create(&threads[i], NULL, &producerMain, &producers[i]);
+  }
+
+  int ran = 0;
+  while (ran < kProducers * kCount) {
+    ran += queue.runTasks();
+  }
+  for (int i = 0; i < kProducers; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  CHECK(ran == kProducers * kCount);
+  CHECK(queue.runTasks() == 0);
+  CHECK(out_of_order == 0);
+  for (int i = 0; i < kProducers; ++i) {
+    CHECK(last[i] == kCount - 1);
+  }
+}
+
+
+int main() {
+  testOrder();
+  testPushWhileRunning();
+  testHeapNodes();
+  testDestroyPending();
+  testProducers();
+
+  if (g_failed) {
+    printf("%d checks failed\n", g_failed);
+    return 1;
+  }
+  printf("test_task_queue ok\n");
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/util.h"
+#include "rocket/net/timer.h"
+#include "rocket/net/timer_event.h"
+
+// Timer wheel driven by hand on this thread, without an EventLoop: events in level 0 and in
+// level 1, which fire only after being cascaded down, fire once and not early. Events cancled
+// or deleted do not fire, a repeated event keeps firing, and size() counts what is scheduled.
+
+static int g_failed = 0;
+
+#define CHECK(cond) \
+  if (!(cond)) { \
+    printf("FAILED %s:%d %s\n", __FILE__, __LINE__, #cond); \
+    g_failed++; \
+  } \
+
+struct Fired {
+  int64_t arrive_time {0};
+  int64_t fired_time {-1};
+  int count {0};
+};
+
+static rocket::TimerEvent::s_ptr addEvent(rocket::Timer& timer, int delay, Fired* fired) {
+  rocket::TimerEvent::s_ptr event = std::make_shared<rocket::TimerEvent>(delay, false, [fired]() {
+    fired->fired_time = rocket::getNowMs();
+    fired->count++;
+  });
+  fired->arrive_time = event->getArriveTime();
+  timer.addTimerEvent(event);
+  return event;
+}
+
+// call onTimer() at every tick the wheel asks for, until end_ms
+static void runUntil(rocket::Timer& timer, int64_t end_ms) {
+  while (true) {
+    int64_t now = rocket::getNowMs();
+    if (now >= end_ms) {
+      return;
+    }
+    int64_t next = timer.getNextArriveTime();
+    if (next == -1 || next > end_ms) {
+      next = end_ms;
+    }
+    if (next > now) {
+      usleep((next - now) * 1000);
+    }
+    timer.onTimer();
+  }
+}
+
+
+int main() {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config::GetGlobalConfig()->m_log_level = "ERROR";
+  rocket::Logger::InitGlobalLogger(0);
+
+  rocket::Timer timer;
+  CHECK(timer.getNextArriveTime() == -1);
+
+  // 1..255ms live in level 0, the rest in level 1 and are cascaded down on the way
+  const int delays[] = {1, 100, 255, 256, 257, 300, 511, 512, 800, 1000};
+  const int count = sizeof(delays) / sizeof(delays[0]);
+  std::vector<Fired> fired(count);
+  for (int i = 0; i < count; ++i) {
+    addEvent(timer, delays[i], &fired[i]);
+  }
+
+  Fired cancled;
+  Fired deleted;
+  Fired far;
+  rocket::TimerEvent::s_ptr cancled_event = addEvent(timer, 600, &cancled);
+  rocket::TimerEvent::s_ptr deleted_event = addEvent(timer, 700, &deleted);
+  rocket::TimerEvent::s_ptr far_event = addEvent(timer, 20000, &far);    // level 2
+
+  int repeats = 0;
+  rocket::TimerEvent::s_ptr repeated = std::make_shared<rocket::TimerEvent>(150, true, [&repeats]() {
+    repeats++;
+  });
+  timer.addTimerEvent(repeated);
+  CHECK(timer.size() == (size_t)count + 4);
+
+  // a cancled event stays in its slot until it is reached, a deleted one leaves at once
+  cancled_event->setCancled(true);
+  timer.deleteTimerEvent(deleted_event);
+  timer.deleteTimerEvent(far_event);
+  CHECK(timer.size() == (size_t)count + 2);
+
+  int64_t begin = rocket::getNowMs();
+  runUntil(timer, begin + 1100);
+
+  for (int i = 0; i < count; ++i) {
+    CHECK(fired[i].count == 1);
+    CHECK(fired[i].fired_time >= fired[i].arrive_time);
+    CHECK(fired[i].fired_time - fired[i].arrive_time < 50);
+    if (fired[i].count != 1 || fired[i].fired_time < fired[i].arrive_time) {
+      printf("  delay %dms: count=%d late by %lldms\n", delays[i], fired[i].count,
+        (long long)(fired[i].fired_time - fired[i].arrive_time));
+    }
+  }
+  CHECK(cancled.count == 0);
+  CHECK(deleted.count == 0);
+  CHECK(far.count == 0);
+  CHECK(repeats >= 6 && repeats <= 7);
+
+  // only the repeated event is left
+  CHECK(timer.size() == 1);
+  timer.deleteTimerEvent(repeated);
+  CHECK(timer.size() == 0);
+  CHECK(timer.getNextArriveTime() == -1);
+
+  if (g_failed) {
+    printf("%d checks failed\n", g_failed);
+    return 1;
+  }
+  printf("test_timer ok\n");
+  return 0;
+}
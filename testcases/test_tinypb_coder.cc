@@ -0,0 +1,138 @@
+#include <string.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/net/tcp/tcp_buffer.h"
+#include "rocket/net/coder/tinypb_coder.h"
+#include "rocket/net/coder/tinypb_v2_coder.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+
+// TinyPBCoder::decode with the default config (checksum on) against frames of every kind of peer:
+// a peer from before the CRC that always sends checksum 1, a peer with the checksum off that
+// sends 0, a current peer, and a frame whose CRC does not match, which has to be dropped.
+// TinyPBV2Coder: a frame with a bad CRC is dropped, a bad frame head desyncs the coder for good.
+
+static int g_failed = 0;
+
+#define CHECK(cond) \
+  if (!(cond)) { \
+    printf("FAILED %s:%d %s\n", __FILE__, __LINE__, #cond); \
+    g_failed++; \
+  } \
+
+static void appendInt32(std::string& out, int32_t value) {
+  int32_t net = htonl(value);
+  out.append(reinterpret_cast<const char*>(&net), sizeof(net));
+}
+
+// the frame as the encoder of the first release wrote it, with checksum htonl(1)
+static std::string baselineFrame(const std::string& msg_id, const std::string& method, const std::string& pb_data, int32_t check_sum) {
+  int pk_len = 2 + 24 + msg_id.length() + method.length() + pb_data.length();
+  std::string frame;
+  frame.push_back(rocket::TinyPBProtocol::PB_START);
+  appendInt32(frame, pk_len);
+  appendInt32(frame, msg_id.length());
+  frame += msg_id;
+  appendInt32(frame, method.length());
+  frame += method;
+  appendInt32(frame, 0);    // err_code
+  appendInt32(frame, 0);    // err_info_len
+  frame += pb_data;
+  appendInt32(frame, check_sum);
+  frame.push_back(rocket::TinyPBProtocol::PB_END);
+  return frame;
+}
+
+static std::vector<rocket::AbstractProtocol::s_ptr> decode(const std::string& bytes) {
+  rocket::TinyPBCoder coder;
+  rocket::TcpBuffer::s_ptr buffer = std::make_shared<rocket::TcpBuffer>(0);
+  buffer->writeToBuffer(bytes.data(), bytes.length());
+  std::vector<rocket::AbstractProtocol::s_ptr> messages;
+  coder.decode(messages, buffer);
+  return messages;
+}
+
+static std::shared_ptr<rocket::TinyPBProtocol> first(const std::vector<rocket::AbstractProtocol::s_ptr>& messages) {
+  return messages.empty() ? NULL : std::dynamic_pointer_cast<rocket::TinyPBProtocol>(messages[0]);
+}
+
+
+int main() {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config::GetGlobalConfig()->m_log_level = "ERROR";
+  rocket::Logger::InitGlobalLogger(0);
+  CHECK(rocket::Config::GetGlobalConfig()->m_tinypb_checksum == 1);
+
+  std::string pb_data(100, 'p');
+
+  // a peer that has not been upgraded
+  std::vector<rocket::AbstractProtocol::s_ptr> messages = decode(baselineFrame("1001", "Order.makeOrder", pb_data, 1));
+  CHECK(messages.size() == 1);
+  std::shared_ptr<rocket::TinyPBProtocol> message = first(messages);
+  CHECK(message && message->m_msg_id == "1001" && message->m_method_name == "Order.makeOrder" && message->m_pb_data == pb_data);
+
+  // a peer with the checksum off
+  messages = decode(baselineFrame("1002", "Order.makeOrder", pb_data, 0));
+  CHECK(messages.size() == 1);
+
+  // a current peer
+  rocket::TinyPBCoder encoder;
+  std::shared_ptr<rocket::TinyPBProtocol> request = std::make_shared<rocket::TinyPBProtocol>();
+  request->m_msg_id = "1003";
+  request->m_method_name = "Order.makeOrder";
+  request->m_pb_data = pb_data;
+  std::vector<rocket::AbstractProtocol::s_ptr> requests(1, request);
+  rocket::TcpBuffer::s_ptr out = std::make_shared<rocket::TcpBuffer>(0);
+  encoder.encode(requests, out);
+  std::string encoded;
+  out->peekString(0, out->readAble(), encoded);
+  messages = decode(encoded);
+  CHECK(messages.size() == 1);
+  message = first(messages);
+  CHECK(message && message->m_msg_id == "1003" && message->m_pb_data == pb_data);
+
+  // a damaged frame is dropped, the one after it still decodes
+  std::string damaged = encoded;
+  damaged[damaged.length() - 10] ^= 1;
+  messages = decode(damaged + baselineFrame("1004", "Order.makeOrder", pb_data, 1));
+  CHECK(messages.size() == 1);
+  message = first(messages);
+  CHECK(message && message->m_msg_id == "1004");
+
+  // v2: the frames before the bad bytes decode, nothing after them does
+  rocket::TinyPBV2Coder v2_encoder;
+  request->m_msg_id = "1005";
+  out = std::make_shared<rocket::TcpBuffer>(0);
+  v2_encoder.encode(requests, out);
+  std::string v2_frame;
+  out->peekString(0, out->readAble(), v2_frame);
+  std::string v2_damaged = v2_frame;
+  v2_damaged[v2_damaged.length() - 10] ^= 1;
+
+  rocket::TinyPBV2Coder v2_decoder;
+  rocket::TcpBuffer::s_ptr in = std::make_shared<rocket::TcpBuffer>(0);
+  std::string v2_bytes = v2_frame + v2_damaged + v2_frame + "junk" + v2_frame;
+  in->writeToBuffer(v2_bytes.data(), v2_bytes.length());
+  messages.clear();
+  v2_decoder.decode(messages, in);
+  CHECK(messages.size() == 2);
+  message = first(messages);
+  CHECK(message && message->m_msg_id == "1005" && message->m_method_name == "Order.makeOrder" && message->m_pb_data == pb_data);
+  CHECK(v2_decoder.isDesynced());
+  messages.clear();
+  in->writeToBuffer(v2_frame.data(), v2_frame.length());
+  v2_decoder.decode(messages, in);
+  CHECK(messages.empty());
+  CHECK(!rocket::TinyPBCoder().isDesynced());
+
+  if (g_failed) {
+    printf("%d checks failed\n", g_failed);
+    return 1;
+  }
+  printf("test_tinypb_coder ok\n");
+  return 0;
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rocket/common/log.h"
+#include "rocket/common/config.h"
+#include "rocket/common/error_code.h"
+#include "rocket/common/msg_id_util.h"
+#include "rocket/net/eventloop.h"
+#include "rocket/net/worker_pool.h"
+#include "rocket/net/tcp/tcp_client.h"
+#include "rocket/net/coder/tinypb_protocol.h"
+#include "bench_util.h"
+
+// WorkerPool: a worker steals the queued task of a blocked one, stop() runs every queued task.
+// RpcDispatcher: with one worker and <worker><max_queue> 2, a blocked handler plus 2 waiting
+// requests are all the service takes, the requests after them are answered ERROR_SERVICE_BUSY.
+
+static int g_failed = 0;
+
+#define CHECK(cond) \
+  if (!(cond)) { \
+    printf("FAILED %s:%d %s\n", __FILE__, __LINE__, #cond); \
+    g_failed++; \
+  } \
+
+// true once flag is set, false after 2s
+static bool waitFor(const std::atomic<bool>& flag) {
+  for (int i = 0; i < 2000 && !flag.load(); ++i) {
+    usleep(1000);
+  }
+  return flag.load();
+}
+
+static void testStealing() {
+  rocket::WorkerPool pool(2);
+  pool.start();
+
+  std::atomic<bool> blocked {false};
+  std::atomic<bool> release {false};
+  std::atomic<bool> stolen_ran {false};
+  std::atomic<bool> in_worker {false};
+  pthread_t blocked_thread = 0;
+
+  // round robin: the 1st and 3rd task go to worker 0, the 2nd to worker 1
+  pool.submit([&]() {
+    blocked_thread = pthread_self();
+    in_worker = rocket::WorkerPool::IsInWorkerThread();
+    blocked = true;
+    waitFor(release);
+  });
+  CHECK(waitFor(blocked));
+  pool.submit([]() {});
+  pool.submit([&]() {
+    stolen_ran = !pthread_equal(pthread_self(), blocked_thread);
+  });
+
+  // worker 0 is still blocked, so worker 1 took the task queued behind it
+  CHECK(waitFor(stolen_ran));
+  CHECK(in_worker.load());
+  CHECK(!rocket::WorkerPool::IsInWorkerThread());
+  release = true;
+
+  pool.stop();
+  rocket::WorkerPool::Stats stats = pool.getStats();
+  CHECK(stats.executed == 3);
+  CHECK(stats.stolen >= 1);
+}
+
+static void testStopRunsQueued() {
+  rocket::WorkerPool pool(4);
+  pool.start();
+  std::atomic<int> ran {0};
+  for (int i = 0; i < 1000; ++i) {
+    pool.submit([&ran]() {
+      ran++;
+    });
+  }
+  pool.stop();
+  CHECK(ran.load() == 1000);
+  CHECK(pool.getStats().executed == 1000);
+}
+
+
+static std::atomic<bool> g_handler_blocked {false};
+static std::atomic<bool> g_handler_release {false};
+
+struct Replies {
+  int ok {0};
+  int busy {0};
+  int other {0};
+};
+
+static void send(rocket::TcpClient& client, Replies* replies, int count) {
+  makeOrderRequest request;
+  request.set_price(100);
+  request.set_goods("apple");
+  for (int i = 0; i < count; ++i) {
+    std::shared_ptr<rocket::TinyPBProtocol> message = std::make_shared<rocket::TinyPBProtocol>();
+    message->m_msg_id = rocket::MsgIDUtil::GenMsgID();
+    message->m_method_name = "Order.makeOrder";
+    request.SerializeToString(&message->m_pb_data);
+    client.readMessage(message->m_msg_id, [replies](rocket::AbstractProtocol::s_ptr msg) {
+      std::shared_ptr<rocket::TinyPBProtocol> response = std::dynamic_pointer_cast<rocket::TinyPBProtocol>(msg);
+      if (response && response->m_err_code == 0) {
+        replies->ok++;
+      } else if (response && response->m_err_code == ERROR_SERVICE_BUSY) {
+        replies->busy++;
+      } else {
+        replies->other++;
+      }
+      if (replies->ok + replies->busy + replies->other == 5) {
+        rocket::EventLoop::GetCurrentEventLoop()->stop();
+      }
+    });
+    client.writeMessage(message, [](rocket::AbstractProtocol::s_ptr) {});
+  }
+}
+
+static void testMaxQueue() {
+  std::shared_ptr<BenchOrderImpl> service = std::make_shared<BenchOrderImpl>([](const makeOrderRequest&) {
+    g_handler_blocked = true;
+    waitFor(g_handler_release);
+  });
+  rocket::NetAddr::s_ptr addr = startBenchServer(12409, [](rocket::Config* config) {
+    config->m_worker_threads = 1;
+    config->m_worker_max_queue = 2;
+  }, service);
+
+  Replies replies;
+  rocket::TcpClient client(addr);
+
+  // once the first request holds the only worker, 2 more wait for it and 2 are turned away.
+  // The busy replies come back while the handler still blocks
+  std::shared_ptr<rocket::TimerEvent> more;
+  more = std::make_shared<rocket::TimerEvent>(1, true, [&more, &client, &replies]() {
+    if (g_handler_blocked && !more->isCancled()) {
+      more->setCancled(true);
+      send(client, &replies, 4);
+    }
+  });
+  rocket::EventLoop::GetCurrentEventLoop()->addTimerEvent(more);
+  std::shared_ptr<rocket::TimerEvent> release = std::make_shared<rocket::TimerEvent>(300, false, []() {
+    g_handler_release = true;
+  });
+  rocket::EventLoop::GetCurrentEventLoop()->addTimerEvent(release);
+  std::shared_ptr<rocket::TimerEvent> timeout = std::make_shared<rocket::TimerEvent>(5000, false, []() {
+    rocket::EventLoop::GetCurrentEventLoop()->stop();
+  });
+  rocket::EventLoop::GetCurrentEventLoop()->addTimerEvent(timeout);
+
+  // connect() runs the loop of this thread until a reply callback stops it
+  client.connect([&client, &replies]() {
+    send(client, &replies, 1);
+  });
+
+  CHECK(replies.ok == 3);
+  CHECK(replies.busy == 2);
+  CHECK(replies.other == 0);
+}
+
+
+int main() {
+  rocket::Config::SetGlobalConfig(NULL);
+  rocket::Config::GetGlobalConfig()->m_log_level = "ERROR";
+  rocket::Logger::InitGlobalLogger(0);
+
+  testStealing();
+  testStopRunsQueued();
+  testMaxQueue();
+
+  if (g_failed) {
+    printf("%d checks failed\n", g_failed);
+    return 1;
+  }
+  printf("test_worker_pool ok\n");
+  return 0;
+}